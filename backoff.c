@@ -0,0 +1,60 @@
+#include <stdlib.h>
+#include <time.h>
+
+#include "backoff.h"
+
+struct backoff {
+	unsigned int min_msec;
+	unsigned int max_msec;
+	unsigned int cur_msec;
+	unsigned int seed;
+};
+
+struct backoff *
+backoff_create (unsigned int min_msec, unsigned int max_msec)
+{
+	struct backoff *b;
+	struct timespec ts;
+
+	if ((b = malloc(sizeof(*b))) == NULL) {
+		return NULL;
+	}
+	b->min_msec = (min_msec > 0) ? min_msec : 1;
+	b->max_msec = (max_msec > b->min_msec) ? max_msec : b->min_msec;
+	b->cur_msec = b->min_msec;
+
+	// Seed each instance differently, so that sources
+	// do not march in step:
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	b->seed = ts.tv_nsec ^ (unsigned int)(size_t)b;
+	return b;
+}
+
+void
+backoff_destroy (struct backoff **b)
+{
+	if (b == NULL || *b == NULL) {
+		return;
+	}
+	free(*b);
+	*b = NULL;
+}
+
+unsigned int
+backoff_next (struct backoff *b)
+{
+	unsigned int cap = b->cur_msec;
+
+	// Wait between half and all of the current cap:
+	unsigned int delay = cap / 2 + rand_r(&b->seed) % (cap - cap / 2 + 1);
+
+	// Double the cap for next time:
+	b->cur_msec = (cap > b->max_msec / 2) ? b->max_msec : cap * 2;
+	return delay;
+}
+
+void
+backoff_reset (struct backoff *b)
+{
+	b->cur_msec = b->min_msec;
+}
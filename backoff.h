@@ -0,0 +1,23 @@
+#ifndef BACKOFF_H
+#define BACKOFF_H
+
+// Delays between reconnection attempts. Each failed attempt doubles the
+// delay, up to a ceiling; a random part spreads out the attempts of many
+// sources that went down at the same time.
+
+// Default bounds for the delay, in milliseconds:
+#define BACKOFF_MIN	500
+#define BACKOFF_MAX	30000
+
+struct backoff;
+
+struct backoff *backoff_create (unsigned int min_msec, unsigned int max_msec);
+void backoff_destroy (struct backoff **);
+
+// Returns the delay before the next attempt, in milliseconds:
+unsigned int backoff_next (struct backoff *);
+
+// Call when a connection has proven to work:
+void backoff_reset (struct backoff *);
+
+#endif	// BACKOFF_H
@@ -0,0 +1,31 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <stdio.h>
+#include <time.h>
+
+// Shared by the benchmarks. Each one prints its results as JSON, one
+// object per line, so that runs can be collected and compared:
+//
+//   {"bench":"grabber","case":"crlf","metric":"mb_per_sec","value":812.4}
+
+// Keep repeating a measurement for at least this long:
+#define BENCH_MIN_SEC	0.5
+
+static inline double
+bench_now (void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static inline void
+bench_result (const char *bench, const char *name, const char *metric, double value)
+{
+	printf("{\"bench\":\"%s\",\"case\":\"%s\",\"metric\":\"%s\",\"value\":%.6g}\n", bench, name, metric, value);
+	fflush(stdout);
+}
+
+#endif	// BENCH_H
@@ -0,0 +1,156 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <jpeglib.h>
+
+#include "../frame.h"
+#include "../pixpool.h"
+#include "bench.h"
+
+// JPEG decoding time per resolution: through frame_to_pixbuf() with a
+// fresh buffer for each frame, then with buffers from a pool, then also
+// with a decoder that is kept across frames, then at reduced sizes for
+// each of the decode profiles, and last to 32-bit pixels for Cairo.
+
+struct resolution {
+	const char *name;
+	unsigned int width;
+	unsigned int height;
+};
+
+static const struct resolution resolutions[] = {
+	{ "320x240",	320,	240 },
+	{ "640x480",	640,	480 },
+	{ "1280x720",	1280,	720 },
+	{ "1920x1080",	1920,	1080 },
+	{ "3840x2160",	3840,	2160 },
+};
+
+// Encode a test picture: a gradient with some noise on top, which
+// compresses about as well as a camera picture:
+static unsigned char *
+make_jpeg (unsigned int width, unsigned int height, unsigned long *len)
+{
+	struct jpeg_compress_struct cinfo;
+	struct jpeg_error_mgr jerr;
+	unsigned char *buf = NULL;
+	unsigned char *row;
+	unsigned int seed = 1;
+
+	if ((row = malloc(width * 3)) == NULL) {
+		return NULL;
+	}
+	cinfo.err = jpeg_std_error(&jerr);
+	jpeg_create_compress(&cinfo);
+	jpeg_mem_dest(&cinfo, &buf, len);
+	cinfo.image_width = width;
+	cinfo.image_height = height;
+	cinfo.input_components = 3;
+	cinfo.in_color_space = JCS_RGB;
+	jpeg_set_defaults(&cinfo);
+	jpeg_set_quality(&cinfo, 85, TRUE);
+	jpeg_start_compress(&cinfo, TRUE);
+
+	while (cinfo.next_scanline < height) {
+		unsigned int y = cinfo.next_scanline;
+
+		for (unsigned int x = 0; x < width * 3; x++) {
+			seed = seed * 1103515245 + 12345;
+			row[x] = (x / 3 * 200 / width + y * 50 / height + ((seed >> 16) & 0x0F)) & 0xFF;
+		}
+		jpeg_write_scanlines(&cinfo, &row, 1);
+	}
+	jpeg_finish_compress(&cinfo);
+	jpeg_destroy_compress(&cinfo);
+	free(row);
+	return buf;
+}
+
+static void
+bench_resolution (const struct resolution *res, struct pixpool *pool, struct frame_decoder *decoder, enum frame_decode_profile profile, enum frame_format format, unsigned int denom)
+{
+	unsigned char *jpeg;
+	unsigned char *pixbuf;
+	unsigned long len;
+	unsigned long frames = 0;
+	struct frame *f;
+	char name[50];
+	char scale[20] = "";
+	double start;
+	double elapsed;
+
+	if ((jpeg = make_jpeg(res->width, res->height, &len)) == NULL) {
+		return;
+	}
+	if ((f = frame_create((char *)jpeg, len)) == NULL) {
+		free(jpeg);
+		return;
+	}
+	if (decoder != NULL) {
+		frame_decoder_set_profile(decoder, profile);
+		frame_decoder_set_format(decoder, format);
+	}
+	start = bench_now();
+	do {
+		pixbuf = (decoder == NULL)
+			? frame_to_pixbuf(f, pool, 0, 0)
+			: frame_decode(decoder, f, pool, res->width / denom, res->height / denom);
+
+		if (pixbuf == NULL) {
+			fprintf(stderr, "Could not decode %s\n", res->name);
+			break;
+		}
+		if (pool == NULL) {
+			free(pixbuf);
+		}
+		else {
+			pixpool_put(pixbuf);
+		}
+		frames++;
+	} while ((elapsed = bench_now() - start) < BENCH_MIN_SEC);
+
+	if (denom > 1) {
+		snprintf(scale, sizeof(scale), "/scale1_%u", denom);
+	}
+	snprintf(name, sizeof(name), "%s%s%s%s%s%s", res->name,
+		(pool == NULL) ? "" : "/pooled",
+		(decoder == NULL) ? "" : "/decoder",
+		(profile == FRAME_DECODE_FAST) ? "/fast" : "",
+		(format == FRAME_FORMAT_XRGB32) ? "/xrgb32" : "",
+		scale);
+	if (frames > 0) {
+		bench_result("decode", name, "msec_per_frame", elapsed * 1e3 / frames);
+		bench_result("decode", name, "mpixels_per_sec", (double)res->width * res->height * frames / elapsed / 1e6);
+	}
+	frame_destroy(&f);
+	free(jpeg);
+}
+
+int
+main ()
+{
+	struct frame_decoder *decoder;
+	struct pixpool *pool;
+
+	if ((pool = pixpool_create()) == NULL) {
+		return 1;
+	}
+	if ((decoder = frame_decoder_create()) == NULL) {
+		pixpool_destroy(&pool);
+		return 1;
+	}
+	for (unsigned int i = 0; i < sizeof(resolutions) / sizeof(resolutions[0]); i++) {
+		bench_resolution(&resolutions[i], NULL, NULL, FRAME_DECODE_QUALITY, FRAME_FORMAT_RGB, 1);
+		bench_resolution(&resolutions[i], pool, NULL, FRAME_DECODE_QUALITY, FRAME_FORMAT_RGB, 1);
+		for (unsigned int denom = 1; denom <= 8; denom *= 2) {
+			bench_resolution(&resolutions[i], pool, decoder, FRAME_DECODE_QUALITY, FRAME_FORMAT_RGB, denom);
+			bench_resolution(&resolutions[i], pool, decoder, FRAME_DECODE_FAST, FRAME_FORMAT_RGB, denom);
+		}
+		bench_resolution(&resolutions[i], pool, decoder, FRAME_DECODE_QUALITY, FRAME_FORMAT_XRGB32, 1);
+		bench_resolution(&resolutions[i], pool, decoder, FRAME_DECODE_FAST, FRAME_FORMAT_XRGB32, 1);
+	}
+	frame_decoder_destroy(&decoder);
+	pixpool_destroy(&pool);
+	return 0;
+}
@@ -0,0 +1,53 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "../filename.h"
+#include "bench.h"
+
+// Cost of forging a file name for each frame.
+
+struct pattern {
+	const char *name;
+	char *pat;
+	const char *srcname;
+};
+
+static struct pattern patterns[] = {
+	{ "frame",		"%f.jpg",		NULL },
+	{ "name_frame",		"%n-%f.jpg",		"camera1" },
+	{ "dir_name_frame",	"/var/spool/%n/%n-%f.jpg", "frontdoor" },
+};
+
+static void
+bench_pattern (const struct pattern *p)
+{
+	unsigned long calls = 0;
+	double start;
+	double elapsed;
+	char *name;
+
+	start = bench_now();
+	do {
+		for (unsigned int i = 0; i < 100000; i++) {
+			if ((name = filename_forge(p->srcname, calls + i, p->pat)) == NULL) {
+				fprintf(stderr, "Could not forge '%s'\n", p->pat);
+				return;
+			}
+			free(name);
+		}
+		calls += 100000;
+	} while ((elapsed = bench_now() - start) < BENCH_MIN_SEC);
+
+	bench_result("filename", p->name, "nsec_per_call", elapsed * 1e9 / calls);
+}
+
+int
+main ()
+{
+	for (unsigned int i = 0; i < sizeof(patterns) / sizeof(patterns[0]); i++) {
+		bench_pattern(&patterns[i]);
+	}
+	return 0;
+}
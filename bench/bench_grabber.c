@@ -0,0 +1,195 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "../frame.h"
+#include "../slab.h"
+#include "../mjv_grabber.h"
+#include "../chunker.h"
+#include "../streamgen.h"
+#include "bench.h"
+
+// Grabber throughput per stream shape. Streams are generated in memory
+// and handed to the grabber in pieces the size of a typical read, so
+// that only the parsing is measured, not the I/O.
+
+#define STREAM_BYTES	(64 * 1024 * 1024)
+#define READ_SIZE	65536
+
+struct shape {
+	const char *name;
+	void (*setup)(struct streamgen_opts *);
+};
+
+static void shape_crlf (struct streamgen_opts *o) { (void)o; }
+static void shape_lf (struct streamgen_opts *o) { o->lf = true; }
+static void shape_no_length (struct streamgen_opts *o) { o->no_length_pct = 100; }
+static void shape_mixed (struct streamgen_opts *o) { o->casing = STREAMGEN_CASING_MIXED; o->no_length_pct = 50; o->garbage_pct = 50; }
+static void shape_small (struct streamgen_opts *o) { o->min_size = 10 * 1024; o->max_size = 20 * 1024; }
+static void shape_large (struct streamgen_opts *o) { o->min_size = 1024 * 1024; o->max_size = 2 * 1024 * 1024; }
+
+static const struct shape shapes[] = {
+	{ "crlf",	shape_crlf },
+	{ "lf",		shape_lf },
+	{ "no-length",	shape_no_length },
+	{ "mixed",	shape_mixed },
+	{ "small",	shape_small },
+	{ "large",	shape_large },
+};
+
+static char *
+generate (const struct shape *shape, size_t *len)
+{
+	struct streamgen_opts opts;
+	char *buf = NULL;
+	FILE *fp;
+
+	streamgen_defaults(&opts);
+	shape->setup(&opts);
+	opts.frames = STREAM_BYTES / ((opts.min_size + opts.max_size) / 2);
+
+	if ((fp = open_memstream(&buf, len)) == NULL) {
+		return NULL;
+	}
+	if (streamgen_write(fp, &opts) == 0) {
+		fclose(fp);
+		free(buf);
+		return NULL;
+	}
+	fclose(fp);
+	return buf;
+}
+
+// Parse the stream once, the way mjv_grabber_read() would get it:
+static unsigned long
+parse_once (const char *buf, size_t len)
+{
+	struct mjv_grabber *g;
+	struct frame *f;
+	unsigned long frames = 0;
+	size_t off = 0;
+
+	if ((g = mjv_grabber_create(NULL)) == NULL) {
+		return 0;
+	}
+	while (off < len) {
+		size_t space;
+		size_t n = (len - off < READ_SIZE) ? len - off : READ_SIZE;
+		void *p = mjv_grabber_write_ptr(g, &space);
+
+		if (p == NULL || space == 0) {
+			break;
+		}
+		if (n > space) {
+			n = space;
+		}
+		memcpy(p, buf + off, n);
+		off += n;
+		if (mjv_grabber_commit(g, n) != MJV_GRABBER_SUCCESS) {
+			break;
+		}
+		while ((f = mjv_grabber_next_frame(g)) != NULL) {
+			frames++;
+			frame_destroy(&f);
+		}
+	}
+	mjv_grabber_destroy(&g);
+	return frames;
+}
+
+static void
+bench_shape (const struct shape *shape)
+{
+	unsigned long frames = 0;
+	unsigned long bytes = 0;
+	double start;
+	double elapsed;
+	size_t len;
+	char *buf;
+
+	if ((buf = generate(shape, &len)) == NULL) {
+		fprintf(stderr, "Could not generate stream '%s'\n", shape->name);
+		return;
+	}
+	start = bench_now();
+	do {
+		frames += parse_once(buf, len);
+		bytes += len;
+	} while ((elapsed = bench_now() - start) < BENCH_MIN_SEC);
+
+	bench_result("grabber", shape->name, "mb_per_sec", bytes / elapsed / 1e6);
+	bench_result("grabber", shape->name, "frames_per_sec", frames / elapsed);
+	free(buf);
+}
+
+static void
+got_frame (struct frame *f, unsigned long framenum, void *user_pointer)
+{
+	(void)framenum;
+	(void)user_pointer;
+
+	frame_destroy(&f);
+}
+
+// Parse a mapped stream in place, on one or more threads:
+static void
+bench_mapped (const struct shape *shape, unsigned int n_workers)
+{
+	struct mjv_grabber_stats stats;
+	unsigned long frames = 0;
+	unsigned long bytes = 0;
+	struct slab *map;
+	char name[50];
+	double start;
+	double elapsed;
+	size_t len;
+	char *buf;
+	int fd;
+
+	if ((buf = generate(shape, &len)) == NULL) {
+		return;
+	}
+	if ((fd = memfd_create("bench_grabber", 0)) < 0 || write(fd, buf, len) != (ssize_t)len) {
+		fprintf(stderr, "Could not create memfd\n");
+		free(buf);
+		return;
+	}
+	free(buf);
+	if ((map = slab_create_mapped(fd, len)) == NULL) {
+		close(fd);
+		return;
+	}
+	close(fd);
+
+	start = bench_now();
+	do {
+		chunker_run(map, n_workers, got_frame, NULL, &stats);
+		frames += stats.frames;
+		bytes += len;
+	} while ((elapsed = bench_now() - start) < BENCH_MIN_SEC);
+
+	snprintf(name, sizeof(name), "%s/mapped/%u", shape->name, n_workers);
+	bench_result("grabber", name, "mb_per_sec", bytes / elapsed / 1e6);
+	bench_result("grabber", name, "frames_per_sec", frames / elapsed);
+	slab_unref(&map);
+}
+
+int
+main ()
+{
+	for (unsigned int i = 0; i < sizeof(shapes) / sizeof(shapes[0]); i++) {
+		bench_shape(&shapes[i]);
+	}
+	// With a Content-Length, most of the image bytes are skipped;
+	// without one, they are all scanned:
+	bench_mapped(&shapes[0], 1);
+	bench_mapped(&shapes[0], 4);
+	bench_mapped(&shapes[2], 1);
+	bench_mapped(&shapes[2], 4);
+
+	return 0;
+}
@@ -0,0 +1,79 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "../frame.h"
+#include "../ringbuf.h"
+#include "../framebuf.h"
+#include "bench.h"
+
+// Cost of appending to a ring buffer, bare and as a frame buffer, where
+// each append also destroys the frame that drops out.
+
+#define RING_SIZE	100
+#define N_FRAMES	100000
+
+static void
+bench_ringbuf (void)
+{
+	struct ringbuf *rb;
+	unsigned long appends = 0;
+	double start;
+	double elapsed;
+
+	if ((rb = ringbuf_create(RING_SIZE, sizeof(void *), NULL)) == NULL) {
+		return;
+	}
+	start = bench_now();
+	do {
+		for (unsigned int i = 0; i < 100000; i++) {
+			void *datum = &appends;
+			ringbuf_append(rb, &datum);
+		}
+		appends += 100000;
+	} while ((elapsed = bench_now() - start) < BENCH_MIN_SEC);
+
+	bench_result("ringbuf", "ringbuf_append", "nsec_per_call", elapsed * 1e9 / appends);
+	ringbuf_destroy(&rb);
+}
+
+static void
+bench_framebuf (void)
+{
+	static struct frame *frames[N_FRAMES];
+	struct framebuf *fb;
+	char jpeg[] = "\xff\xd8\xff\xd9";
+	unsigned long appends = 0;
+	double elapsed = 0.0;
+	double start;
+
+	if ((fb = framebuf_create(RING_SIZE)) == NULL) {
+		return;
+	}
+	// The framebuf takes ownership of the frames, so make new
+	// ones for each round, outside of the measurement:
+	do {
+		for (unsigned int i = 0; i < N_FRAMES; i++) {
+			frames[i] = frame_create(jpeg, sizeof(jpeg) - 1);
+		}
+		start = bench_now();
+		for (unsigned int i = 0; i < N_FRAMES; i++) {
+			framebuf_append(fb, frames[i]);
+		}
+		elapsed += bench_now() - start;
+		appends += N_FRAMES;
+	} while (elapsed < BENCH_MIN_SEC);
+
+	bench_result("ringbuf", "framebuf_append", "nsec_per_call", elapsed * 1e9 / appends);
+	framebuf_destroy(&fb);
+}
+
+int
+main ()
+{
+	bench_ringbuf();
+	bench_framebuf();
+
+	return 0;
+}
@@ -0,0 +1,80 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../filename.h"
+#include "bench.h"
+
+// The path that writes each frame to its own file, as the dumpers do:
+// filename_write_image() forges a name, writes the file, and sets its
+// time to the frame's.
+
+#define FILES_PER_ROUND	500
+
+static void
+remove_files (const char *dir, unsigned int n)
+{
+	char path[100];
+
+	for (unsigned int i = 0; i < n; i++) {
+		snprintf(path, sizeof(path), "%s/%u.jpg", dir, i);
+		unlink(path);
+	}
+}
+
+static void
+bench_size (const char *dir, const char *name, size_t nbytes)
+{
+	struct timespec now;
+	unsigned long frames = 0;
+	double elapsed = 0.0;
+	double start;
+	char pat[100];
+	char *data;
+
+	if ((data = malloc(nbytes)) == NULL) {
+		return;
+	}
+	memset(data, 0x55, nbytes);
+	clock_gettime(CLOCK_REALTIME, &now);
+	snprintf(pat, sizeof(pat), "%s/%%f.jpg", dir);
+
+	// Remove the files between rounds, outside the measurement:
+	do {
+		start = bench_now();
+		for (unsigned int i = 0; i < FILES_PER_ROUND; i++) {
+			if (!filename_write_image(pat, NULL, i, data, nbytes, &now)) {
+				fprintf(stderr, "Could not write to %s\n", dir);
+				free(data);
+				return;
+			}
+		}
+		elapsed += bench_now() - start;
+		frames += FILES_PER_ROUND;
+		remove_files(dir, FILES_PER_ROUND);
+	} while (elapsed < BENCH_MIN_SEC);
+
+	bench_result("write", name, "frames_per_sec", frames / elapsed);
+	bench_result("write", name, "mb_per_sec", frames * nbytes / elapsed / 1e6);
+	free(data);
+}
+
+int
+main ()
+{
+	char dir[] = "/tmp/bench_write_XXXXXX";
+
+	if (mkdtemp(dir) == NULL) {
+		perror("mkdtemp");
+		return 1;
+	}
+	bench_size(dir, "50k", 50 * 1024);
+	bench_size(dir, "500k", 500 * 1024);
+
+	rmdir(dir);
+	return 0;
+}
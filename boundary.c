@@ -0,0 +1,107 @@
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "memscan.h"
+#include "boundary.h"
+
+struct boundary {
+	char *str;
+	unsigned int len;
+
+	// Horspool skip table: how far the search window can shift
+	// when its last byte is a given character:
+	unsigned int skip[256];
+};
+
+struct boundary *
+boundary_create (const char *const str, const unsigned int len)
+{
+	struct boundary *b;
+
+	if (str == NULL || len == 0) {
+		return NULL;
+	}
+	if ((b = malloc(sizeof(*b))) == NULL) {
+		return NULL;
+	}
+	if ((b->str = malloc(len + 1)) == NULL) {
+		free(b);
+		return NULL;
+	}
+	memcpy(b->str, str, len);
+	b->str[len] = '\0';
+	b->len = len;
+
+	// Build the skip table once, so that searches need not:
+	for (unsigned int i = 0; i < 256; i++) {
+		b->skip[i] = len;
+	}
+	for (unsigned int i = 0; i < len - 1; i++) {
+		b->skip[(unsigned char)str[i]] = len - 1 - i;
+	}
+	return b;
+}
+
+void
+boundary_destroy (struct boundary **b)
+{
+	if (b == NULL || *b == NULL) {
+		return;
+	}
+	free((*b)->str);
+	free(*b);
+	*b = NULL;
+}
+
+static const char *
+find_horspool (const struct boundary *const b, const char *start, const char *end)
+{
+	const char *p = start;
+	const char *last = b->str + b->len - 1;
+
+	while (end - p >= (long)b->len) {
+		char c = p[b->len - 1];
+		if (c == *last && memcmp(p, b->str, b->len - 1) == 0) {
+			return p;
+		}
+		p += b->skip[(unsigned char)c];
+	}
+	return NULL;
+}
+
+static const char *
+find_vectorized (const struct boundary *const b, const char *start, const char *end)
+{
+	const char *p = start;
+
+	// Let the vector scanner find positions where both the first and
+	// the last byte of the boundary match, then verify the middle part:
+	while ((p = memscan_pair(p, end, b->str[0], b->str[b->len - 1], b->len - 1)) != NULL) {
+		if (b->len <= 2 || memcmp(p + 1, b->str + 1, b->len - 2) == 0) {
+			return p;
+		}
+		p++;
+	}
+	return NULL;
+}
+
+const char *
+boundary_find (const struct boundary *const b, const char *start, const char *end)
+{
+	return (memscan_get_engine() == MEMSCAN_SCALAR)
+		? find_horspool(b, start, end)
+		: find_vectorized(b, start, end);
+}
+
+const char *
+boundary_get_string (const struct boundary *const b)
+{
+	return b->str;
+}
+
+unsigned int
+boundary_get_len (const struct boundary *const b)
+{
+	return b->len;
+}
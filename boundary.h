@@ -0,0 +1,15 @@
+#ifndef BOUNDARY_H
+#define BOUNDARY_H
+
+struct boundary;
+
+struct boundary *boundary_create (const char *const str, const unsigned int len);
+void boundary_destroy (struct boundary **);
+
+// Find the first occurrence of the boundary string in [start, end):
+const char *boundary_find (const struct boundary *const, const char *start, const char *end);
+
+const char *boundary_get_string (const struct boundary *const);
+unsigned int boundary_get_len (const struct boundary *const);
+
+#endif	// BOUNDARY_H
@@ -0,0 +1,225 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "mjv_log.h"
+#include "frame.h"
+#include "slab.h"
+#include "mjv_grabber.h"
+#include "chunker.h"
+
+struct worker {
+	pthread_t thread;
+	struct mjv_grabber *grabber;
+	struct slab *map;
+	size_t from;		// start of the range to parse;
+	size_t to;		// end of the range to parse;
+	size_t stop;		// the boundary where parsing stopped;
+	enum mjv_grabber_status status;
+
+	// Frames found in the range, in order:
+	struct frame **frames;
+	unsigned int n_frames;
+	unsigned int size;
+
+	unsigned long first_framenum;
+	void (*got_frame)(struct frame *, unsigned long, void *);
+	void *user_pointer;
+};
+
+static void
+collect_frames (struct frame **frames, unsigned int n, void *user_pointer)
+{
+	struct worker *w = user_pointer;
+
+	// Grow the array if needed:
+	if (w->n_frames + n > w->size) {
+		unsigned int size = (w->size == 0) ? 64 : w->size;
+		struct frame **f;
+
+		while (size < w->n_frames + n) {
+			size *= 2;
+		}
+		if ((f = realloc(w->frames, size * sizeof(*f))) == NULL) {
+			log_error("Out of memory, dropping %u frames\n", n);
+			for (unsigned int i = 0; i < n; i++) {
+				frame_destroy(&frames[i]);
+			}
+			return;
+		}
+		w->frames = f;
+		w->size = size;
+	}
+	memcpy(w->frames + w->n_frames, frames, n * sizeof(*frames));
+	w->n_frames += n;
+}
+
+static void *
+parse_main (void *user_pointer)
+{
+	struct worker *w = user_pointer;
+
+	w->status = mjv_grabber_parse_range(w->grabber, w->map, w->from, w->to, &w->stop);
+	return NULL;
+}
+
+static void *
+deliver_main (void *user_pointer)
+{
+	struct worker *w = user_pointer;
+
+	// Hand over the frames in order, numbered across the whole file:
+	for (unsigned int i = 0; i < w->n_frames; i++) {
+		w->got_frame(w->frames[i], w->first_framenum + i, w->user_pointer);
+	}
+	w->n_frames = 0;
+	return NULL;
+}
+
+static bool
+run_workers (struct worker *w, unsigned int n_workers, void *(*main)(void *))
+{
+	unsigned int i;
+	bool ret = true;
+
+	// The first range runs on the calling thread:
+	for (i = 1; i < n_workers; i++) {
+		if (pthread_create(&w[i].thread, NULL, main, &w[i]) != 0) {
+			log_error("Could not create worker thread\n");
+			ret = false;
+			break;
+		}
+	}
+	main(&w[0]);
+	while (--i > 0) {
+		pthread_join(w[i].thread, NULL);
+	}
+	return ret;
+}
+
+static void
+stitch (struct worker *w, unsigned int n_workers, const char *base)
+{
+	size_t covered = w[0].stop;
+
+	// Each range ends at the first boundary at or past its end, which
+	// normally is exactly where the next range started. But a search
+	// in the middle of a file can be fooled by a boundary string in
+	// the image data, which the previous range skipped over. Drop any
+	// frames before the point that the previous ranges already got to:
+	for (unsigned int i = 1; i < n_workers; i++) {
+		unsigned int keep = 0;
+
+		for (unsigned int j = 0; j < w[i].n_frames; j++) {
+			if ((size_t)((char *)frame_get_rawbits(w[i].frames[j]) - base) < covered) {
+				frame_destroy(&w[i].frames[j]);
+				continue;
+			}
+			w[i].frames[keep++] = w[i].frames[j];
+		}
+		if (keep < w[i].n_frames) {
+			log_info("Dropped %u frames found twice near offset %zu\n", w[i].n_frames - keep, covered);
+			w[i].n_frames = keep;
+		}
+		if (w[i].stop > covered) {
+			covered = w[i].stop;
+		}
+	}
+	// Number the frames:
+	for (unsigned int i = 1; i < n_workers; i++) {
+		w[i].first_framenum = w[i - 1].first_framenum + w[i - 1].n_frames;
+	}
+}
+
+static void
+add_stats (struct mjv_grabber_stats *total, const struct mjv_grabber *g)
+{
+	struct mjv_grabber_stats stats;
+
+	mjv_grabber_get_stats(g, &stats);
+	total->bad_start += stats.bad_start;
+	total->bad_end += stats.bad_end;
+	total->bad_segment += stats.bad_segment;
+	total->oversize += stats.oversize;
+}
+
+enum mjv_grabber_status
+chunker_run (struct slab *map, unsigned int n_workers, void (*got_frame)(struct frame *, unsigned long, void *), void *user_pointer, struct mjv_grabber_stats *stats)
+{
+	enum mjv_grabber_status status = MJV_GRABBER_READ_ERROR;
+	struct mjv_grabber *header;
+	struct worker *w;
+	size_t start;
+	size_t size = slab_size(map);
+	unsigned int i;
+
+	memset(stats, 0, sizeof(*stats));
+	if (n_workers == 0) {
+		n_workers = 1;
+	}
+	// Read the HTTP header to learn the boundary, and find the start
+	// of the first part:
+	if ((header = mjv_grabber_create(NULL)) == NULL) {
+		return MJV_GRABBER_READ_ERROR;
+	}
+	if ((status = mjv_grabber_parse_range(header, map, 0, 0, &start)) != MJV_GRABBER_SUCCESS) {
+		goto err0;
+	}
+	if ((w = calloc(n_workers, sizeof(*w))) == NULL) {
+		status = MJV_GRABBER_READ_ERROR;
+		goto err0;
+	}
+	// Divide the rest of the file into equal ranges,
+	// and give each worker a grabber for its range:
+	for (i = 0; i < n_workers; i++) {
+		w[i].map = map;
+		w[i].from = start + (size - start) / n_workers * i;
+		w[i].to = (i == n_workers - 1) ? size : start + (size - start) / n_workers * (i + 1);
+		w[i].first_framenum = 1;
+		w[i].got_frame = got_frame;
+		w[i].user_pointer = user_pointer;
+
+		if ((w[i].grabber = mjv_grabber_create(NULL)) == NULL
+		 || !mjv_grabber_copy_boundary(w[i].grabber, header)) {
+			status = MJV_GRABBER_READ_ERROR;
+			goto err1;
+		}
+		mjv_grabber_set_batch_callback(w[i].grabber, collect_frames, &w[i]);
+	}
+	log_debug("Parsing %zu bytes in %u ranges\n", size - start, n_workers);
+
+	// First parse all ranges, then number the frames and hand them over
+	// to the callback, from as many threads:
+	if (!run_workers(w, n_workers, parse_main)) {
+		status = MJV_GRABBER_READ_ERROR;
+		goto err1;
+	}
+	stitch(w, n_workers, slab_data(map));
+	stats->frames = w[n_workers - 1].first_framenum - 1 + w[n_workers - 1].n_frames;
+
+	if (!run_workers(w, n_workers, deliver_main)) {
+		status = MJV_GRABBER_READ_ERROR;
+		goto err1;
+	}
+	// Report the first error, if any; the other ranges were still parsed:
+	status = MJV_GRABBER_SUCCESS;
+	for (i = 0; i < n_workers; i++) {
+		if (status == MJV_GRABBER_SUCCESS) {
+			status = w[i].status;
+		}
+		add_stats(stats, w[i].grabber);
+	}
+
+err1:	for (i = 0; i < n_workers; i++) {
+		while (w[i].n_frames > 0) {
+			frame_destroy(&w[i].frames[--w[i].n_frames]);
+		}
+		free(w[i].frames);
+		mjv_grabber_destroy(&w[i].grabber);
+	}
+	free(w);
+err0:	mjv_grabber_destroy(&header);
+	return status;
+}
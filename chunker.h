@@ -0,0 +1,18 @@
+#ifndef CHUNKER_H
+#define CHUNKER_H
+
+// Extract the frames from a large recorded file, mapped into memory, on
+// several threads at once. The file is split into equal ranges, and each
+// range is parsed by its own grabber, starting at the first boundary in
+// it. The results are stitched back together in order, and the frames
+// are then handed to the callback with their frame number in the file,
+// counting from one. The callback is called from all threads at once,
+// but sees the frames from each range in order, and owns them:
+
+struct slab;
+struct frame;
+struct mjv_grabber_stats;
+
+enum mjv_grabber_status chunker_run (struct slab *map, unsigned int n_workers, void (*got_frame)(struct frame *, unsigned long framenum, void *), void *user_pointer, struct mjv_grabber_stats *);
+
+#endif	// CHUNKER_H
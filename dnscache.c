@@ -0,0 +1,177 @@
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netdb.h>
+
+#include "mjv_log.h"
+#include "dnscache.h"
+
+#define DNSCACHE_TTL_SEC	60
+
+struct entry {
+	char *host;
+	char *port;
+	struct dnscache_addr *addrs;
+	unsigned int n_addrs;
+	time_t expires;
+	bool pending;		// a lookup is in progress;
+	struct entry *next;
+};
+
+static struct entry *entries = NULL;
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t done = PTHREAD_COND_INITIALIZER;
+
+static time_t
+now_sec (void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec;
+}
+
+static struct entry *
+find_entry (const char *host, const char *port)
+{
+	struct entry *e;
+
+	for (e = entries; e; e = e->next) {
+		if (strcmp(e->host, host) == 0 && strcmp(e->port, port) == 0) {
+			return e;
+		}
+	}
+	return NULL;
+}
+
+static struct entry *
+add_entry (const char *host, const char *port)
+{
+	struct entry *e;
+
+	if ((e = calloc(1, sizeof(*e))) == NULL) {
+		return NULL;
+	}
+	if ((e->host = strdup(host)) == NULL || (e->port = strdup(port)) == NULL) {
+		free(e->host);
+		free(e);
+		return NULL;
+	}
+	e->next = entries;
+	entries = e;
+	return e;
+}
+
+static unsigned int
+resolve (const char *host, const char *port, struct dnscache_addr **addrs)
+{
+	struct addrinfo hints;
+	struct addrinfo *result;
+	struct addrinfo *rp;
+	unsigned int n = 0;
+	int ret;
+
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	hints.ai_protocol = IPPROTO_TCP;
+
+	if ((ret = getaddrinfo(host, port, &hints, &result)) != 0) {
+		log_error("getaddrinfo(%s): %s\n", host, gai_strerror(ret));
+		return 0;
+	}
+	for (rp = result; rp; rp = rp->ai_next) {
+		n++;
+	}
+	if ((*addrs = malloc(n * sizeof(**addrs))) == NULL) {
+		freeaddrinfo(result);
+		return 0;
+	}
+	// Keep the order in which the resolver sorted them:
+	for (n = 0, rp = result; rp; rp = rp->ai_next) {
+		if (rp->ai_addrlen > sizeof((*addrs)[n].addr)) {
+			continue;
+		}
+		(*addrs)[n].family = rp->ai_family;
+		(*addrs)[n].addrlen = rp->ai_addrlen;
+		memcpy(&(*addrs)[n].addr, rp->ai_addr, rp->ai_addrlen);
+		n++;
+	}
+	freeaddrinfo(result);
+	return n;
+}
+
+static unsigned int
+copy_addrs (const struct entry *e, struct dnscache_addr **addrs)
+{
+	if (e->n_addrs == 0) {
+		return 0;
+	}
+	if ((*addrs = malloc(e->n_addrs * sizeof(**addrs))) == NULL) {
+		return 0;
+	}
+	memcpy(*addrs, e->addrs, e->n_addrs * sizeof(**addrs));
+	return e->n_addrs;
+}
+
+unsigned int
+dnscache_lookup (const char *host, const char *port, struct dnscache_addr **addrs)
+{
+	struct dnscache_addr *fresh = NULL;
+	struct entry *e;
+	unsigned int n;
+
+	pthread_mutex_lock(&lock);
+
+	// Wait for any lookup of this name that is already under way:
+	while ((e = find_entry(host, port)) != NULL && e->pending) {
+		pthread_cond_wait(&done, &lock);
+	}
+	if (e != NULL && e->n_addrs > 0 && now_sec() < e->expires) {
+		n = copy_addrs(e, addrs);
+		pthread_mutex_unlock(&lock);
+		return n;
+	}
+	if (e == NULL && (e = add_entry(host, port)) == NULL) {
+		pthread_mutex_unlock(&lock);
+		return 0;
+	}
+	// Resolve without holding the lock:
+	e->pending = true;
+	pthread_mutex_unlock(&lock);
+
+	n = resolve(host, port, &fresh);
+
+	pthread_mutex_lock(&lock);
+	if (n > 0) {
+		free(e->addrs);
+		e->addrs = fresh;
+		e->n_addrs = n;
+		e->expires = now_sec() + DNSCACHE_TTL_SEC;
+	}
+	else if (e->n_addrs > 0) {
+		log_info("%s: lookup failed, using last known addresses\n", host);
+	}
+	e->pending = false;
+	pthread_cond_broadcast(&done);
+
+	n = copy_addrs(e, addrs);
+	pthread_mutex_unlock(&lock);
+	return n;
+}
+
+void
+dnscache_expire (const char *host, const char *port)
+{
+	struct entry *e;
+
+	pthread_mutex_lock(&lock);
+	if ((e = find_entry(host, port)) != NULL) {
+		e->expires = 0;
+	}
+	pthread_mutex_unlock(&lock);
+}
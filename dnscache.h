@@ -0,0 +1,21 @@
+#ifndef DNSCACHE_H
+#define DNSCACHE_H
+
+// A process-wide cache of resolved addresses, shared by all sources. Many
+// cameras behind one recorder resolve the same host; only the first lookup
+// goes out, and concurrent lookups for the same name wait for it. When a
+// lookup fails, the last known addresses are returned if there are any.
+
+struct dnscache_addr {
+	int family;
+	socklen_t addrlen;
+	struct sockaddr_storage addr;
+};
+
+// Returns the number of addresses; *addrs must be freed by the caller:
+unsigned int dnscache_lookup (const char *host, const char *port, struct dnscache_addr **addrs);
+
+// Forget the addresses for this host, for instance when none connect:
+void dnscache_expire (const char *host, const char *port);
+
+#endif	// DNSCACHE_H
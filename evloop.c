@@ -0,0 +1,791 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+
+#include "mjv_log.h"
+#include "frame.h"
+#include "source.h"
+#include "mjv_grabber.h"
+#include "backoff.h"
+#include "pacer.h"
+#include "evloop.h"
+
+#define MAX_EVENTS	64
+
+// Most lookups to run at once; a hanging one holds up only its thread:
+#define MAX_RESOLVERS	8
+
+// What an epoll event refers to:
+enum watch_type
+{ WATCH_SOURCE
+, WATCH_TIMER
+, WATCH_PACE
+, WATCH_RESOLVED
+, WATCH_STOP
+};
+
+struct watch {
+	enum watch_type type;
+	struct entry *entry;
+};
+
+struct entry {
+	struct source *source;
+	struct mjv_grabber *grabber;
+	void (*got_frame)(struct frame *, void *);
+	void *user_pointer;
+
+	bool active;		// source is open;
+	bool resolving;		// queued for the resolver thread;
+	bool connecting;	// open in steps under way;
+	bool waiting;		// waiting to reconnect;
+	bool dead;		// given up on;
+	bool always_ready;	// cannot be polled, such as a regular file;
+	bool seen_frame;	// a frame arrived since opening;
+	bool paused;		// not reading while a frame is held;
+	int timerfd;
+	struct backoff *backoff;
+	struct pacer *pacer;	// if the source is paced;
+	struct frame *held;	// next frame, held back till it is due;
+	struct timespec last_active;	// time of last read;
+	struct timespec last_frame;	// time of last frame;
+
+	struct watch source_watch;
+	struct watch timer_watch;
+	struct watch pace_watch;
+	struct entry *next;
+
+	// Owned by the resolver thread while resolving:
+	bool prepared;		// the prepare step succeeded;
+	struct entry *resolve_next;
+};
+
+struct evloop {
+	int epfd;
+	int stopfd;
+	unsigned int timeout_sec;
+	unsigned int n_live;
+	unsigned int n_always_ready;
+	struct watch stop_watch;
+	struct entry *entries;
+
+	// The resolver threads run the blocking prepare steps. They are
+	// started as needed, and hand back finished entries through resolvedfd:
+	pthread_t resolvers[MAX_RESOLVERS];
+	unsigned int n_resolvers;
+	unsigned int n_idle;
+	unsigned int n_queued;
+	bool resolver_quit;
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	struct entry *resolve_head;
+	struct entry **resolve_tail;
+	struct entry *resolved;
+	int resolvedfd;
+	struct watch resolved_watch;
+};
+
+struct evloop *
+evloop_create (unsigned int timeout_sec)
+{
+	struct evloop *l;
+	struct epoll_event ev;
+
+	if ((l = malloc(sizeof(*l))) == NULL) {
+		goto err0;
+	}
+	l->timeout_sec = timeout_sec;
+	l->n_live = 0;
+	l->n_always_ready = 0;
+	l->entries = NULL;
+	l->n_resolvers = 0;
+	l->n_idle = 0;
+	l->n_queued = 0;
+	l->resolver_quit = false;
+	l->resolve_head = NULL;
+	l->resolve_tail = &l->resolve_head;
+	l->resolved = NULL;
+
+	if (pthread_mutex_init(&l->mutex, NULL) != 0) {
+		goto err1;
+	}
+	if (pthread_cond_init(&l->cond, NULL) != 0) {
+		goto err2;
+	}
+	if ((l->epfd = epoll_create1(EPOLL_CLOEXEC)) < 0) {
+		log_error("epoll_create1: %s\n", strerror(errno));
+		goto err3;
+	}
+	// Writing to this eventfd wakes up and stops the loop:
+	if ((l->stopfd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) < 0) {
+		log_error("eventfd: %s\n", strerror(errno));
+		goto err4;
+	}
+	l->stop_watch.type = WATCH_STOP;
+	l->stop_watch.entry = NULL;
+
+	ev.events = EPOLLIN;
+	ev.data.ptr = &l->stop_watch;
+	if (epoll_ctl(l->epfd, EPOLL_CTL_ADD, l->stopfd, &ev) < 0) {
+		log_error("epoll_ctl: %s\n", strerror(errno));
+		goto err5;
+	}
+	// The resolver thread writes to this eventfd when it is done:
+	if ((l->resolvedfd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) < 0) {
+		log_error("eventfd: %s\n", strerror(errno));
+		goto err5;
+	}
+	l->resolved_watch.type = WATCH_RESOLVED;
+	l->resolved_watch.entry = NULL;
+
+	ev.events = EPOLLIN;
+	ev.data.ptr = &l->resolved_watch;
+	if (epoll_ctl(l->epfd, EPOLL_CTL_ADD, l->resolvedfd, &ev) < 0) {
+		log_error("epoll_ctl: %s\n", strerror(errno));
+		goto err6;
+	}
+	return l;
+
+err6:	close(l->resolvedfd);
+err5:	close(l->stopfd);
+err4:	close(l->epfd);
+err3:	pthread_cond_destroy(&l->cond);
+err2:	pthread_mutex_destroy(&l->mutex);
+err1:	free(l);
+err0:	return NULL;
+}
+
+static bool
+arm_timer (int timerfd, time_t sec, long nsec)
+{
+	struct itimerspec its;
+
+	memset(&its, 0, sizeof(its));
+	its.it_value.tv_sec = sec;
+	its.it_value.tv_nsec = nsec;
+
+	return (timerfd_settime(timerfd, 0, &its, NULL) == 0);
+}
+
+static void
+entry_pause (struct evloop *l, struct entry *e)
+{
+	struct epoll_event ev;
+
+	// Stop reading while a frame is held back. The frames that
+	// were already read are plenty to be getting on with:
+	if (e->paused) {
+		return;
+	}
+	if (e->always_ready) {
+		l->n_always_ready--;
+	}
+	else {
+		ev.events = 0;
+		ev.data.ptr = &e->source_watch;
+		epoll_ctl(l->epfd, EPOLL_CTL_MOD, e->source->fd, &ev);
+	}
+	e->paused = true;
+}
+
+static void
+entry_resume (struct evloop *l, struct entry *e)
+{
+	struct epoll_event ev;
+
+	if (!e->paused) {
+		return;
+	}
+	if (e->always_ready) {
+		l->n_always_ready++;
+	}
+	else {
+		ev.events = EPOLLIN;
+		ev.data.ptr = &e->source_watch;
+		epoll_ctl(l->epfd, EPOLL_CTL_MOD, e->source->fd, &ev);
+	}
+	e->paused = false;
+}
+
+static void
+entry_close (struct evloop *l, struct entry *e)
+{
+	// Give up on a connect in flight:
+	if (e->connecting) {
+		e->source->close(e->source);
+		e->connecting = false;
+		return;
+	}
+	if (!e->active) {
+		return;
+	}
+	entry_resume(l, e);
+	frame_destroy(&e->held);
+	// Closing the descriptor also removes it from the epoll set:
+	if (e->always_ready) {
+		l->n_always_ready--;
+	}
+	e->source->close(e->source);
+	e->active = false;
+}
+
+static void
+entry_retry (struct evloop *l, struct entry *e)
+{
+	unsigned int delay = backoff_next(e->backoff);
+
+	// Close the source and try again after a while. The grabber
+	// starts over, but keeps its buffers:
+	entry_close(l, e);
+	mjv_grabber_reset(e->grabber);
+	log_info("%s: reconnecting in %u ms\n", source_get_name(e->source), delay);
+	arm_timer(e->timerfd, delay / 1000, (delay % 1000) * 1000000L);
+	e->waiting = true;
+}
+
+static void
+entry_drop (struct evloop *l, struct entry *e)
+{
+	// The entry itself stays around till the loop is destroyed, so that
+	// pending events in the current batch do not refer to freed memory:
+	entry_close(l, e);
+	arm_timer(e->timerfd, 0, 0);
+	e->waiting = false;
+	e->dead = true;
+	l->n_live--;
+}
+
+void
+evloop_destroy (struct evloop **l)
+{
+	struct entry *e;
+
+	if (l == NULL || *l == NULL) {
+		return;
+	}
+	// Let the resolvers finish their current lookups and quit:
+	pthread_mutex_lock(&(*l)->mutex);
+	(*l)->resolver_quit = true;
+	pthread_cond_broadcast(&(*l)->cond);
+	pthread_mutex_unlock(&(*l)->mutex);
+	for (unsigned int i = 0; i < (*l)->n_resolvers; i++) {
+		pthread_join((*l)->resolvers[i], NULL);
+	}
+	while ((e = (*l)->entries) != NULL) {
+		(*l)->entries = e->next;
+		entry_close(*l, e);
+		pacer_destroy(&e->pacer);
+		backoff_destroy(&e->backoff);
+		close(e->timerfd);
+		free(e);
+	}
+	close((*l)->resolvedfd);
+	close((*l)->stopfd);
+	close((*l)->epfd);
+	pthread_cond_destroy(&(*l)->cond);
+	pthread_mutex_destroy(&(*l)->mutex);
+	free(*l);
+	*l = NULL;
+}
+
+bool
+evloop_add (struct evloop *l, struct source *s, struct mjv_grabber *g, void (*got_frame)(struct frame *, void *), void *user_pointer)
+{
+	struct entry *e;
+	struct epoll_event ev;
+	unsigned int interval_usec;
+	bool original_timing;
+	double speed;
+
+	if ((e = malloc(sizeof(*e))) == NULL) {
+		goto err0;
+	}
+	e->source = s;
+	e->grabber = g;
+	e->got_frame = got_frame;
+	e->user_pointer = user_pointer;
+	e->active = false;
+	e->resolving = false;
+	e->connecting = false;
+	e->waiting = false;
+	e->dead = false;
+	e->always_ready = false;
+	e->seen_frame = false;
+	e->paused = false;
+	e->pacer = NULL;
+	e->held = NULL;
+
+	e->source_watch.type = WATCH_SOURCE;
+	e->source_watch.entry = e;
+	e->timer_watch.type = WATCH_TIMER;
+	e->timer_watch.entry = e;
+	e->pace_watch.type = WATCH_PACE;
+	e->pace_watch.entry = e;
+
+	if ((e->backoff = backoff_create(BACKOFF_MIN, BACKOFF_MAX)) == NULL) {
+		goto err1;
+	}
+	// The timer lives as long as the entry. It times out reads while
+	// connected, and times reconnection attempts while not:
+	if ((e->timerfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC)) < 0) {
+		goto err2;
+	}
+	ev.events = EPOLLIN;
+	ev.data.ptr = &e->timer_watch;
+	if (epoll_ctl(l->epfd, EPOLL_CTL_ADD, e->timerfd, &ev) < 0) {
+		goto err3;
+	}
+	// Paced sources hold back frames till the pacer's timer fires:
+	if (source_get_pace(s, &interval_usec, &original_timing, &speed)) {
+		if ((e->pacer = pacer_create(interval_usec, original_timing, speed)) == NULL) {
+			goto err3;
+		}
+		ev.events = EPOLLIN;
+		ev.data.ptr = &e->pace_watch;
+		if (epoll_ctl(l->epfd, EPOLL_CTL_ADD, pacer_get_fd(e->pacer), &ev) < 0) {
+			goto err4;
+		}
+	}
+	e->next = l->entries;
+	l->entries = e;
+	l->n_live++;
+	return true;
+
+err4:	pacer_destroy(&e->pacer);
+err3:	close(e->timerfd);
+err2:	backoff_destroy(&e->backoff);
+err1:	free(e);
+err0:	return false;
+}
+
+static bool
+entry_activate (struct evloop *l, struct entry *e)
+{
+	struct epoll_event ev;
+	int flags;
+
+	// The loop never waits inside a read:
+	if ((flags = fcntl(e->source->fd, F_GETFL)) < 0
+	 || fcntl(e->source->fd, F_SETFL, flags | O_NONBLOCK) < 0) {
+		goto err;
+	}
+	e->always_ready = false;
+	ev.events = EPOLLIN;
+	ev.data.ptr = &e->source_watch;
+	if (epoll_ctl(l->epfd, EPOLL_CTL_ADD, e->source->fd, &ev) < 0) {
+		// Regular files cannot be polled, but are always readable:
+		if (errno != EPERM) {
+			log_error("epoll_ctl: %s\n", strerror(errno));
+			goto err;
+		}
+		e->always_ready = true;
+		l->n_always_ready++;
+	}
+	// The timer is armed once per timeout period, not on every read;
+	// when it expires, it is checked against the time of the last read
+	// and the last frame:
+	arm_timer(e->timerfd, (e->always_ready) ? 0 : l->timeout_sec, 0);
+
+	clock_gettime(CLOCK_MONOTONIC, &e->last_active);
+	e->last_frame = e->last_active;
+	e->seen_frame = false;
+	e->waiting = false;
+	e->active = true;
+
+	// The reopened stream starts its own schedule:
+	if (e->pacer != NULL) {
+		pacer_reset(e->pacer);
+	}
+	return true;
+
+err:	e->source->close(e->source);
+	return false;
+}
+
+static bool
+entry_connect (struct evloop *l, struct entry *e)
+{
+	struct epoll_event ev;
+	int wait_fd;
+	int wait_msec;
+
+	// The source closes its wait descriptor when done, which
+	// also removes it from the epoll set:
+	switch (e->source->open_nowait(e->source, &wait_fd, &wait_msec))
+	{
+		case SOURCE_OPEN_DONE:
+			e->connecting = false;
+			return entry_activate(l, e);
+
+		case SOURCE_OPEN_PENDING:
+			break;
+
+		default:
+			e->connecting = false;
+			return false;
+	}
+	// Wait till the source has news, or till its next deadline.
+	// The descriptor stays the same while it connects:
+	ev.events = EPOLLIN;
+	ev.data.ptr = &e->source_watch;
+	if (epoll_ctl(l->epfd, EPOLL_CTL_ADD, wait_fd, &ev) < 0 && errno != EEXIST) {
+		log_error("epoll_ctl: %s\n", strerror(errno));
+		e->source->close(e->source);
+		e->connecting = false;
+		return false;
+	}
+	// A zero timer would be disarmed:
+	if (wait_msec == 0) {
+		wait_msec = 1;
+	}
+	arm_timer(e->timerfd, wait_msec / 1000, (wait_msec % 1000) * 1000000L);
+	e->connecting = true;
+	return true;
+}
+
+static void *
+resolver_main (void *data)
+{
+	struct evloop *l = data;
+	struct entry *e;
+	uint64_t val = 1;
+	bool prepared;
+
+	pthread_mutex_lock(&l->mutex);
+	for (;;) {
+		l->n_idle++;
+		while (l->resolve_head == NULL && !l->resolver_quit) {
+			pthread_cond_wait(&l->cond, &l->mutex);
+		}
+		l->n_idle--;
+		if (l->resolver_quit) {
+			break;
+		}
+		e = l->resolve_head;
+		l->n_queued--;
+		if ((l->resolve_head = e->resolve_next) == NULL) {
+			l->resolve_tail = &l->resolve_head;
+		}
+		// The lookup may take a while; don't hold the lock:
+		pthread_mutex_unlock(&l->mutex);
+		prepared = e->source->open_prepare(e->source);
+		pthread_mutex_lock(&l->mutex);
+
+		e->prepared = prepared;
+		e->resolve_next = l->resolved;
+		l->resolved = e;
+		while (write(l->resolvedfd, &val, sizeof(val)) < 0 && errno == EINTR) {
+			continue;
+		}
+	}
+	pthread_mutex_unlock(&l->mutex);
+	return NULL;
+}
+
+static bool
+entry_resolve (struct evloop *l, struct entry *e)
+{
+	pthread_mutex_lock(&l->mutex);
+
+	// Start another resolver if there are more lookups than idle
+	// ones. Past the limit, lookups wait for one to come free:
+	if (++l->n_queued > l->n_idle && l->n_resolvers < MAX_RESOLVERS) {
+		if (pthread_create(&l->resolvers[l->n_resolvers], NULL, resolver_main, l) == 0) {
+			l->n_resolvers++;
+		}
+		else if (l->n_resolvers == 0) {
+			l->n_queued--;
+			pthread_mutex_unlock(&l->mutex);
+			log_error("pthread_create failed\n");
+			return false;
+		}
+	}
+	e->resolve_next = NULL;
+	*l->resolve_tail = e;
+	l->resolve_tail = &e->resolve_next;
+	pthread_cond_signal(&l->cond);
+	pthread_mutex_unlock(&l->mutex);
+
+	e->resolving = true;
+	return true;
+}
+
+static bool
+entry_open (struct evloop *l, struct entry *e)
+{
+	e->waiting = false;
+
+	// Sources that open in steps never block the loop. Their prepare
+	// step, such as a name lookup, runs on the resolver thread:
+	if (e->source->open_nowait != NULL) {
+		return (e->source->open_prepare == NULL)
+			? entry_connect(l, e)
+			: entry_resolve(l, e);
+	}
+	if (e->source->open(e->source) == false) {
+		log_error("%s: could not open source\n", source_get_name(e->source));
+		return false;
+	}
+	return entry_activate(l, e);
+}
+
+static void
+deliver_frames (struct evloop *l, struct entry *e)
+{
+	bool got_frames = false;
+
+	for (;;) {
+		if (e->held == NULL && (e->held = mjv_grabber_next_frame(e->grabber)) == NULL) {
+			break;
+		}
+		// If the frame is not due yet, hold on to it
+		// till the pacer's timer fires:
+		if (e->pacer != NULL) {
+			if (!pacer_ready(e->pacer, frame_get_capture_time(e->held))) {
+				entry_pause(l, e);
+				break;
+			}
+			pacer_advance(e->pacer);
+		}
+		e->got_frame(e->held, e->user_pointer);
+		e->held = NULL;
+		got_frames = true;
+	}
+	if (e->held == NULL) {
+		entry_resume(l, e);
+	}
+	if (got_frames && !e->always_ready) {
+		clock_gettime(CLOCK_MONOTONIC, &e->last_frame);
+
+		// The connection works; the next outage starts
+		// with short delays again:
+		if (!e->seen_frame) {
+			backoff_reset(e->backoff);
+			e->seen_frame = true;
+		}
+	}
+}
+
+static void
+handle_source (struct evloop *l, struct entry *e)
+{
+	enum mjv_grabber_status status;
+
+	// Events may still come in for a source just paused:
+	if (e->paused) {
+		return;
+	}
+	status = mjv_grabber_read(e->grabber);
+
+	// Pass on whatever frames were found, even if the read failed:
+	deliver_frames(l, e);
+
+	switch (status)
+	{
+		case MJV_GRABBER_SUCCESS:
+			if (!e->always_ready) {
+				clock_gettime(CLOCK_MONOTONIC, &e->last_active);
+			}
+			break;
+
+		case MJV_GRABBER_AGAIN:
+			break;
+
+		default:
+			// A file that was read to the end is done:
+			if (status == MJV_GRABBER_PREMATURE_EOF && e->always_ready) {
+				log_info("%s: end of file\n", source_get_name(e->source));
+				entry_drop(l, e);
+				break;
+			}
+			log_info("%s: stream ended\n", source_get_name(e->source));
+			entry_retry(l, e);
+			break;
+	}
+}
+
+static long long
+nsec_since (const struct timespec *now, const struct timespec *then)
+{
+	return (now->tv_sec - then->tv_sec) * 1000000000LL
+	     + (now->tv_nsec - then->tv_nsec);
+}
+
+static void
+handle_pace (struct evloop *l, struct entry *e)
+{
+	uint64_t expirations;
+
+	if (read(pacer_get_fd(e->pacer), &expirations, sizeof(expirations)) < 0) {
+		return;
+	}
+	if (e->active) {
+		deliver_frames(l, e);
+	}
+}
+
+static void
+handle_resolved (struct evloop *l)
+{
+	struct entry *e, *next;
+	uint64_t val;
+
+	if (read(l->resolvedfd, &val, sizeof(val)) < 0) {
+		return;
+	}
+	pthread_mutex_lock(&l->mutex);
+	e = l->resolved;
+	l->resolved = NULL;
+	pthread_mutex_unlock(&l->mutex);
+
+	for (; e; e = next) {
+		next = e->resolve_next;
+		e->resolving = false;
+		if (!e->prepared || !entry_connect(l, e)) {
+			entry_retry(l, e);
+		}
+	}
+}
+
+static void
+handle_timer (struct evloop *l, struct entry *e)
+{
+	uint64_t expirations;
+	struct timespec now;
+	long long timeout_nsec = l->timeout_sec * 1000000000LL;
+	long long read_left;
+	long long frame_left;
+
+	if (read(e->timerfd, &expirations, sizeof(expirations)) < 0) {
+		return;
+	}
+	// Time to try again:
+	if (e->waiting) {
+		if (!entry_open(l, e)) {
+			entry_retry(l, e);
+		}
+		return;
+	}
+	// The source keeps its own connect deadlines; let it check them:
+	if (e->connecting) {
+		if (!entry_connect(l, e)) {
+			entry_retry(l, e);
+		}
+		return;
+	}
+	if (!e->active || e->always_ready) {
+		return;
+	}
+	// Not reading is our own choice while paused:
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	if (e->paused) {
+		e->last_active = now;
+	}
+	// Reconnect if no bytes came in, or if bytes came in but
+	// no frames, for the length of the timeout:
+	read_left = timeout_nsec - nsec_since(&now, &e->last_active);
+	frame_left = timeout_nsec - nsec_since(&now, &e->last_frame);
+
+	if (read_left <= 0 || frame_left <= 0) {
+		log_error("%s: %s\n", source_get_name(e->source), (read_left <= 0) ? "timeout" : "stalled");
+		entry_retry(l, e);
+		return;
+	}
+	// Else rearm the timer for the remainder of the timeout:
+	if (frame_left < read_left) {
+		read_left = frame_left;
+	}
+	arm_timer(e->timerfd, read_left / 1000000000LL, read_left % 1000000000LL);
+}
+
+void
+evloop_run (struct evloop *l)
+{
+	struct epoll_event events[MAX_EVENTS];
+	struct entry *e;
+	uint64_t val;
+	int n;
+
+	// Open the sources from the thread that runs the loop. Network
+	// sources only start here, and connect while the loop runs:
+	for (e = l->entries; e; e = e->next) {
+		if (!e->dead && !entry_open(l, e)) {
+			entry_retry(l, e);
+		}
+	}
+	while (l->n_live > 0)
+	{
+		// Don't block if some sources can always be read:
+		if ((n = epoll_wait(l->epfd, events, MAX_EVENTS, (l->n_always_ready > 0) ? 0 : -1)) < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			log_error("epoll_wait: %s\n", strerror(errno));
+			break;
+		}
+		for (int i = 0; i < n; i++) {
+			struct watch *w = events[i].data.ptr;
+
+			if (w->type == WATCH_STOP) {
+				while (read(l->stopfd, &val, sizeof(val)) < 0 && errno == EINTR) {
+					continue;
+				}
+				goto out;
+			}
+			if (w->type == WATCH_RESOLVED) {
+				handle_resolved(l);
+				continue;
+			}
+			if (w->entry->dead) {
+				continue;
+			}
+			if (w->type == WATCH_TIMER) {
+				handle_timer(l, w->entry);
+			}
+			else if (w->type == WATCH_PACE) {
+				handle_pace(l, w->entry);
+			}
+			// The source has news about its connect:
+			else if (w->entry->connecting) {
+				if (!entry_connect(l, w->entry)) {
+					entry_retry(l, w->entry);
+				}
+			}
+			// Skip events for sources closed earlier in this batch:
+			else if (w->entry->active) {
+				handle_source(l, w->entry);
+			}
+		}
+		if (l->n_always_ready == 0) {
+			continue;
+		}
+		for (e = l->entries; e; e = e->next) {
+			if (e->active && e->always_ready && !e->paused) {
+				handle_source(l, e);
+			}
+		}
+	}
+out:	for (e = l->entries; e; e = e->next) {
+		entry_close(l, e);
+	}
+}
+
+void
+evloop_stop (struct evloop *l)
+{
+	uint64_t val = 1;
+
+	// Only async-signal-safe calls here:
+	while (write(l->stopfd, &val, sizeof(val)) < 0 && errno == EINTR) {
+		continue;
+	}
+}
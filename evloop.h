@@ -0,0 +1,33 @@
+#ifndef EVLOOP_H
+#define EVLOOP_H
+
+// An event loop that drives many sources and their grabbers from a single
+// thread. Sources are added before the loop runs; the loop opens them,
+// waits for data with epoll, feeds it to the grabbers, and passes each
+// frame to a callback. A source that errors out, ends, or delivers no bytes
+// or no frames for longer than the timeout is closed and reopened after a
+// growing, randomized delay. Only a regular file that was read to the end
+// is dropped from the loop. Frames from a paced source are held back till
+// they are due; meanwhile, that source is not read from. Sources that can
+// open in steps, such as network sources, never block the loop: their
+// name lookups run on a helper thread, and their connects complete in the
+// loop, racing the addresses under the same deadlines as a blocking open.
+
+struct evloop;
+struct source;
+struct mjv_grabber;
+struct frame;
+
+struct evloop *evloop_create (unsigned int timeout_sec);
+void evloop_destroy (struct evloop **);
+
+// The grabber must have no callback set. The callback owns the frame:
+bool evloop_add (struct evloop *, struct source *, struct mjv_grabber *, void (*got_frame)(struct frame *, void *), void *user_pointer);
+
+// Runs until evloop_stop() is called, or until no sources remain:
+void evloop_run (struct evloop *);
+
+// Can be called from any thread, or from a signal handler:
+void evloop_stop (struct evloop *);
+
+#endif	// EVLOOP_H
@@ -1,5 +1,13 @@
+#include <stdbool.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdio.h>
+#include <time.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#include "mjv_log.h"
+#include "filename.h"
 
 static size_t
 framenum_expanded_len (unsigned int framenum)
@@ -97,3 +105,49 @@ filename_forge (const char *const srcname, unsigned int framenum, char *const pa
 	*p = '\0';
 	return buf;
 }
+
+static void
+timestamp_file (const char *const filename, const struct timespec *const timestamp)
+{
+	struct timespec times[2];
+
+	times[0].tv_sec = timestamp->tv_sec;
+	times[0].tv_nsec = timestamp->tv_nsec;
+
+	times[1].tv_sec = timestamp->tv_sec;
+	times[1].tv_nsec = timestamp->tv_nsec;
+
+	utimensat(AT_FDCWD, filename, times, 0);
+}
+
+bool
+filename_write_image (char *const pat, const char *const srcname, unsigned int framenum, const char *data, size_t nbytes, const struct timespec *const timestamp)
+{
+	FILE *fp;
+	char *filename;
+	bool ret = false;
+
+	if (data == NULL || nbytes == 0) {
+		log_error("Error: frame contains no data\n");
+		return false;
+	}
+	if (framenum >= 1000000000) {
+		log_error("Error: framenum too large (over 9 digits)\n");
+		return false;
+	}
+	if ((filename = filename_forge(srcname, framenum, pat)) == NULL) {
+		log_error("Error: could not forge filename\n");
+		return false;
+	}
+	if ((fp = fopen(filename, "w")) == NULL) {
+		perror("fopen");
+	}
+	else {
+		log_debug("writing %s\n", filename);
+		ret = (fwrite(data, nbytes, 1, fp) == 1);
+		ret &= (fclose(fp) == 0);
+		timestamp_file(filename, timestamp);
+	}
+	free(filename);
+	return ret;
+}
@@ -1,6 +1,15 @@
 #ifndef FILENAME_H
 #define FILENAME_H
 
+#include <stdbool.h>
+#include <stddef.h>
+
+struct timespec;
+
 char *filename_forge (const char *const srcname, unsigned int framenum, char *const pat);
 
+// Write an image to the file named by the pattern, and set the file's
+// times to the frame's timestamp. Returns false on error:
+bool filename_write_image (char *const pat, const char *const srcname, unsigned int framenum, const char *data, size_t nbytes, const struct timespec *const timestamp);
+
 #endif	/* FILENAME_H */
@@ -1,3 +1,5 @@
+#include <stdbool.h>
+#include <stdint.h>
 #include <stdlib.h>	// malloc()
 #include <time.h>	// clock_gettime()
 #include <stdio.h>
@@ -5,8 +7,19 @@
 #include <jpeglib.h>
 #include <setjmp.h>
 
+#include "slab.h"
+#include "pixpool.h"
+#include "frame.h"
+
+// Most rows to hand to libjpeg in one call:
+#define MAX_ROWS	16
+
 struct frame {
-	struct timespec *timestamp;
+	struct timespec timestamp;
+	struct timespec capture;	// as recorded in the stream, if known
+	bool has_capture;
+	struct slab *slab;	// if set, rawbits points into this slab
+	bool borrowed;	// if set, rawbits belongs to the caller
 	char *error;
 	unsigned char *rawbits;
 	unsigned int num_rawbits;
@@ -21,51 +34,89 @@ struct my_jpeg_error_mgr {
 	jmp_buf setjmp_buffer;
 };
 
-struct frame *
-frame_create (const char *const rawbits, const unsigned int num_rawbits)
+// A decompressor that is set up once and used for many frames, which
+// saves libjpeg from building up its state and tables for each one:
+struct frame_decoder {
+	struct jpeg_decompress_struct cinfo;
+	struct my_jpeg_error_mgr jerr;
+	enum frame_decode_profile profile;
+	enum frame_format format;
+};
+
+static struct frame *
+frame_alloc (void)
 {
-	struct frame *f = NULL;
-	struct timespec timestamp;
+	struct frame *f;
 
-	// First thing, timestamp this frame:
-	if (clock_gettime(CLOCK_REALTIME, &timestamp) != 0) {
-		timestamp.tv_sec = timestamp.tv_nsec = 0;
-	}
 	// Allocate structure:
 	if ((f = malloc(sizeof(*f))) == NULL) {
-		goto err;
+		return NULL;
+	}
+	// First thing, timestamp this frame:
+	if (clock_gettime(CLOCK_REALTIME, &f->timestamp) != 0) {
+		f->timestamp.tv_sec = f->timestamp.tv_nsec = 0;
 	}
+	// Set default values:
+	f->has_capture = false;
+	f->slab = NULL;
+	f->borrowed = false;
 	f->error = NULL;
-	f->timestamp = NULL;
 	f->rawbits = NULL;
+	f->num_rawbits = 0;
+	f->width = 0;
+	f->height = 0;
+	return f;
+}
+
+struct frame *
+frame_create (const char *const rawbits, const unsigned int num_rawbits)
+{
+	struct frame *f;
 
-	// Allocate timestamp struct:
-	if ((f->timestamp = malloc(sizeof(*f->timestamp))) == NULL) {
-		goto err;
+	if ((f = frame_alloc()) == NULL) {
+		return NULL;
 	}
 	// Allocate space for the frame:
 	if ((f->rawbits = malloc(num_rawbits)) == NULL) {
-		goto err;
+		free(f);
+		return NULL;
 	}
-	// Copy timestamp over:
-	memcpy(f->timestamp, &timestamp, sizeof(timestamp));
-
 	// Copy rawbits over:
 	memcpy(f->rawbits, rawbits, num_rawbits);
+	f->num_rawbits = num_rawbits;
+	return f;
+}
 
-	// Set default values:
+struct frame *
+frame_create_from_slab (struct slab *slab, const char *const rawbits, const unsigned int num_rawbits)
+{
+	struct frame *f;
+
+	// Refer to the rawbits in place; the slab
+	// stays alive until the frame is destroyed:
+	if ((f = frame_alloc()) == NULL) {
+		return NULL;
+	}
+	f->slab = slab_ref(slab);
+	f->rawbits = (unsigned char *)rawbits;
 	f->num_rawbits = num_rawbits;
-	f->width = 0;
-	f->height = 0;
 	return f;
+}
 
-err:	if (f != NULL) {
-		free(f->error);
-		free(f->rawbits);
-		free(f->timestamp);
-		free(f);
+struct frame *
+frame_create_borrowed (const char *const rawbits, const unsigned int num_rawbits)
+{
+	struct frame *f;
+
+	// Refer to the rawbits in place; the caller
+	// keeps them valid for the life of the frame:
+	if ((f = frame_alloc()) == NULL) {
+		return NULL;
 	}
-	return NULL;
+	f->borrowed = true;
+	f->rawbits = (unsigned char *)rawbits;
+	f->num_rawbits = num_rawbits;
+	return f;
 }
 
 void
@@ -74,9 +125,13 @@ frame_destroy (struct frame **const f)
 	if (f == NULL || *f == NULL) {
 		return;
 	}
+	if ((*f)->slab != NULL) {
+		slab_unref(&(*f)->slab);
+	}
+	else if (!(*f)->borrowed) {
+		free((*f)->rawbits);
+	}
 	free((*f)->error);
-	free((*f)->rawbits);
-	free((*f)->timestamp);
 	free(*f);
 	*f = NULL;
 }
@@ -89,63 +144,222 @@ on_jpeg_error (j_common_ptr cinfo)
 	longjmp(((struct my_jpeg_error_mgr*)(cinfo->err))->setjmp_buffer, 1);
 }
 
+struct frame_decoder *
+frame_decoder_create (void)
+{
+	// Volatile, because it is used after longjmp():
+	struct frame_decoder *volatile d;
+
+	if ((d = malloc(sizeof(*d))) == NULL) {
+		return NULL;
+	}
+	// Use a custom error exit; libjpeg just calls exit()
+	d->cinfo.err = jpeg_std_error(&d->jerr.pub);
+	d->jerr.pub.error_exit = on_jpeg_error;
+	if (setjmp(d->jerr.setjmp_buffer)) {
+		free(d);
+		return NULL;
+	}
+	jpeg_create_decompress(&d->cinfo);
+	d->profile = FRAME_DECODE_QUALITY;
+	d->format = FRAME_FORMAT_RGB;
+	return d;
+}
+
+void
+frame_decoder_destroy (struct frame_decoder **d)
+{
+	if (d == NULL || *d == NULL) {
+		return;
+	}
+	jpeg_destroy_decompress(&(*d)->cinfo);
+	free(*d);
+	*d = NULL;
+}
+
+void
+frame_decoder_set_profile (struct frame_decoder *d, enum frame_decode_profile profile)
+{
+	d->profile = profile;
+}
+
+void
+frame_decoder_set_format (struct frame_decoder *d, enum frame_format format)
+{
+	d->format = format;
+}
+
+// The libjpeg color space that lays out
+// pixels as 32-bit words of 0x00RRGGBB:
+#ifdef JCS_EXTENSIONS
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+#define JCS_XRGB32	JCS_EXT_XRGB
+#else
+#define JCS_XRGB32	JCS_EXT_BGRX
+#endif
+#endif
+
+// Find the smallest of libjpeg's IDCT scales, 1/1 down to 1/8, at which
+// the image is still no smaller than it would be when shrunk to fit the
+// target size. Scaling in the IDCT is much cheaper than decoding at full
+// size and shrinking afterwards:
+static unsigned int
+scale_denom (unsigned int image_width, unsigned int image_height, unsigned int width, unsigned int height)
+{
+	unsigned int denom = 1;
+
+	if (width == 0 || height == 0) {
+		return 1;
+	}
+	// The image fits when its limiting side fits, so it can
+	// be halved while either side is twice the target:
+	while (denom < 8 && (image_width >= width * denom * 2 || image_height >= height * denom * 2)) {
+		denom *= 2;
+	}
+	return denom;
+}
+
+#ifndef JCS_EXTENSIONS
+// Without libjpeg-turbo, widen each decoded row from the back of its
+// buffer to 32-bit words. Reading runs ahead of writing, so this can
+// be done in place, front to back:
+static void
+expand_row (unsigned char *src, unsigned int width, unsigned int components)
+{
+	uint32_t *dst = (uint32_t *)(src - width * (4 - components));
+
+	for (unsigned int x = 0; x < width; x++, src += components) {
+		dst[x] = (components == 1)
+			? 0x010101U * src[0]
+			: ((uint32_t)src[0] << 16) | (src[1] << 8) | src[2];
+	}
+}
+#endif
+
+static void
+release_pixbuf (unsigned char *pixbuf, struct pixpool *pool)
+{
+	if (pool == NULL) {
+		free(pixbuf);
+	}
+	else {
+		pixpool_put(pixbuf);
+	}
+}
+
 unsigned char *
-frame_to_pixbuf (struct frame *f)
+frame_decode (struct frame_decoder *d, struct frame *f, struct pixpool *pool, unsigned int width, unsigned int height)
 {
-	unsigned char *pixbuf;
-	struct jpeg_decompress_struct cinfo;
-	struct my_jpeg_error_mgr jerr;
-	JSAMPROW row_pointer;
+	// Volatile, because it is changed between setjmp() and longjmp():
+	unsigned char *volatile pixbuf = NULL;
+	struct jpeg_decompress_struct *cinfo = &d->cinfo;
+	JSAMPROW rows[MAX_ROWS];
 
-	// Given a mjv_frame, returns a pixmap and sets some of the feame's
+	// Given a mjv_frame, returns a pixmap and sets some of the frame's
 	// variables, such as height and width (which are unknown till we
 	// actually decode the image).
-	// Caaller is responsible for freeing the resulting pixmap.
-
-	// Use a custom error exit; libjpeg just calls exit()
-	cinfo.err = jpeg_std_error(&jerr.pub);
-	jerr.pub.error_exit = on_jpeg_error;
-	if (setjmp(jerr.setjmp_buffer))
+	// Caller is responsible for releasing the resulting pixmap.
+	if (setjmp(d->jerr.setjmp_buffer))
 	{
 		char *c;
 		char jpeg_errmsg[JMSG_LENGTH_MAX];
 
-		jerr.pub.format_message((j_common_ptr)(&cinfo), jpeg_errmsg);
+		d->jerr.pub.format_message((j_common_ptr)cinfo, jpeg_errmsg);
 		size_t len = strlen(jpeg_errmsg) + 1;
 		if ((c = realloc(f->error, len)) != NULL) {
 			memcpy(f->error = c, jpeg_errmsg, len);
 		}
-		jpeg_destroy_decompress(&cinfo);
+		// The error may have come halfway through the scanlines:
+		release_pixbuf(pixbuf, pool);
+
+		// Keep the decompressor for the next frame:
+		jpeg_abort_decompress(cinfo);
 		return NULL;
 	}
-	jpeg_create_decompress(&cinfo);
-
 	// Note: this source is available from libjpeg v8 onwards:
-	jpeg_mem_src(&cinfo, f->rawbits, f->num_rawbits);
+	jpeg_mem_src(cinfo, f->rawbits, f->num_rawbits);
+
+	jpeg_read_header(cinfo, TRUE);
 
-	// FIXME error checking??
-	jpeg_read_header(&cinfo, TRUE);
-	jpeg_start_decompress(&cinfo);
+	// Let the IDCT shrink the image towards the target size:
+	cinfo->scale_num = 1;
+	cinfo->scale_denom = scale_denom(cinfo->image_width, cinfo->image_height, width, height);
 
-	f->row_stride = cinfo.output_width * cinfo.output_components;
+	// The header resets these to the defaults, which make the quality profile:
+	if (d->profile == FRAME_DECODE_FAST) {
+		cinfo->dct_method = JDCT_IFAST;
+		cinfo->do_fancy_upsampling = FALSE;
+		cinfo->do_block_smoothing = FALSE;
+	}
+#ifdef JCS_EXTENSIONS
+	// Let libjpeg-turbo write the 32-bit pixels itself:
+	if (d->format == FRAME_FORMAT_XRGB32) {
+		cinfo->out_color_space = JCS_XRGB32;
+	}
+#endif
+	jpeg_start_decompress(cinfo);
 
 	// Update the frame object with this new information:
-	f->height = cinfo.output_height;
-	f->width = cinfo.output_width;
-	f->components = cinfo.output_components;
-
-	// Allocate our own output buffer:
-	// FIXME: constant allocating/freeing is wasteful;
-	// maybe reuse the pixmap and only realloc if the dimensions change:
-	if ((pixbuf = malloc(cinfo.output_height * f->row_stride)) == NULL) {
+	f->height = cinfo->output_height;
+	f->width = cinfo->output_width;
+	f->components = (d->format == FRAME_FORMAT_XRGB32) ? 4 : cinfo->output_components;
+	f->row_stride = f->width * f->components;
+
+	// Take an output buffer from the pool, which only allocates
+	// when the dimensions change:
+	pixbuf = (pool == NULL)
+		? malloc(cinfo->output_height * f->row_stride)
+		: pixpool_get(pool, f->width, f->height, f->row_stride);
+
+	if (pixbuf == NULL) {
+		jpeg_abort_decompress(cinfo);
 		return NULL;
 	}
-	while (cinfo.output_scanline < cinfo.output_height) {
-		row_pointer = &pixbuf[cinfo.output_scanline * f->row_stride];
-		jpeg_read_scanlines(&cinfo, &row_pointer, 1);
+	// Ask for as many rows as libjpeg makes in one go, so
+	// that it can write them out without buffering them:
+	while (cinfo->output_scanline < cinfo->output_height) {
+		unsigned int n = cinfo->output_height - cinfo->output_scanline;
+
+		if (n > (unsigned int)cinfo->rec_outbuf_height) {
+			n = cinfo->rec_outbuf_height;
+		}
+		if (n > MAX_ROWS) {
+			n = MAX_ROWS;
+		}
+		for (unsigned int i = 0; i < n; i++) {
+			rows[i] = &pixbuf[(cinfo->output_scanline + i) * f->row_stride];
+#ifndef JCS_EXTENSIONS
+			// Decode into the back of the row, to expand in place:
+			if (d->format == FRAME_FORMAT_XRGB32) {
+				rows[i] += f->width * (4 - cinfo->output_components);
+			}
+#endif
+		}
+		jpeg_read_scanlines(cinfo, rows, n);
+#ifndef JCS_EXTENSIONS
+		if (d->format == FRAME_FORMAT_XRGB32) {
+			for (unsigned int i = 0; i < n; i++) {
+				expand_row(rows[i], f->width, cinfo->output_components);
+			}
+		}
+#endif
 	}
-	jpeg_finish_decompress(&cinfo);
-	jpeg_destroy_decompress(&cinfo);
+	jpeg_finish_decompress(cinfo);
+	return pixbuf;
+}
+
+unsigned char *
+frame_to_pixbuf (struct frame *f, struct pixpool *pool, unsigned int width, unsigned int height)
+{
+	struct frame_decoder *d;
+	unsigned char *pixbuf;
+
+	// One-off decode, for callers that decode rarely:
+	if ((d = frame_decoder_create()) == NULL) {
+		return NULL;
+	}
+	pixbuf = frame_decode(d, f, pool, width, height);
+	frame_decoder_destroy(&d);
 	return pixbuf;
 }
 
@@ -170,7 +384,20 @@ frame_get_row_stride (const struct frame *const frame)
 struct timespec *
 frame_get_timestamp (const struct frame *const frame)
 {
-	return frame->timestamp;
+	return (struct timespec *)&frame->timestamp;
+}
+
+void
+frame_set_capture_time (struct frame *const frame, const struct timespec *const capture)
+{
+	frame->capture = *capture;
+	frame->has_capture = true;
+}
+
+const struct timespec *
+frame_get_capture_time (const struct frame *const frame)
+{
+	return (frame->has_capture) ? &frame->capture : NULL;
 }
 
 unsigned char *
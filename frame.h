@@ -1,8 +1,44 @@
 struct frame;
+struct slab;
+struct pixpool;
+struct frame_decoder;
 
 struct frame *frame_create (const char *const, const unsigned int);
+struct frame *frame_create_from_slab (struct slab *, const char *const, const unsigned int);
+struct frame *frame_create_borrowed (const char *const, const unsigned int);
 void frame_destroy (struct frame **const);
-unsigned char *frame_to_pixbuf (struct frame *);
+// Decode the frame to RGB pixels. The buffer is taken from the pool and
+// must be put back with pixpool_put(); without a pool, it is malloc'ed.
+// If a target size is given, the image is decoded at 1/2, 1/4 or 1/8 of
+// its size, as long as it stays large enough to be shrunk to fit the
+// target; the frame's width and height are then those of the result.
+// A target of 0 by 0 decodes at full size. A decoder is kept for the
+// life of a decoding thread, and must not be shared between threads.
+// frame_to_pixbuf() uses a one-off decoder:
+struct frame_decoder *frame_decoder_create (void);
+void frame_decoder_destroy (struct frame_decoder **);
+
+// Decode profiles. Quality uses libjpeg's defaults. Fast uses the integer
+// IDCT and plain chroma upsampling, which looks about the same at a wall
+// of cameras and is a good deal cheaper. Applies from the next frame:
+enum frame_decode_profile
+{ FRAME_DECODE_QUALITY
+, FRAME_DECODE_FAST
+};
+
+void frame_decoder_set_profile (struct frame_decoder *, enum frame_decode_profile);
+
+// Pixel formats to decode to. RGB is three bytes per pixel. XRGB32 is a
+// 32-bit word per pixel, 0x00RRGGBB in native byte order, as in Cairo's
+// RGB24 format, so that the pixels can be painted without converting:
+enum frame_format
+{ FRAME_FORMAT_RGB
+, FRAME_FORMAT_XRGB32
+};
+
+void frame_decoder_set_format (struct frame_decoder *, enum frame_format);
+unsigned char *frame_decode (struct frame_decoder *, struct frame *, struct pixpool *, unsigned int width, unsigned int height);
+unsigned char *frame_to_pixbuf (struct frame *, struct pixpool *, unsigned int width, unsigned int height);
 
 unsigned int frame_get_width (const struct frame *const frame);
 unsigned int frame_get_height (const struct frame *const frame);
@@ -12,3 +48,7 @@ unsigned char *frame_get_rawbits (const struct frame *const frame);
 unsigned int frame_get_num_rawbits (const struct frame *const frame);
 
 struct timespec *frame_get_timestamp (const struct frame *const frame);
+
+// The time at which the frame was captured, if the stream says so, else NULL:
+void frame_set_capture_time (struct frame *const frame, const struct timespec *const capture);
+const struct timespec *frame_get_capture_time (const struct frame *const frame);
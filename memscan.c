@@ -0,0 +1,254 @@
+#include <stdbool.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HAVE_X86_SIMD	1
+#endif
+
+#include "memscan.h"
+
+static const char *scan_scalar (const char *, const char *, char, char, unsigned int);
+static const char *marker_scalar (const char *, const char *);
+
+// The engine in use, chosen at startup by memscan_init():
+static enum memscan_engine engine = MEMSCAN_SCALAR;
+static const char *(*scan)(const char *, const char *, char, char, unsigned int) = scan_scalar;
+static const char *(*marker)(const char *, const char *) = marker_scalar;
+
+// True if the byte after an 0xff in entropy-coded data makes a
+// marker, rather than a stuffed zero or a restart marker:
+static inline bool
+is_marker (unsigned char c)
+{
+	return c != 0x00 && (c & 0xf8) != 0xd0;
+}
+
+static const char *
+scan_scalar (const char *start, const char *end, char first, char last, unsigned int dist)
+{
+	const char *p = start;
+
+	// Let memchr() find the candidates for the first byte,
+	// then check the last byte by hand:
+	while (end - p > (long)dist) {
+		if ((p = memchr(p, first, end - dist - p)) == NULL) {
+			return NULL;
+		}
+		if (p[dist] == last) {
+			return p;
+		}
+		p++;
+	}
+	return NULL;
+}
+
+static const char *
+marker_scalar (const char *start, const char *end)
+{
+	const char *p = start;
+
+	while (end - p > 1) {
+		if ((p = memchr(p, 0xff, end - 1 - p)) == NULL) {
+			return NULL;
+		}
+		if (is_marker(p[1])) {
+			return p;
+		}
+		p++;
+	}
+	return NULL;
+}
+
+#ifdef HAVE_X86_SIMD
+
+__attribute__((target("sse2")))
+static const char *
+scan_sse2 (const char *start, const char *end, char first, char last, unsigned int dist)
+{
+	const char *p = start;
+	const __m128i vfirst = _mm_set1_epi8(first);
+	const __m128i vlast = _mm_set1_epi8(last);
+
+	// Compare sixteen candidate positions at once; a position is a hit
+	// if both its first and its last byte match:
+	while (end - p >= (long)dist + 16) {
+		__m128i a = _mm_loadu_si128((const __m128i *)p);
+		__m128i b = _mm_loadu_si128((const __m128i *)(p + dist));
+		unsigned int mask = _mm_movemask_epi8(_mm_and_si128(
+			_mm_cmpeq_epi8(a, vfirst),
+			_mm_cmpeq_epi8(b, vlast)));
+
+		if (mask != 0) {
+			return p + __builtin_ctz(mask);
+		}
+		p += 16;
+	}
+	// Handle the tail:
+	return scan_scalar(p, end, first, last, dist);
+}
+
+__attribute__((target("avx2")))
+static const char *
+scan_avx2 (const char *start, const char *end, char first, char last, unsigned int dist)
+{
+	const char *p = start;
+	const __m256i vfirst = _mm256_set1_epi8(first);
+	const __m256i vlast = _mm256_set1_epi8(last);
+
+	// Same as above, but 32 positions at once:
+	while (end - p >= (long)dist + 32) {
+		__m256i a = _mm256_loadu_si256((const __m256i *)p);
+		__m256i b = _mm256_loadu_si256((const __m256i *)(p + dist));
+		unsigned int mask = _mm256_movemask_epi8(_mm256_and_si256(
+			_mm256_cmpeq_epi8(a, vfirst),
+			_mm256_cmpeq_epi8(b, vlast)));
+
+		if (mask != 0) {
+			return p + __builtin_ctz(mask);
+		}
+		p += 32;
+	}
+	return scan_sse2(p, end, first, last, dist);
+}
+
+__attribute__((target("sse2")))
+static const char *
+marker_sse2 (const char *start, const char *end)
+{
+	const char *p = start;
+	const __m128i vff = _mm_set1_epi8((char)0xff);
+	const __m128i vf8 = _mm_set1_epi8((char)0xf8);
+	const __m128i vd0 = _mm_set1_epi8((char)0xd0);
+	const __m128i zero = _mm_setzero_si128();
+
+	// A hit is an 0xff whose next byte is neither zero nor 0xd0-0xd7:
+	while (end - p >= 17) {
+		__m128i a = _mm_loadu_si128((const __m128i *)p);
+		__m128i b = _mm_loadu_si128((const __m128i *)(p + 1));
+		__m128i skip = _mm_or_si128(
+			_mm_cmpeq_epi8(b, zero),
+			_mm_cmpeq_epi8(_mm_and_si128(b, vf8), vd0));
+		unsigned int mask = _mm_movemask_epi8(_mm_andnot_si128(skip, _mm_cmpeq_epi8(a, vff)));
+
+		if (mask != 0) {
+			return p + __builtin_ctz(mask);
+		}
+		p += 16;
+	}
+	return marker_scalar(p, end);
+}
+
+__attribute__((target("avx2")))
+static const char *
+marker_avx2 (const char *start, const char *end)
+{
+	const char *p = start;
+	const __m256i vff = _mm256_set1_epi8((char)0xff);
+	const __m256i vf8 = _mm256_set1_epi8((char)0xf8);
+	const __m256i vd0 = _mm256_set1_epi8((char)0xd0);
+	const __m256i zero = _mm256_setzero_si256();
+
+	while (end - p >= 33) {
+		__m256i a = _mm256_loadu_si256((const __m256i *)p);
+		__m256i b = _mm256_loadu_si256((const __m256i *)(p + 1));
+		__m256i skip = _mm256_or_si256(
+			_mm256_cmpeq_epi8(b, zero),
+			_mm256_cmpeq_epi8(_mm256_and_si256(b, vf8), vd0));
+		unsigned int mask = _mm256_movemask_epi8(_mm256_andnot_si256(skip, _mm256_cmpeq_epi8(a, vff)));
+
+		if (mask != 0) {
+			return p + __builtin_ctz(mask);
+		}
+		p += 32;
+	}
+	return marker_sse2(p, end);
+}
+
+#endif	// HAVE_X86_SIMD
+
+static bool
+engine_supported (enum memscan_engine e)
+{
+	switch (e)
+	{
+		case MEMSCAN_SCALAR:
+			return true;
+#ifdef HAVE_X86_SIMD
+		case MEMSCAN_SSE2:
+			return __builtin_cpu_supports("sse2");
+
+		case MEMSCAN_AVX2:
+			return __builtin_cpu_supports("avx2");
+#else
+		default:
+			return false;
+#endif
+	}
+	return false;
+}
+
+bool
+memscan_set_engine (enum memscan_engine e)
+{
+	if (!engine_supported(e)) {
+		return false;
+	}
+	switch (e)
+	{
+#ifdef HAVE_X86_SIMD
+		case MEMSCAN_AVX2: scan = scan_avx2; marker = marker_avx2; break;
+		case MEMSCAN_SSE2: scan = scan_sse2; marker = marker_sse2; break;
+#endif
+		default: scan = scan_scalar; marker = marker_scalar; break;
+	}
+	engine = e;
+	return true;
+}
+
+// Pick the best engine that the CPU supports, once, before main() runs;
+// this way there are no races between threads on first use:
+__attribute__((constructor))
+static void
+memscan_init (void)
+{
+#ifdef HAVE_X86_SIMD
+	__builtin_cpu_init();
+#endif
+	if (memscan_set_engine(MEMSCAN_AVX2)) {
+		return;
+	}
+	if (memscan_set_engine(MEMSCAN_SSE2)) {
+		return;
+	}
+	memscan_set_engine(MEMSCAN_SCALAR);
+}
+
+const char *
+memscan_pair (const char *start, const char *end, char first, char last, unsigned int dist)
+{
+	return scan(start, end, first, last, dist);
+}
+
+const char *
+memscan_marker (const char *start, const char *end)
+{
+	return marker(start, end);
+}
+
+enum memscan_engine
+memscan_get_engine (void)
+{
+	return engine;
+}
+
+const char *
+memscan_engine_name (enum memscan_engine e)
+{
+	switch (e) {
+		case MEMSCAN_SCALAR: return "scalar";
+		case MEMSCAN_SSE2: return "sse2";
+		case MEMSCAN_AVX2: return "avx2";
+	}
+	return "unknown";
+}
@@ -0,0 +1,23 @@
+#ifndef MEMSCAN_H
+#define MEMSCAN_H
+
+// Scanning engines, in increasing order of preference:
+enum memscan_engine
+{ MEMSCAN_SCALAR
+, MEMSCAN_SSE2
+, MEMSCAN_AVX2
+};
+
+// Find the first position p in [start, end) where p[0] == first and
+// p[dist] == last, and p + dist is still inside the range:
+const char *memscan_pair (const char *start, const char *end, char first, char last, unsigned int dist);
+
+// Find the first marker in JPEG entropy-coded data: an 0xff followed by
+// a byte that is not a stuffed zero or a restart marker, both in range:
+const char *memscan_marker (const char *start, const char *end);
+
+enum memscan_engine memscan_get_engine (void);
+bool memscan_set_engine (enum memscan_engine);
+const char *memscan_engine_name (enum memscan_engine);
+
+#endif	// MEMSCAN_H
@@ -71,6 +71,12 @@ mjv_config_get_sources (struct mjv_config *const c)
 	for (i = 0; i < len; i++) {
 		int port = 0;
 		int usec = 200000;
+		int max_frame_size = 0;
+		int io_uring = 0;
+		int mmap = 0;
+		double speed = 1.0;
+		const char *timing = NULL;
+		const char *decode = NULL;
 		const char *type = NULL;
 		const char *name = NULL;
 		const char *host = NULL;
@@ -94,6 +100,16 @@ mjv_config_get_sources (struct mjv_config *const c)
 			if ((source = source_file_create(name, file, usec)) == NULL) {
 				goto err;
 			}
+			// Play at the recorded capture times instead of at the
+			// interval, if asked to; optionally sped up:
+			config_setting_lookup_string(csource, "timing", &timing);
+			config_setting_lookup_float( csource, "speed", &speed);
+			source_set_pace(source, (usec > 0) ? usec : 0, timing != NULL && strcmp(timing, "original") == 0, speed);
+
+			// Optionally map the whole file into memory:
+			if (config_setting_lookup_bool(csource, "mmap", &mmap) == CONFIG_TRUE) {
+				source_set_mmap(source, mmap);
+			}
 		}
 		else if (strcmp(type, "network") == 0)
 		{
@@ -111,6 +127,18 @@ mjv_config_get_sources (struct mjv_config *const c)
 		else {
 			continue;
 		}
+		// Optional ceiling on the frame size, in bytes:
+		if (config_setting_lookup_int(csource, "max_frame_size", &max_frame_size) == CONFIG_TRUE && max_frame_size > 0) {
+			source_set_max_frame_size(source, max_frame_size);
+		}
+		// Optionally read through io_uring, where available:
+		if (config_setting_lookup_bool(csource, "io_uring", &io_uring) == CONFIG_TRUE) {
+			source_set_io_uring(source, io_uring);
+		}
+		// Decode profile for the viewer, "quality" or "fast":
+		if (config_setting_lookup_string(csource, "decode", &decode) == CONFIG_TRUE) {
+			source_set_fast_decode(source, strcmp(decode, "fast") == 0);
+		}
 		// Allocate new node for linked list:
 		if ((s = malloc(sizeof(*s))) == NULL) {
 			source->destroy(&source);
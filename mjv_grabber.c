@@ -1,17 +1,36 @@
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdint.h>
 #include <time.h>
 #include <unistd.h>
+#include <errno.h>
 
 #include "mjv_log.h"
 #include "source.h"
 #include "frame.h"
+#include "boundary.h"
+#include "memscan.h"
+#include "streambuf.h"
+#include "pacer.h"
 #include "mjv_grabber.h"
 
-// Buffer must be large enough to hold the entire JPEG frame:
-#define BUF_SIZE	100000
+// Buffer must be large enough to hold the entire JPEG frame. It starts
+// out at the minimum size and grows on demand up to the ceiling:
+#define BUF_SIZE_MIN	100000
+#define BUF_SIZE_MAX	(16 * 1024 * 1024)
+
+// Number of frames to observe before considering shrinking the buffer:
+#define SHRINK_WINDOW	100
+
+// When reading the remainder of an image of known length, also read
+// this many bytes more, to catch the header of the next part:
+#define READ_TRAILER	256
+
+// When parsing a file that is mapped into memory, hand over this many
+// bytes at a time, so that batches of frames stay small:
+#define MAP_CHUNK	(1024 * 1024)
 
 // The string length of a constant character array is one less
 // than its apparent size, because of the zero terminator:
@@ -25,6 +44,9 @@
 #define U16_BYTESWAP(y)	(((((uint16_t)y) >> 8) & 0xFF) | ((((uint16_t)y) & 0xFF) << 8))
 #define VALUE_AT(x,y)	(*((uint16_t *)(x)) == U16_BYTESWAP(y))
 
+// Read the big-endian 16-bit value at a location:
+#define U16_AT(x)	((((const unsigned char *)(x))[0] << 8) | ((const unsigned char *)(x))[1])
+
 // States in our state machine:
 enum states {
 	STATE_HTTP_BANNER,
@@ -33,13 +55,14 @@ enum states {
 	STATE_HTTP_SUBHEADER,
 	STATE_FIND_IMAGE,
 	STATE_IMAGE_BY_CONTENT_LENGTH,
-	STATE_IMAGE_BY_EOF_SEARCH
+	STATE_IMAGE_BY_SEGMENTS
 };
 
 // Return codes for each state:
 enum state_result {
 	READ_SUCCESS,
 	OUT_OF_BYTES,
+	END_OF_RANGE,
 	CORRUPT_HEADER,
 	READ_ERROR
 };
@@ -48,28 +71,49 @@ static char header_content_type_one[] = "Content-Type:";
 static char header_content_type_two[] = "Content-type:";
 static char header_content_length_one[] = "Content-Length:";
 static char header_content_length_two[] = "Content-length:";
+static char header_timestamp[] = "X-Timestamp:";
 
 struct mjv_grabber
 {
-	int nread;		// return value of read();
 	enum states state;	// state machine state
-	char *boundary;
-	int delay_usec;
-	unsigned int boundary_len;
+	struct boundary *boundary;
+	struct pacer *pacer;
 	unsigned int response_code;
 	unsigned int content_length;
-	struct timespec last_emitted;
+	struct timespec capture;	// capture time from the part header;
+	bool has_capture;
+	unsigned int seg_pos;	// offset of next JPEG marker from anchor;
+	bool seg_entropy;	// whether seg_pos is in entropy-coded data;
+	struct mjv_grabber_stats stats;
 	struct source *source;
 
-	char *buf;	// read buffer;
+	struct streambuf *sb;	// read buffer;
+	enum mjv_grabber_frames frames;	// how frames refer to the read buffer;
+	struct streambuf *spare;	// read buffer set aside while parsing a mapped file;
+	unsigned int buf_max;	// ceiling for read buffer size;
+	unsigned int frame_size_est;	// running estimate of frame size;
+	unsigned int window_frames;	// frames seen in shrink window;
+	unsigned int window_max;	// largest frame in shrink window;
 	char *cur;	// current char under inspection in buffer;
 	char *head;	// where the current read starts;
 	char *anchor;	// the first byte in the buffer to keep;
+	char *limit;	// when parsing a range, stop at the first boundary past this;
 
 	// This callback function is called whenever
 	// a frame object is created by a source:
 	void (*callback)(struct frame *, void *);
 	void *user_pointer;
+
+	// Alternatively, this callback is called once per
+	// pass with all the frames found in that pass:
+	void (*batch_callback)(struct frame **, unsigned int, void *);
+
+	// Without a callback, or for the batch callback, frames are
+	// queued here to be picked up with mjv_grabber_next_frame():
+	struct frame **queue;
+	unsigned int queue_head;
+	unsigned int queue_len;
+	unsigned int queue_size;
 };
 
 static inline unsigned int
@@ -94,28 +138,50 @@ mjv_grabber_create (struct source *source)
 	if ((s = malloc(sizeof(*s))) == NULL) {
 		goto err;
 	}
-	if ((s->buf = malloc(BUF_SIZE)) == NULL) {
+	s->boundary = NULL;
+	s->pacer = NULL;
+	s->spare = NULL;
+
+	// By default, read into a slab buffer so that frames can refer
+	// to their bytes in place, without copying:
+	if ((s->sb = streambuf_create(BUF_SIZE_MIN, STREAMBUF_SLAB)) == NULL) {
 		goto err;
 	}
+	s->frames = MJV_GRABBER_FRAMES_SHARED;
+	s->buf_max = BUF_SIZE_MAX;
+	if (source != NULL && source_get_max_frame_size(source) > 0) {
+		s->buf_max = source_get_max_frame_size(source) + MJV_GRABBER_BUF_HEADROOM;
+	}
+	if (s->buf_max < BUF_SIZE_MIN) {
+		s->buf_max = BUF_SIZE_MIN;
+	}
+	s->frame_size_est = 0;
+	s->window_frames = 0;
+	s->window_max = 0;
 	// Set default values:
-	s->boundary = NULL;
 	s->content_length = 0;
-	s->delay_usec = 0;
+	s->has_capture = false;
+	memset(&s->stats, 0, sizeof(s->stats));
 	s->state = STATE_HTTP_BANNER;
-	s->last_emitted.tv_sec = 0;
-	s->last_emitted.tv_nsec = 0;
 	s->source = source;
 
 	s->callback = NULL;
+	s->batch_callback = NULL;
 	s->user_pointer = NULL;
 
+	s->queue = NULL;
+	s->queue_head = 0;
+	s->queue_len = 0;
+	s->queue_size = 0;
+
 	s->anchor = NULL;
-	s->cur = s->head = s->buf;
+	s->limit = NULL;
+	s->cur = s->head = streambuf_base(s->sb);
 
 	return s;
 
 err:	if (s != NULL) {
-		free(s->buf);
+		streambuf_destroy(&s->sb);
 		free(s);
 	}
 	return NULL;
@@ -124,12 +190,22 @@ err:	if (s != NULL) {
 void
 mjv_grabber_destroy (struct mjv_grabber **s)
 {
+	struct frame *frame;
+
 	if (s == NULL || *s == NULL) {
 		return;
 	}
-	log_info("Destroying source %s\n", source_get_name((*s)->source));
-	free((*s)->boundary);
-	free((*s)->buf);
+	if ((*s)->source != NULL) {
+		log_info("Destroying source %s\n", source_get_name((*s)->source));
+	}
+	while ((frame = mjv_grabber_next_frame(*s)) != NULL) {
+		frame_destroy(&frame);
+	}
+	free((*s)->queue);
+	pacer_destroy(&(*s)->pacer);
+	boundary_destroy(&(*s)->boundary);
+	streambuf_destroy(&(*s)->sb);
+	streambuf_destroy(&(*s)->spare);
 	free(*s);
 	*s = NULL;
 }
@@ -138,9 +214,125 @@ void
 mjv_grabber_set_callback (struct mjv_grabber *s, void (*got_frame_callback)(struct frame*, void*), void *user_pointer)
 {
 	s->callback = got_frame_callback;
+	s->batch_callback = NULL;
+	s->user_pointer = user_pointer;
+}
+
+void
+mjv_grabber_set_batch_callback (struct mjv_grabber *s, void (*got_frames_callback)(struct frame**, unsigned int, void*), void *user_pointer)
+{
+	s->batch_callback = got_frames_callback;
+	s->callback = NULL;
 	s->user_pointer = user_pointer;
 }
 
+bool
+mjv_grabber_set_frames (struct mjv_grabber *s, enum mjv_grabber_frames frames)
+{
+	struct streambuf *sb;
+
+	// Shared frames need a slab buffer. Others can use a mirrored
+	// buffer, which never needs to move its contents. Can only
+	// switch while the buffer is still empty:
+	if (s->head != streambuf_base(s->sb)) {
+		return false;
+	}
+	if ((sb = streambuf_create(streambuf_size(s->sb), (frames == MJV_GRABBER_FRAMES_SHARED) ? STREAMBUF_SLAB : STREAMBUF_MIRRORED)) == NULL) {
+		return false;
+	}
+	streambuf_destroy(&s->sb);
+	s->sb = sb;
+	s->cur = s->head = streambuf_base(s->sb);
+	s->frames = frames;
+	return true;
+}
+
+void
+mjv_grabber_get_stats (const struct mjv_grabber *s, struct mjv_grabber_stats *stats)
+{
+	memcpy(stats, &s->stats, sizeof(*stats));
+}
+
+static unsigned int
+bufsize_for_frame (const struct mjv_grabber *s, unsigned int frame_size)
+{
+	// A buffer twice the frame size leaves room for the next frame
+	// to start arriving before the current one is done; round up
+	// to whole pages and keep within bounds:
+	unsigned long size = ((2UL * frame_size + MJV_GRABBER_BUF_HEADROOM) + 4095) & ~4095UL;
+
+	if (size < BUF_SIZE_MIN) {
+		return BUF_SIZE_MIN;
+	}
+	if (size > s->buf_max) {
+		return s->buf_max;
+	}
+	return size;
+}
+
+static inline char *
+keepfrom (const struct mjv_grabber *s)
+{
+	// First byte to keep is either the byte at the anchor,
+	// or the byte at cur:
+	return (s->anchor == NULL) ? s->cur : s->anchor;
+}
+
+static void
+rebase_pointers (struct mjv_grabber *s, ptrdiff_t shift)
+{
+	// Follow the contents of the read buffer after they moved:
+	s->cur += shift;
+	s->head += shift;
+	if (s->anchor != NULL) {
+		s->anchor += shift;
+	}
+}
+
+static void
+flush_batch (struct mjv_grabber *s)
+{
+	// Hand all queued frames to the batch callback:
+	if (s->batch_callback != NULL && s->queue_head < s->queue_len) {
+		s->batch_callback(s->queue + s->queue_head, s->queue_len - s->queue_head, s->user_pointer);
+		s->queue_head = s->queue_len = 0;
+	}
+}
+
+static bool
+resize_streambuf (struct mjv_grabber *s, unsigned int size)
+{
+	ptrdiff_t shift;
+	unsigned int old_size = streambuf_size(s->sb);
+
+	// Borrowed frames refer to the old buffer; hand
+	// over the frames found so far while it is still there:
+	flush_batch(s);
+
+	if (!streambuf_resize(s->sb, size, keepfrom(s), s->head, &shift)) {
+		log_error("Could not resize read buffer to %u bytes\n", size);
+		return false;
+	}
+	log_debug("Resized read buffer from %u to %zu bytes\n", old_size, streambuf_size(s->sb));
+	rebase_pointers(s, shift);
+	return true;
+}
+
+static void
+track_frame_size (struct mjv_grabber *s, unsigned int len)
+{
+	// Exponentially weighted moving average of the frame size:
+	s->frame_size_est = (s->frame_size_est == 0)
+		? len
+		: s->frame_size_est - s->frame_size_est / 8 + len / 8;
+
+	// Track the largest frame within the shrink window:
+	if (len > s->window_max) {
+		s->window_max = len;
+	}
+	s->window_frames++;
+}
+
 static inline bool
 is_numeric (char c)
 {
@@ -235,21 +427,24 @@ interpret_content_type (struct mjv_grabber *s, char *line, unsigned int line_len
 			char *end;
 			cur += STR_LEN(boundary);
 			end = cur;
-			// Everything up to EOL or next semicolon is boundary:
-			while (*end != ';' && end != last) {
+			// Everything up to EOL or next semicolon is boundary;
+			// 'end' stops just past it:
+			while (end <= last && *end != ';') {
 				end++;
 			}
 			if (end > cur) {
-				// Allocate storage for boundary, copy over:
-				s->boundary_len = end - cur + 1;
-				if ((s->boundary = malloc(s->boundary_len + 1)) == NULL) {
-					// TODO: better handling
-					log_error("malloc()");
+				// Create the boundary object; this also precomputes
+				// the tables used to search for it in the stream:
+				boundary_destroy(&s->boundary);
+				if ((s->boundary = boundary_create(cur, end - cur)) == NULL) {
+					log_error("Could not create boundary\n");
 					return READ_ERROR;
 				}
-				memcpy(s->boundary, cur, s->boundary_len);
-				s->boundary[s->boundary_len] = 0;
 			}
+			if (end > last) {
+				return READ_SUCCESS;
+			}
+			cur = end;
 		}
 	}
 	return READ_SUCCESS;
@@ -259,74 +454,108 @@ interpret_content_type (struct mjv_grabber *s, char *line, unsigned int line_len
 #undef STRING_MATCH
 }
 
-static void
-artificial_delay (unsigned int delay_usec, struct timespec *last)
+static bool
+validate_frame (struct mjv_grabber *s, const char *start, unsigned int *len)
 {
-	struct timespec now;
-	unsigned long delay_sec;
-	unsigned long delay_nsec;
-
-	if (delay_usec < 1000000) {
-		delay_sec = 0;
-		delay_nsec = delay_usec * 1000;
+	// Quick validity check on the frame;
+	// must start with 0xffd8 and end with 0xffd9:
+	if (*len < 4 || !VALUE_AT(start, 0xffd8)) {
+		log_debug("Dropping frame: invalid start marker\n");
+		s->stats.bad_start++;
+		return false;
 	}
-	else {
-		delay_sec = delay_usec / 1000000;
-		delay_nsec = (delay_usec % 1000000) * 1000;
+	// Allow for a few bytes of padding behind the end marker,
+	// and trim them off:
+	for (unsigned int i = 0; i < MJV_GRABBER_EOI_SLACK && *len - i >= 4; i++) {
+		if (VALUE_AT(start + *len - i - 2, 0xffd9)) {
+			*len -= i;
+			return true;
+		}
 	}
-	clock_gettime(CLOCK_REALTIME, &now);
+	log_debug("Dropping frame: invalid end marker\n");
+	s->stats.bad_end++;
+	return false;
+}
 
-	// Need a nonzero previous timestamp to time against:
-	if (last->tv_sec > 0)
-	{
-		// Calculate scheduled awakening:
-		now.tv_sec  = last->tv_sec  + delay_sec;
-		now.tv_nsec = last->tv_nsec + delay_nsec;
-		if (now.tv_nsec >= 1000000000) {
-			now.tv_sec++;
-			now.tv_nsec -= 1000000000;
+static bool
+enqueue_frame (struct mjv_grabber *s, struct frame *frame)
+{
+	// Reclaim the slots of frames already picked up:
+	if (s->queue_len == s->queue_size && s->queue_head > 0) {
+		memmove(s->queue, s->queue + s->queue_head, (s->queue_len - s->queue_head) * sizeof(*s->queue));
+		s->queue_len -= s->queue_head;
+		s->queue_head = 0;
+	}
+	// Grow the queue if needed:
+	if (s->queue_len == s->queue_size) {
+		unsigned int size = (s->queue_size == 0) ? 8 : 2 * s->queue_size;
+		struct frame **queue;
+
+		if ((queue = realloc(s->queue, size * sizeof(*queue))) == NULL) {
+			return false;
 		}
-		// Keep sleeping across interrupts until the now has come to pass:
-		while (clock_nanosleep(CLOCK_REALTIME, TIMER_ABSTIME, &now, NULL) != 0);
+		s->queue = queue;
+		s->queue_size = size;
 	}
-	// Update the last emission time to the now:
-	memcpy(last, &now, sizeof(struct timespec));
+	s->queue[s->queue_len++] = frame;
+	return true;
 }
 
 static bool
 got_new_frame (struct mjv_grabber *s, char *start, unsigned int len)
 {
 	struct frame *frame;
+	struct slab *slab;
+	const struct timespec *capture = (s->has_capture) ? &s->capture : NULL;
 
-#if 0
-	// Quick validity check on the frame;
-	// must start with 0xffd8 and end with 0xffd9:
-	if (!VALUE_AT(start, 0xffd8)) {
-		log_error("Invalid start marker!\n");
-	}
-	if (!VALUE_AT(start + len - 2, 0xffd9)) {
-		log_error("%s: invalid JPEG EOF signature\n", s->name);
-		{
-			char *c;
-			for (c = start + len - 20; c < start + len + 20; c++) {
-				if (VALUE_AT(c, 0xffd9)) log_error("Off by %i??\n", c - (start + len - 2));
-			}
-		}
+	if (!validate_frame(s, start, &len)) {
+		return false;
 	}
-#endif
-	if (s->delay_usec > 0) {
-		artificial_delay(s->delay_usec, &s->last_emitted);
+	track_frame_size(s, len);
+
+	// Borrowed frames are only valid during a callback; queued for
+	// mjv_grabber_next_frame(), later reads would overwrite them:
+	if (s->frames == MJV_GRABBER_FRAMES_BORROWED && s->callback == NULL && s->batch_callback == NULL) {
+		log_error("Borrowed frames need a callback; dropping frame\n");
+		return false;
 	}
-	if (s->callback == NULL) {
-		log_error("No callback defined for frame\n");
+	// When playing back at a pace, wait till the frame is due:
+	if (s->pacer != NULL && !pacer_wait(s->pacer, capture, s->source->selfpipe_readfd)) {
 		return false;
 	}
-	if ((frame = frame_create(start, len)) == NULL) {
+	// If reading into a slab, the frame can refer to it in place;
+	// borrowed frames always do:
+	if ((slab = streambuf_get_slab(s->sb)) != NULL) {
+		frame = frame_create_from_slab(slab, start, len);
+	}
+	else if (s->frames == MJV_GRABBER_FRAMES_BORROWED) {
+		frame = frame_create_borrowed(start, len);
+	}
+	else {
+		frame = frame_create(start, len);
+	}
+
+	if (frame == NULL) {
 		log_error("Could not create frame\n");
 		return false;
 	}
-	s->callback(frame, s->user_pointer);
+	if (capture != NULL) {
+		frame_set_capture_time(frame, capture);
+	}
+	if (s->callback != NULL) {
+		s->callback(frame, s->user_pointer);
+	}
+	else if (!enqueue_frame(s, frame)) {
+		log_error("Could not queue frame\n");
+		frame_destroy(&frame);
+		return false;
+	}
+	s->stats.frames++;
 
+	// Paced frames go out one by one:
+	if (s->pacer != NULL) {
+		flush_batch(s);
+	}
 	return true;
 }
 
@@ -418,50 +647,81 @@ state_http_header (struct mjv_grabber *s)
 static enum state_result
 state_find_boundary (struct mjv_grabber *s)
 {
-	// Loop over the input till we find a \r\n or an \n followed by
-	// our boundary marker, and another \r\n or \n:
-	for (;;)
+	const char *match;
+	const char *from;
+	unsigned int len = boundary_get_len(s->boundary);
+
+	// If the previous call ran out of bytes, it left the anchor on the
+	// earliest byte that could still start a match; resume from there:
+	from = (s->anchor == NULL) ? s->cur : s->anchor;
+	s->anchor = NULL;
+
+	// Find our boundary marker, followed by an \r\n or an \n:
+	while ((match = boundary_find(s->boundary, from, s->head)) != NULL)
 	{
-		// If this character matches the first character of the boundary,
-		// then it might be the start of a match; set the anchor:
-		if (s->anchor == NULL) {
-			if (*s->cur == *s->boundary) {
-				s->anchor = s->cur;
-			}
+		const char *eol = match + len;
+
+		// Need to see the line terminator before we can decide:
+		if (eol >= s->head || (*eol == (char)0x0d && eol + 1 >= s->head)) {
+			break;
 		}
-		else {
-			// Complete boundary not yet found, and we have a non-matching character;
-			// restart the scan:
-			if (LINE_LEN <= s->boundary_len && *s->cur != s->boundary[s->cur - s->anchor]) {
-				s->cur = s->anchor + 1;
-				s->anchor = NULL;
-			}
-			// If successfully found boundary plus one byte, and that byte is \n, then success:
-			if (LINE_LEN == s->boundary_len + 1 && *s->cur == (char)0x0a) {
-				s->anchor = NULL;
-				s->state = STATE_HTTP_SUBHEADER;
-				break;
-			}
-			// If successfully found boundary plus two bytes...
-			if (LINE_LEN == s->boundary_len + 2) {
-				// ..and those two bytes are \r\n, then success...
-				if (VALUE_AT(s->cur - 1, 0x0d0a)) {
-					s->anchor = NULL;
-					s->content_length = 0;
-					s->state = STATE_HTTP_SUBHEADER;
-					break;
-				}
-				// ...else back to square one:
-				s->cur = s->anchor + 1;
-				s->anchor = NULL;
+		if (*eol == (char)0x0d) {
+			eol++;
+		}
+		if (*eol == (char)0x0a) {
+			// When parsing a range of a file, stop at the
+			// first boundary at or past the end of the range:
+			if (s->limit != NULL && match >= s->limit) {
+				s->cur = (char *)match;
+				s->limit = NULL;
+				return END_OF_RANGE;
 			}
+			s->cur = (char *)eol;
+			s->content_length = 0;
+			s->has_capture = false;
+			s->state = STATE_HTTP_SUBHEADER;
+			return increment_cur(s);
 		}
-		// Move on to next byte:
-		if (increment_cur(s) == OUT_OF_BYTES) {
-			return OUT_OF_BYTES;
+		// Not followed by a line terminator, keep looking:
+		from = match + 1;
+	}
+	// Out of bytes. Keep the tail of the buffer that might contain the
+	// start of a boundary that is split across reads:
+	if (match != NULL) {
+		from = match;
+	}
+	else if (s->head - from >= (long)len) {
+		from = s->head - len + 1;
+	}
+	s->anchor = (char *)from;
+	s->cur = s->head;
+	return OUT_OF_BYTES;
+}
+
+static bool
+parse_timestamp (const char *cur, const char *last, struct timespec *ts)
+{
+	long scale = 100000000;
+
+	// Seconds and an optional fraction, as in "1234567890.123456":
+	while (cur <= last && *cur == ' ') {
+		cur++;
+	}
+	if (cur > last || !is_numeric(*cur)) {
+		return false;
+	}
+	ts->tv_sec = 0;
+	ts->tv_nsec = 0;
+	while (cur <= last && is_numeric(*cur)) {
+		ts->tv_sec = ts->tv_sec * 10 + (*cur++ - '0');
+	}
+	if (cur <= last && *cur == '.') {
+		while (++cur <= last && is_numeric(*cur) && scale > 0) {
+			ts->tv_nsec += (*cur - '0') * scale;
+			scale /= 10;
 		}
 	}
-	return increment_cur(s);
+	return true;
 }
 
 static enum state_result
@@ -502,6 +762,9 @@ state_http_subheader (struct mjv_grabber *s)
 				s->content_length = simple_atoi(num_start, num_end);
 			}
 		}
+		else if (STRING_MATCH(header_timestamp)) {
+			s->has_capture = parse_timestamp(line + STR_LEN(header_timestamp), line + line_len - 1, &s->capture);
+		}
 		if (increment_cur(s) == OUT_OF_BYTES) {
 			return OUT_OF_BYTES;
 		}
@@ -512,6 +775,37 @@ state_http_subheader (struct mjv_grabber *s)
 #undef STRING_MATCH
 }
 
+static bool
+reserve_image (struct mjv_grabber *s)
+{
+	// The content length is known and we are at the start of the image.
+	// Make room for all of it right behind the anchor, now that only a
+	// few of its bytes need to be moved. The rest of the image can then
+	// be read straight into place:
+	unsigned int needed = s->content_length + READ_TRAILER;
+	unsigned int found = s->head - s->anchor;
+
+	// A mapped file holds all of its bytes already:
+	if (streambuf_get_type(s->sb) == STREAMBUF_MAPPED) {
+		return true;
+	}
+	if (needed > streambuf_size(s->sb)) {
+		resize_streambuf(s, bufsize_for_frame(s, s->content_length));
+	}
+	// Only the image itself must fit; the trailer
+	// gets whatever room is left:
+	if (s->content_length > streambuf_size(s->sb)) {
+		return false;
+	}
+	if (needed > streambuf_size(s->sb)) {
+		needed = streambuf_size(s->sb);
+	}
+	if (found < needed) {
+		rebase_pointers(s, streambuf_reserve(s->sb, needed - found, s->anchor, s->head));
+	}
+	return true;
+}
+
 static enum state_result
 state_find_image (struct mjv_grabber *s)
 {
@@ -524,16 +818,21 @@ state_find_image (struct mjv_grabber *s)
 		}
 		else if ((s->cur - s->anchor) == 1 && *s->cur == (char)0xd8) {
 			// If the content length is known, we can use it to
-			// take a shortcut; else brute search for the EOF:
+			// take a shortcut; else walk the JPEG segments:
 			s->state = (s->content_length > 0)
 				? STATE_IMAGE_BY_CONTENT_LENGTH
-				: STATE_IMAGE_BY_EOF_SEARCH;
+				: STATE_IMAGE_BY_SEGMENTS;
 
-			// Check that the whole of the image can fit in the buffer.
-			// FIXME: do something nicer:
-			if (s->content_length > BUF_SIZE) {
-				log_error("Content length larger than read buffer; frame won't fit\n");
-				log_error("Skipping frame, sorry.\n");
+			// The first marker follows the start-of-image marker:
+			s->seg_pos = 2;
+			s->seg_entropy = false;
+
+			// Check that the whole of the image can fit in the buffer;
+			// grow the buffer now if we can, while it is cheap to do:
+			if (s->content_length > 0 && !reserve_image(s)) {
+				log_error("Content length %u larger than read buffer ceiling of %u; skipping frame\n", s->content_length, s->buf_max);
+				s->stats.oversize++;
+				s->anchor = NULL;
 				s->state = STATE_FIND_BOUNDARY;
 			}
 			break;
@@ -589,94 +888,194 @@ state_image_by_content_length (struct mjv_grabber *s)
 }
 
 static enum state_result
-state_image_by_eof_search (struct mjv_grabber *s)
+drop_malformed_frame (struct mjv_grabber *s, const char *reason)
 {
-	// If no content-length known, then there's nothing we can
-	// do but seek the EOF marker, 0xffd9, one byte at a time:
+	log_debug("Dropping frame: %s\n", reason);
+	s->stats.bad_segment++;
+
+	// Resynchronize by searching for the next boundary from just
+	// past the start marker of this frame:
+	s->cur = s->anchor + 2;
+	s->anchor = NULL;
+	s->state = STATE_FIND_BOUNDARY;
+	return READ_SUCCESS;
+}
+
+static enum state_result
+state_image_by_segments (struct mjv_grabber *s)
+{
+	const unsigned char *p;
+	const unsigned char *base = (const unsigned char *)s->anchor;
+	const unsigned char *head = (const unsigned char *)s->head;
+
+	// If no content-length known, walk the JPEG structure to find the
+	// EOF marker. Marker segments carry their own length, so we can
+	// jump straight over them. Only the entropy-coded data following
+	// the start-of-scan marker needs to be searched for an 0xff:
 	for (;;)
 	{
-		// If we found the EOF marker, export the frame and be done:
-		if (VALUE_AT(s->cur - 1, 0xffd9)) {
+		if ((p = base + s->seg_pos) >= head) {
+			break;
+		}
+		if (s->seg_entropy)
+		{
+			// Skip over stuffed zero bytes and restart markers; any
+			// other marker ends the entropy-coded data:
+			if ((p = (const unsigned char *)memscan_marker((const char *)p, (const char *)head)) == NULL) {
+				// Keep a trailing 0xff till its next byte is in:
+				s->seg_pos = (head[-1] == 0xff) ? head - 1 - base : head - base;
+				break;
+			}
+			s->seg_pos = p - base;
+			s->seg_entropy = false;
+			continue;
+		}
+		if (p + 1 >= head) {
+			break;
+		}
+		if (p[0] != 0xff) {
+			return drop_malformed_frame(s, "expected a marker");
+		}
+		// Fill byte:
+		if (p[1] == 0xff) {
+			s->seg_pos++;
+			continue;
+		}
+		// End of image, export the frame and be done:
+		if (p[1] == 0xd9) {
+			s->cur = (char *)p + 1;
 			got_new_frame(s, s->anchor, s->cur - s->anchor + 1);
 			s->anchor = NULL;
 			s->state = STATE_FIND_BOUNDARY;
 			return increment_cur(s);
 		}
-		if (increment_cur(s) == OUT_OF_BYTES) {
-			return OUT_OF_BYTES;
+		if (p[1] == 0xd8) {
+			return drop_malformed_frame(s, "unexpected start marker");
+		}
+		// Standalone markers without a length field:
+		if (p[1] == 0x01 || (p[1] >= 0xd0 && p[1] <= 0xd7)) {
+			s->seg_pos += 2;
+			continue;
+		}
+		// All other markers are followed by a length field,
+		// which includes itself but not the marker:
+		if (p + 3 >= head) {
+			break;
+		}
+		if (U16_AT(p + 2) < 2) {
+			return drop_malformed_frame(s, "invalid segment length");
+		}
+		s->seg_pos += 2 + U16_AT(p + 2);
+
+		// The start-of-scan header is followed by entropy-coded data:
+		if (p[1] == 0xda) {
+			s->seg_entropy = true;
 		}
 	}
+	s->cur = s->head;
+	return OUT_OF_BYTES;
 }
 
 static void
 adjust_streambuf (struct mjv_grabber *s)
 {
-	// Cheap test: if anchored at start of buffer, nothing to do:
-	if (s->anchor == s->buf) {
-		return;
+	// Let go of the bytes we no longer need:
+	rebase_pointers(s, streambuf_compact(s->sb, keepfrom(s), s->head));
+
+	// After a window of frames, give back memory if the frames
+	// have become much smaller than the buffer:
+	if (s->window_frames >= SHRINK_WINDOW) {
+		unsigned int size = bufsize_for_frame(s, s->window_max);
+		if (size < streambuf_size(s->sb) / 2) {
+			resize_streambuf(s, size);
+		}
+		s->window_frames = 0;
+		s->window_max = 0;
 	}
-	// First byte to keep is either the byte at the anchor,
-	// or the byte at cur:
-	char *keepfrom = (s->anchor == NULL) ? s->cur : s->anchor;
+}
+
+static bool
+grow_streambuf (struct mjv_grabber *s)
+{
+	// Double the size, or jump straight
+	// to the size the estimate calls for:
+	unsigned long size = 2UL * streambuf_size(s->sb);
 
-	// How much bytes at the start to shift over:
-	unsigned int offset = keepfrom - s->buf;
+	if (size < bufsize_for_frame(s, s->frame_size_est)) {
+		size = bufsize_for_frame(s, s->frame_size_est);
+	}
+	if (size > s->buf_max) {
+		size = s->buf_max;
+	}
+	if (size <= streambuf_size(s->sb)) {
+		return false;
+	}
+	return resize_streambuf(s, size);
+}
 
-	// How much bytes left from keep till end?
-	unsigned int good_bytes = s->head - keepfrom;
+static bool
+ensure_space (struct mjv_grabber *s)
+{
+	unsigned int space = streambuf_space(s->sb, keepfrom(s), s->head);
 
-	// If important bytes left in buffer at an offset, move them:
-	if (good_bytes > 0 && offset > 0) {
-		memmove(s->buf, keepfrom, good_bytes);
-		s->cur -= offset;
-		s->head -= offset;
-		s->anchor -= offset;
-		return;
+	// Grow the buffer when it is getting full:
+	if (space >= streambuf_size(s->sb) / 8 || grow_streambuf(s)) {
+		return true;
 	}
-	// Else if no anchor, reset to start of buffer:
-	if (s->anchor == NULL) {
-		s->cur = s->head = s->buf;
+	if (space > 0) {
+		return true;
+	}
+	// If we cannot grow the buffer any further and are in the middle
+	// of an image, drop the image and look for the next boundary:
+	if (s->state == STATE_IMAGE_BY_CONTENT_LENGTH
+	 || s->state == STATE_IMAGE_BY_SEGMENTS) {
+		log_error("Frame larger than read buffer ceiling of %u; skipping frame\n", s->buf_max);
+		s->stats.oversize++;
+		s->anchor = NULL;
+		s->cur = s->head;
+		s->state = STATE_FIND_BOUNDARY;
+		rebase_pointers(s, streambuf_compact(s->sb, s->head, s->head));
+		return true;
 	}
+	return false;
 }
 
-enum mjv_grabber_status
-mjv_grabber_run (struct mjv_grabber *s)
+static enum mjv_grabber_status
+dispatch (struct mjv_grabber *s)
 {
 	// Jump table per state; order corresponds with
 	// the state enum at the top of this file:
-	enum state_result (*state_jump_table[])(struct mjv_grabber *) = {
+	static enum state_result (*const state_jump_table[])(struct mjv_grabber *) = {
 		state_http_banner,
 		state_http_header,
 		state_find_boundary,
 		state_http_subheader,
 		state_find_image,
 		state_image_by_content_length,
-		state_image_by_eof_search
+		state_image_by_segments
 	};
+	// Dispatcher; while successful, keep jumping from state to state:
 	for (;;)
 	{
-		s->nread = source_read(s->source, s->head, BUF_SIZE - (s->head - s->buf));
-		if (s->nread < 0) {
-			return MJV_GRABBER_READ_ERROR;
-		}
-		else if (s->nread == 0) {
-			log_info("End of file\n");
-			return MJV_GRABBER_PREMATURE_EOF;
-		}
-		// buflast is always ONE PAST the real last char:
-		s->head += s->nread;
-
-		log_debug("Read %u bytes\n", s->nread);
-
-		// Dispatcher; while successful, keep jumping from state to state:
-next_state: 	switch (state_jump_table[s->state](s))
+		switch (state_jump_table[s->state](s))
 		{
 			case READ_SUCCESS:
-				goto next_state;
+				continue;
 
 			case OUT_OF_BYTES:
+				// A mapped file is never compacted or refilled:
+				if (streambuf_get_type(s->sb) == STREAMBUF_MAPPED) {
+					return MJV_GRABBER_SUCCESS;
+				}
 				adjust_streambuf(s);
-				continue;
+				if (!ensure_space(s)) {
+					log_error("Header larger than read buffer\n");
+					return MJV_GRABBER_CORRUPT_HEADER;
+				}
+				return MJV_GRABBER_SUCCESS;
+
+			case END_OF_RANGE:
+				return MJV_GRABBER_SUCCESS;
 
 			case READ_ERROR:
 				log_error("READ_ERROR\n");
@@ -687,5 +1086,332 @@ next_state: 	switch (state_jump_table[s->state](s))
 				return MJV_GRABBER_CORRUPT_HEADER;
 		}
 	}
+}
+
+static size_t
+read_hint (const struct mjv_grabber *s, size_t *minsize)
+{
+	size_t space = streambuf_space(s->sb, keepfrom(s), s->head);
+	size_t remaining;
+
+	*minsize = 0;
+	if (s->state != STATE_IMAGE_BY_CONTENT_LENGTH) {
+		return space;
+	}
+	// The size of the image is known, and room was reserved for it;
+	// read the rest of it in one go, plus a little for the next part:
+	remaining = s->content_length - (s->head - s->anchor);
+	if (remaining + READ_TRAILER < space) {
+		space = remaining + READ_TRAILER;
+	}
+	*minsize = (remaining < space) ? remaining : space;
+	return space;
+}
+
+void *
+mjv_grabber_write_ptr (struct mjv_grabber *s, size_t *space)
+{
+	size_t minsize;
+
+	*space = read_hint(s, &minsize);
+	return s->head;
+}
+
+enum mjv_grabber_status
+mjv_grabber_commit (struct mjv_grabber *s, size_t nbytes)
+{
+	enum mjv_grabber_status status;
+
+	// The states expect at least one new byte:
+	if (nbytes == 0) {
+		return MJV_GRABBER_SUCCESS;
+	}
+	// Head is always ONE PAST the real last char:
+	s->head += nbytes;
+
+	log_debug("Got %zu bytes\n", nbytes);
+	status = dispatch(s);
+
+	// Hand all frames found in this pass to the batch callback:
+	flush_batch(s);
+	return status;
+}
+
+enum mjv_grabber_status
+mjv_grabber_feed (struct mjv_grabber *s, const void *buf, size_t len)
+{
+	enum mjv_grabber_status status;
+	const char *c = buf;
+
+	// Copy the bytes into the read buffer, as much as fits at a time:
+	while (len > 0) {
+		size_t space;
+		void *dst = mjv_grabber_write_ptr(s, &space);
+		size_t n = (len < space) ? len : space;
+
+		if (n == 0) {
+			return MJV_GRABBER_CORRUPT_HEADER;
+		}
+		memcpy(dst, c, n);
+		if ((status = mjv_grabber_commit(s, n)) != MJV_GRABBER_SUCCESS) {
+			return status;
+		}
+		c += n;
+		len -= n;
+	}
+	return MJV_GRABBER_SUCCESS;
+}
+
+static bool
+use_map (struct mjv_grabber *s, struct slab *map)
+{
+	struct streambuf *sb;
+
+	// Check that we parse the given file mapping, if any,
+	// or else our own read buffer:
+	if (map == streambuf_get_slab(s->sb)) {
+		return true;
+	}
+	if (map == NULL && streambuf_get_type(s->sb) != STREAMBUF_MAPPED) {
+		return true;
+	}
+	if (map != NULL) {
+		if ((sb = streambuf_create_mapped(map)) == NULL) {
+			log_error("Could not wrap file mapping\n");
+			return false;
+		}
+		// Set the read buffer aside, or drop the previous mapping:
+		if (s->spare == NULL) {
+			s->spare = s->sb;
+		}
+		else {
+			streambuf_destroy(&s->sb);
+		}
+		s->sb = sb;
+	}
+	else {
+		streambuf_destroy(&s->sb);
+		s->sb = s->spare;
+		s->spare = NULL;
+	}
+	// Start parsing at the start of the new buffer:
+	s->anchor = NULL;
+	s->cur = s->head = streambuf_base(s->sb);
+	return true;
+}
+
+static bool
+follow_map (struct mjv_grabber *s)
+{
+	struct slab *map = source_get_map(s->source);
+
+	// Parse the file mapping that the source currently has open, if any:
+	return use_map(s, map);
+}
+
+static enum mjv_grabber_status
+commit_mapped (struct mjv_grabber *s)
+{
+	// The whole file is in memory already. Rather than reading,
+	// move the head along over the next chunk of the mapping:
+	size_t left = streambuf_base(s->sb) + streambuf_size(s->sb) - s->head;
+
+	if (left == 0) {
+		log_info("End of file\n");
+		return MJV_GRABBER_PREMATURE_EOF;
+	}
+	return mjv_grabber_commit(s, (left < MAP_CHUNK) ? left : MAP_CHUNK);
+}
+
+enum mjv_grabber_status
+mjv_grabber_read (struct mjv_grabber *s)
+{
+	ssize_t nread;
+	size_t space;
+	void *buf;
+
+	if (s->source == NULL || !follow_map(s)) {
+		return MJV_GRABBER_READ_ERROR;
+	}
+	if (streambuf_get_type(s->sb) == STREAMBUF_MAPPED) {
+		return commit_mapped(s);
+	}
+	buf = mjv_grabber_write_ptr(s, &space);
+
+	// Read whatever is available without blocking:
+	if ((nread = source_read_nowait(s->source, buf, space)) < 0) {
+		return (errno == EAGAIN || errno == EWOULDBLOCK)
+			? MJV_GRABBER_AGAIN
+			: MJV_GRABBER_READ_ERROR;
+	}
+	if (nread == 0) {
+		log_info("End of file\n");
+		return MJV_GRABBER_PREMATURE_EOF;
+	}
+	return mjv_grabber_commit(s, nread);
+}
+
+enum mjv_grabber_status
+mjv_grabber_parse_range (struct mjv_grabber *s, struct slab *map, size_t from, size_t to, size_t *stop)
+{
+	enum mjv_grabber_status status;
+	char *base;
+	char *end;
+
+	if (!use_map(s, map)) {
+		return MJV_GRABBER_READ_ERROR;
+	}
+	base = streambuf_base(s->sb);
+	end = base + streambuf_size(s->sb);
+
+	// Without a boundary, start with the HTTP header at the top of
+	// the file. Else search for the first boundary in the range:
+	s->state = (s->boundary == NULL) ? STATE_HTTP_BANNER : STATE_FIND_BOUNDARY;
+	s->content_length = 0;
+	s->anchor = NULL;
+	s->cur = s->head = base + from;
+	s->limit = base + to;
+
+	// Parse until the first boundary at or past the limit,
+	// which clears the limit, or till the end of the file:
+	while (s->limit != NULL && s->head < end) {
+		size_t left = end - s->head;
+
+		if ((status = mjv_grabber_commit(s, (left < MAP_CHUNK) ? left : MAP_CHUNK)) != MJV_GRABBER_SUCCESS) {
+			s->limit = NULL;
+			return status;
+		}
+	}
+	*stop = (s->limit == NULL) ? (size_t)(s->cur - base) : (size_t)(end - base);
+	s->limit = NULL;
+	return MJV_GRABBER_SUCCESS;
+}
+
+bool
+mjv_grabber_copy_boundary (struct mjv_grabber *dst, const struct mjv_grabber *src)
+{
+	struct boundary *b;
+
+	if (src->boundary == NULL) {
+		return false;
+	}
+	if ((b = boundary_create(boundary_get_string(src->boundary), boundary_get_len(src->boundary))) == NULL) {
+		return false;
+	}
+	boundary_destroy(&dst->boundary);
+	dst->boundary = b;
+	return true;
+}
+
+struct frame *
+mjv_grabber_next_frame (struct mjv_grabber *s)
+{
+	struct frame *frame;
+
+	if (s->queue_head == s->queue_len) {
+		return NULL;
+	}
+	frame = s->queue[s->queue_head++];
+
+	// Rewind the queue when it runs empty:
+	if (s->queue_head == s->queue_len) {
+		s->queue_head = s->queue_len = 0;
+	}
+	return frame;
+}
+
+int
+mjv_grabber_get_fd (const struct mjv_grabber *s)
+{
+	return (s->source == NULL) ? -1 : s->source->fd;
+}
+
+void
+mjv_grabber_reset (struct mjv_grabber *s)
+{
+	// Drop whatever is left of the old stream, but keep the buffer, its
+	// size estimate and any frames still queued. In a slab that frames
+	// still refer to, the new stream just continues after the old bytes:
+	s->anchor = NULL;
+	s->cur = s->head;
+	rebase_pointers(s, streambuf_compact(s->sb, s->head, s->head));
+
+	boundary_destroy(&s->boundary);
+	s->state = STATE_HTTP_BANNER;
+	s->response_code = 0;
+	s->content_length = 0;
+	s->has_capture = false;
+	s->seg_pos = 0;
+	s->seg_entropy = false;
+
+	// The reopened stream starts its own schedule:
+	if (s->pacer != NULL) {
+		pacer_reset(s->pacer);
+	}
+}
+
+static bool
+setup_pacer (struct mjv_grabber *s)
+{
+	unsigned int interval_usec;
+	bool original_timing;
+	double speed;
+
+	// Pace the frames if the source asks for it. Only done here,
+	// where the caller lets us block:
+	if (!source_get_pace(s->source, &interval_usec, &original_timing, &speed)) {
+		pacer_destroy(&s->pacer);
+		return true;
+	}
+	if (s->pacer == NULL && (s->pacer = pacer_create(interval_usec, original_timing, speed)) == NULL) {
+		log_error("Could not create pacer\n");
+		return false;
+	}
+	return true;
+}
+
+enum mjv_grabber_status
+mjv_grabber_run (struct mjv_grabber *s)
+{
+	enum mjv_grabber_status status;
+	ssize_t nread;
+	size_t space;
+	size_t minsize;
+
+	if (s->source == NULL || (s->callback == NULL && s->batch_callback == NULL)) {
+		log_error("No source or no callback defined\n");
+		return MJV_GRABBER_READ_ERROR;
+	}
+	if (!setup_pacer(s)) {
+		return MJV_GRABBER_READ_ERROR;
+	}
+	for (;;)
+	{
+		if (!follow_map(s)) {
+			return MJV_GRABBER_READ_ERROR;
+		}
+		if (streambuf_get_type(s->sb) == STREAMBUF_MAPPED) {
+			if ((status = commit_mapped(s)) != MJV_GRABBER_SUCCESS) {
+				return status;
+			}
+			continue;
+		}
+		space = read_hint(s, &minsize);
+		nread = (minsize > 0)
+			? source_read_min(s->source, s->head, space, minsize)
+			: source_read(s->source, s->head, space);
+
+		if (nread < 0) {
+			return MJV_GRABBER_READ_ERROR;
+		}
+		else if (nread == 0) {
+			log_info("End of file\n");
+			return MJV_GRABBER_PREMATURE_EOF;
+		}
+		// Frames are passed to the callback from within:
+		if ((status = mjv_grabber_commit(s, nread)) != MJV_GRABBER_SUCCESS) {
+			return status;
+		}
+	}
 	return MJV_GRABBER_SUCCESS;
 }
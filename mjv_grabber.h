@@ -2,6 +2,15 @@
 #define MJV_GRABBER_H
 
 struct mjv_grabber;
+struct slab;
+
+// The read buffer grows up to a source's maximum frame size plus this
+// much, for headers and the start of the next part:
+#define MJV_GRABBER_BUF_HEADROOM	65536
+
+// Number of trailing bytes after the EOI marker that are tolerated in a
+// frame, for cameras that count a line terminator in their Content-Length:
+#define MJV_GRABBER_EOI_SLACK	4
 
 // Return codes for mjv_grabber_run:
 enum mjv_grabber_status
@@ -10,14 +19,82 @@ enum mjv_grabber_status
 , MJV_GRABBER_READ_ERROR
 , MJV_GRABBER_PREMATURE_EOF
 , MJV_GRABBER_CORRUPT_HEADER
+, MJV_GRABBER_AGAIN		// no data available yet, try again later
+};
+
+// Frame counters, for diagnostics:
+struct mjv_grabber_stats {
+	unsigned long frames;		// frames delivered to the caller
+	unsigned long bad_start;	// frames dropped for lacking a start marker
+	unsigned long bad_end;		// frames dropped for lacking an end marker
+	unsigned long bad_segment;	// frames dropped for malformed JPEG segments
+	unsigned long oversize;		// frames dropped for exceeding the buffer ceiling
 };
 
 struct mjv_grabber *mjv_grabber_create();
 void mjv_grabber_destroy (struct mjv_grabber**);
 
+// Start over with a fresh stream from the same source, after reopening
+// it. Keeps the read buffer:
+void mjv_grabber_reset (struct mjv_grabber *);
+
 // The main function. This grabs frames from the source and relays them
-// to a callback function:
+// to a callback function. When the source has mapped its file into
+// memory, frames are parsed from the mapping in place and refer to it,
+// without any reads or copies. When the source asks for a pace, frames
+// are held back till they are due:
 enum mjv_grabber_status mjv_grabber_run (struct mjv_grabber*);
+
+// Incremental interface. The grabber is a state machine that parses the
+// bytes it is given and does not block. Bytes can be put straight into
+// the read buffer at mjv_grabber_write_ptr(), then handed over with
+// mjv_grabber_commit(), or be copied in with mjv_grabber_feed().
+// mjv_grabber_read() does one nonblocking read from the source, and is
+// meant to be called when the descriptor from mjv_grabber_get_fd() is
+// readable. If no callback is set, parsed frames are queued, and can be
+// picked up with mjv_grabber_next_frame(); the caller owns them. The
+// source may be NULL when only feeding bytes:
+void *mjv_grabber_write_ptr (struct mjv_grabber *, size_t *space);
+enum mjv_grabber_status mjv_grabber_commit (struct mjv_grabber *, size_t nbytes);
+enum mjv_grabber_status mjv_grabber_feed (struct mjv_grabber *, const void *buf, size_t len);
+enum mjv_grabber_status mjv_grabber_read (struct mjv_grabber *);
+struct frame *mjv_grabber_next_frame (struct mjv_grabber *);
+int mjv_grabber_get_fd (const struct mjv_grabber *);
+
+// Parse part of a file mapping, so that a large file can be split up
+// among several grabbers. Starts with the first boundary at or past
+// 'from', and stops at the first boundary at or past 'to', whose offset
+// is returned in 'stop'. A grabber without a boundary starts with the
+// HTTP header, so 'from' must then be zero; passing a 'to' of zero just
+// reads the header. Other grabbers can then be given its boundary:
+enum mjv_grabber_status mjv_grabber_parse_range (struct mjv_grabber *, struct slab *map, size_t from, size_t to, size_t *stop);
+bool mjv_grabber_copy_boundary (struct mjv_grabber *dst, const struct mjv_grabber *src);
+
 void mjv_grabber_set_callback (struct mjv_grabber *s, void (*got_frame_callback)(struct frame*, void*), void*);
 
+// Like the above, but delivers all frames found in one read at once; or
+// in two goes, if the read buffer must grow halfway. The callback owns
+// the frames, but not the array, which is only valid during the call.
+// Replaces any per-frame callback, and vice versa:
+void mjv_grabber_set_batch_callback (struct mjv_grabber *s, void (*got_frames_callback)(struct frame**, unsigned int, void*), void*);
+
+// How frames hold on to their bytes. Shared frames refer to the read
+// buffer in place, and keep that part of it alive for as long as they
+// live; this is the default, for callers that keep frames around. Copied
+// frames get their own copy of the bytes. Borrowed frames also refer to
+// the read buffer in place, but are only valid during the callback, so
+// the caller must be done with them when it returns; the read buffer
+// then never needs to copy or move its contents. Borrowed frames need a
+// callback, and can not be queued for mjv_grabber_next_frame(). Copied
+// and borrowed frames use a mirrored read buffer. Can only be set before
+// the first read:
+enum mjv_grabber_frames
+{ MJV_GRABBER_FRAMES_SHARED
+, MJV_GRABBER_FRAMES_COPIED
+, MJV_GRABBER_FRAMES_BORROWED
+};
+
+bool mjv_grabber_set_frames (struct mjv_grabber *, enum mjv_grabber_frames);
+void mjv_grabber_get_stats (const struct mjv_grabber *, struct mjv_grabber_stats *);
+
 #endif	// MJV_GRABBER_H
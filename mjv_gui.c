@@ -68,6 +68,13 @@ mjv_gui_main (int argc, char **argv, struct mjv_config *config)
 	}
 	gtk_container_add(GTK_CONTAINER(vbox), hbox);
 
+	// Start with room for each source at 640x480, plus toolbar and status
+	// bar, as far as the screen allows. Frames are decoded at the size
+	// that the sources get:
+	gtk_window_set_default_size(GTK_WINDOW(win),
+		MIN(640 * g_list_length(thread_list), (guint)gdk_screen_width()),
+		MIN(480 + 80, gdk_screen_height()));
+
 	gtk_container_add(GTK_CONTAINER(win), vbox);
 	gtk_signal_connect(GTK_OBJECT(win), "destroy", G_CALLBACK(on_destroy), NULL);
 	gtk_widget_show_all(win);
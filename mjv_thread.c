@@ -3,16 +3,20 @@
 #include <string.h>
 #include <unistd.h>
 #include <pthread.h>
+#include <poll.h>
 #include <time.h>
+#include <sys/socket.h>
 #include <glib.h>
 #include <gtk/gtk.h>
 
 #include "frame.h"
 #include "framebuf.h"
 #include "framerate.h"
+#include "pixpool.h"
 #include "source.h"
 #include "mjv_grabber.h"
 #include "mjv_thread.h"
+#include "backoff.h"
 #include "selfpipe.h"
 #include "spinner.h"
 
@@ -26,6 +30,7 @@ struct toolbar {
 	GtkWidget *toolbar;
 	GtkToolItem *btn_record;
 	GtkToolItem *btn_connect;
+	GtkToolItem *btn_fast;
 };
 
 struct statusbar {
@@ -37,13 +42,18 @@ struct statusbar {
 struct mjv_thread {
 	cairo_t   *cairo;
 	GMutex    mutex;
-	GdkPixbuf *pixbuf;
+	cairo_surface_t *surface;
+	struct pixpool *pixpool;
+	struct frame_decoder *decoder;
 	GtkWidget *frame;
 	GtkWidget *canvas;
 	int selfpipe_readfd;
 	int selfpipe_writefd;
 	unsigned int width;
 	unsigned int height;
+	unsigned int view_width;	// size of the canvas, to decode for;
+	unsigned int view_height;
+	bool fast_decode;
 	unsigned int blinker;
 	struct spinner *spinner;
 	struct source *source;
@@ -57,6 +67,10 @@ struct mjv_thread {
 	GMutex framerate_mutex;
 	pthread_t framerate_pthread;
 
+	// Held while opening or closing the source,
+	// so that its descriptor stays valid:
+	GMutex source_mutex;
+
 	pthread_t      pthread;
 	pthread_attr_t pthread_attr;
 };
@@ -64,8 +78,15 @@ struct mjv_thread {
 #define BLINKER_ALPHA	0.3
 #define BLINKER_HEIGHT	8
 
+// The canvas takes its share of the window, but no less than this:
+#define CANVAS_MIN_WIDTH	160
+#define CANVAS_MIN_HEIGHT	120
+
+// Reconnect when the framerate has been stalled this many seconds:
+#define STALL_SECONDS	10
+
 static void *thread_main (void *);
-static void callback_got_frame (struct frame *, void *);
+static void callback_got_frames (struct frame **, unsigned int, void *);
 static void draw_blinker (cairo_t *, int, int, int);
 
 static void framerate_thread_run (struct mjv_thread *);
@@ -112,14 +133,25 @@ canvas_repaint (GtkWidget *widget, GdkEventExpose *event, gpointer user_data)
 	g_mutex_lock(&t->mutex);
 	t->cairo = gdk_cairo_create(widget->window);
 
-	if (t->pixbuf == NULL) {
-		cairo_set_source_rgb(t->cairo, 0.1, 0.1, 0.1);
-	}
-	else {
-		gdk_cairo_set_source_pixbuf(t->cairo, t->pixbuf, 0, 0);
-	}
+	cairo_set_source_rgb(t->cairo, 0.1, 0.1, 0.1);
 	cairo_paint(t->cairo);
 
+	// The frame was decoded at about the size of the canvas;
+	// shrink it the rest of the way to fit:
+	if (t->surface != NULL) {
+		double sx = (double)widget->allocation.width / cairo_image_surface_get_width(t->surface);
+		double sy = (double)widget->allocation.height / cairo_image_surface_get_height(t->surface);
+		double scale = (sx < sy) ? sx : sy;
+
+		cairo_save(t->cairo);
+		if (scale < 1.0) {
+			cairo_scale(t->cairo, scale, scale);
+		}
+		cairo_set_source_surface(t->cairo, t->surface, 0, 0);
+		cairo_paint(t->cairo);
+		cairo_restore(t->cairo);
+	}
+
 	if ((source_name = source_get_name(t->source)) != NULL) {
 		print_source_name(t->cairo, source_name);
 	}
@@ -127,28 +159,59 @@ canvas_repaint (GtkWidget *widget, GdkEventExpose *event, gpointer user_data)
 		spinner_repaint(t->spinner, t->cairo, widget->allocation.width / 2, widget->allocation.height / 2);
 	}
 	else if (t->state == STATE_CONNECTED) {
-		draw_blinker(t->cairo, 4, t->height - 4 - BLINKER_HEIGHT, t->blinker);
+		draw_blinker(t->cairo, 4, widget->allocation.height - 4 - BLINKER_HEIGHT, t->blinker);
 	}
 	cairo_destroy(t->cairo);
 	g_mutex_unlock(&t->mutex);
 	return TRUE;
 }
 
+static void
+canvas_resize (GtkWidget *widget, GtkAllocation *allocation, gpointer user_data)
+{
+	struct mjv_thread *t = (struct mjv_thread *)(user_data);
+	(void)widget;
+
+	// Called from gtk_main(); the grabber thread picks
+	// up the new size when it decodes the next frame:
+	g_mutex_lock(&t->mutex);
+	t->view_width = allocation->width;
+	t->view_height = allocation->height;
+	g_mutex_unlock(&t->mutex);
+}
+
+static void
+on_fast_toggled (GtkToggleToolButton *button, gpointer user_data)
+{
+	struct mjv_thread *t = (struct mjv_thread *)(user_data);
+
+	// The grabber thread switches profiles from the next frame:
+	g_mutex_lock(&t->mutex);
+	t->fast_decode = gtk_toggle_tool_button_get_active(button);
+	g_mutex_unlock(&t->mutex);
+}
+
 static void
 create_frame_toolbar (struct mjv_thread *thread)
 {
 	GtkWidget *toolbar = gtk_toolbar_new();
 	GtkToolItem *btn_record = gtk_toggle_tool_button_new_from_stock(GTK_STOCK_MEDIA_RECORD);
 	GtkToolItem *btn_connect = gtk_tool_button_new_from_stock(GTK_STOCK_CONNECT);
+	GtkToolItem *btn_fast = gtk_toggle_tool_button_new();
 	gtk_tool_button_set_label(GTK_TOOL_BUTTON(btn_record), "Record");
 	gtk_tool_button_set_label(GTK_TOOL_BUTTON(btn_connect), "Connect");
+	gtk_tool_button_set_label(GTK_TOOL_BUTTON(btn_fast), "Fast");
+	gtk_toggle_tool_button_set_active(GTK_TOGGLE_TOOL_BUTTON(btn_fast), thread->fast_decode);
+	g_signal_connect(G_OBJECT(btn_fast), "toggled", G_CALLBACK(on_fast_toggled), thread);
 	gtk_toolbar_insert(GTK_TOOLBAR(toolbar), btn_connect, -1);
 	gtk_toolbar_insert(GTK_TOOLBAR(toolbar), btn_record, -1);
+	gtk_toolbar_insert(GTK_TOOLBAR(toolbar), btn_fast, -1);
 
 	// Save these to thread object:
 	thread->toolbar.toolbar = toolbar;
 	thread->toolbar.btn_record = btn_record;
 	thread->toolbar.btn_connect = btn_connect;
+	thread->toolbar.btn_fast = btn_fast;
 }
 
 static GtkWidget *
@@ -180,7 +243,7 @@ create_frame (struct mjv_thread *thread)
 	GtkWidget *statusbar = create_frame_statusbar(thread);
 
 	gtk_box_pack_start(GTK_BOX(vbox), thread->toolbar.toolbar, FALSE, FALSE, 0);
-	gtk_box_pack_start(GTK_BOX(vbox), thread->canvas, FALSE, FALSE, 0);
+	gtk_box_pack_start(GTK_BOX(vbox), thread->canvas, TRUE, TRUE, 0);
 	gtk_box_pack_start(GTK_BOX(vbox), statusbar, FALSE, FALSE, 0);
 
 	gtk_container_add(GTK_CONTAINER(thread->frame), vbox);
@@ -203,10 +266,20 @@ mjv_thread_create (struct source *source)
 	if ((t->framebuf = framebuf_create(50)) == NULL) {
 		goto err_2;
 	}
+	// The pixels of decoded frames are recycled through this pool:
+	if ((t->pixpool = pixpool_create()) == NULL) {
+		goto err_3;
+	}
+	// Only ever used from the grabber thread, one frame at a time;
+	// decodes to pixels that Cairo can paint without converting:
+	if ((t->decoder = frame_decoder_create()) == NULL) {
+		goto err_4;
+	}
+	frame_decoder_set_format(t->decoder, FRAME_FORMAT_XRGB32);
 	// Open a pipe pair to use in the self-pipe trick. When we write
 	// a byte to the pipe, the grabber knows to quit gracefully:
 	if (selfpipe_pair(&t->selfpipe_readfd, &t->selfpipe_writefd) == false) {
-		goto err_3;
+		goto err_5;
 	}
 	source_set_selfpipe(source, t->selfpipe_readfd);
 
@@ -217,18 +290,23 @@ mjv_thread_create (struct source *source)
 	t->canvas  = gtk_drawing_area_new();
 	t->state   = STATE_DISCONNECTED;
 	t->spinner = NULL;
+	t->fast_decode = source_get_fast_decode(source);
 
 	g_mutex_init(&t->mutex);
 	g_mutex_init(&t->framerate_mutex);
+	g_mutex_init(&t->source_mutex);
 
 	pthread_attr_init(&t->pthread_attr);
 	pthread_attr_setdetachstate(&t->pthread_attr, PTHREAD_CREATE_JOINABLE);
 
-	gtk_widget_set_size_request(t->canvas, t->width, t->height);
+	gtk_widget_set_size_request(t->canvas, CANVAS_MIN_WIDTH, CANVAS_MIN_HEIGHT);
 	gtk_signal_connect(GTK_OBJECT(t->canvas), "expose_event", GTK_SIGNAL_FUNC(canvas_repaint), t);
+	gtk_signal_connect(GTK_OBJECT(t->canvas), "size-allocate", GTK_SIGNAL_FUNC(canvas_resize), t);
 
 	return t;
 
+err_5:	frame_decoder_destroy(&t->decoder);
+err_4:	pixpool_destroy(&t->pixpool);
 err_3:	framebuf_destroy(&t->framebuf);
 err_2:	framerate_destroy(&t->framerate);
 err_1:	free(t);
@@ -243,13 +321,16 @@ mjv_thread_destroy (struct mjv_thread *t)
 	spinner_destroy(&t->spinner);
 	g_mutex_clear(&t->mutex);
 	g_mutex_clear(&t->framerate_mutex);
+	g_mutex_clear(&t->source_mutex);
 	pthread_attr_destroy(&t->pthread_attr);
 	mjv_grabber_destroy(&t->grabber);
 	framebuf_destroy(&t->framebuf);
 	framerate_destroy(&t->framerate);
-	if (t->pixbuf != NULL) {
-		g_object_unref(t->pixbuf);
+	if (t->surface != NULL) {
+		cairo_surface_destroy(t->surface);
 	}
+	pixpool_destroy(&t->pixpool);
+	frame_decoder_destroy(&t->decoder);
 	selfpipe_write_close(&t->selfpipe_writefd);
 	selfpipe_read_close(&t->selfpipe_readfd);
 	free(t);
@@ -335,49 +416,117 @@ update_state (struct mjv_thread *thread, enum state state)
 	gdk_threads_leave();
 }
 
-static void *
-thread_main (void *user_data)
+static bool
+wait_for_cancel (struct mjv_thread *t, unsigned int msec)
 {
-	struct mjv_thread *t = (struct mjv_thread *)user_data;
+	struct pollfd pfd;
+
+	// The self-pipe becomes readable when the thread is canceled:
+	pfd.fd = t->selfpipe_readfd;
+	pfd.events = POLLIN;
+	return (poll(&pfd, 1, msec) > 0);
+}
+
+static bool
+connect_source (struct mjv_thread *t)
+{
+	bool ret;
 
-	// Try to connect:
 	t->spinner = spinner_create(on_spinner_tick, t->canvas);
 	update_state(t, STATE_CONNECTING);
 
-	// Open source file descriptor:
-	if (t->source->open(t->source) == false) {
-		spinner_destroy(&t->spinner);
-		update_state(t, STATE_DISCONNECTED);
+	g_mutex_lock(&t->source_mutex);
+	ret = t->source->open(t->source);
+	g_mutex_unlock(&t->source_mutex);
+
+	spinner_destroy(&t->spinner);
+	update_state(t, (ret) ? STATE_CONNECTED : STATE_DISCONNECTED);
+	return ret;
+}
+
+static void
+disconnect_source (struct mjv_thread *t)
+{
+	g_mutex_lock(&t->source_mutex);
+	t->source->close(t->source);
+	g_mutex_unlock(&t->source_mutex);
+
+	update_state(t, STATE_DISCONNECTED);
+}
+
+static void *
+thread_main (void *user_data)
+{
+	struct mjv_thread *t = (struct mjv_thread *)user_data;
+	struct mjv_grabber_stats before, after;
+	struct backoff *backoff;
+
+	if ((backoff = backoff_create(BACKOFF_MIN, BACKOFF_MAX)) == NULL) {
 		return NULL;
 	}
 	if ((t->grabber = mjv_grabber_create(t->source)) == NULL) {
-		spinner_destroy(&t->spinner);
-		update_state(t, STATE_DISCONNECTED);
+		backoff_destroy(&backoff);
 		return NULL;
 	}
-	mjv_grabber_set_callback(t->grabber, &callback_got_frame, (void *)t);
+	mjv_grabber_set_batch_callback(t->grabber, &callback_got_frames, (void *)t);
 
-	// We are connected:
-	update_state(t, STATE_CONNECTED);
-	spinner_destroy(&t->spinner);
-	framerate_thread_run(t);
+	// Keep reconnecting till canceled:
+	do {
+		if (!connect_source(t)) {
+			continue;
+		}
+		framerate_thread_run(t);
 
-	// Stay in this function till it terminates;
-	// meanwhile we get frames back through callback_got_frame():
-	mjv_grabber_run(t->grabber);
+		// Stay here till the stream ends, stalls or is canceled;
+		// meanwhile we get frames back through callback_got_frames():
+		mjv_grabber_get_stats(t->grabber, &before);
+		mjv_grabber_run(t->grabber);
+		mjv_grabber_get_stats(t->grabber, &after);
 
-	// We are disconnected:
-	mjv_grabber_destroy(&t->grabber);
-	update_state(t, STATE_DISCONNECTED);
-	framerate_thread_kill(t);
+		framerate_thread_kill(t);
+		disconnect_source(t);
+
+		// Start over with the same buffers:
+		mjv_grabber_reset(t->grabber);
+
+		// If the connection worked for a while, the next
+		// outage starts with short delays again:
+		if (after.frames > before.frames) {
+			backoff_reset(backoff);
+		}
+	} while (!wait_for_cancel(t, backoff_next(backoff)));
+
+	backoff_destroy(&backoff);
 	return NULL;
 }
 
+// Key under which a surface keeps its pixels, to release them with it:
+static const cairo_user_data_key_t pixels_key;
+
 static void
-destroy_pixels (guchar *pixels, gpointer data)
+destroy_pixels (void *pixels)
 {
-	(void)data;
-	free(pixels);
+	// Back to the pool, for the next frame:
+	pixpool_put(pixels);
+}
+
+// Wrap the decoded pixels in a surface that Cairo can paint as is:
+static cairo_surface_t *
+create_surface (unsigned char *pixels, unsigned int width, unsigned int height, unsigned int row_stride)
+{
+	cairo_surface_t *surface = cairo_image_surface_create_for_data(pixels, CAIRO_FORMAT_RGB24, width, height, row_stride);
+
+	if (cairo_surface_status(surface) != CAIRO_STATUS_SUCCESS) {
+		cairo_surface_destroy(surface);
+		pixpool_put(pixels);
+		return NULL;
+	}
+	if (cairo_surface_set_user_data(surface, &pixels_key, pixels, destroy_pixels) != CAIRO_STATUS_SUCCESS) {
+		cairo_surface_destroy(surface);
+		pixpool_put(pixels);
+		return NULL;
+	}
+	return surface;
 }
 
 static void
@@ -392,63 +541,75 @@ update_framebuf_label (struct mjv_thread *thread)
 }
 
 static void
-callback_got_frame (struct frame *frame, void *user_data)
+callback_got_frames (struct frame **frames, unsigned int nframes, void *user_data)
 {
-	unsigned char *pixels;
+	unsigned char *pixels = NULL;
+	cairo_surface_t *surface = NULL;
+	struct frame *frame = NULL;
 	struct mjv_thread *thread = (struct mjv_thread *)(user_data);
 
-	g_assert(frame != NULL);
+	g_assert(frames != NULL);
 	g_assert(thread != NULL);
 
-	// Convert from JPEG to pixbuf:
-	if ((pixels = frame_to_pixbuf(frame)) == NULL) {
-		frame_destroy(&frame);
-		return;
-	}
-	unsigned int width = frame_get_width(frame);
-	unsigned int height = frame_get_height(frame);
-	unsigned int row_stride = frame_get_row_stride(frame);
+	// Decode at no more than the size of the canvas; a tile
+	// on a wall of cameras needs only a fraction of the pixels:
+	g_mutex_lock(&thread->mutex);
+	unsigned int view_width = thread->view_width;
+	unsigned int view_height = thread->view_height;
+	bool fast_decode = thread->fast_decode;
+	g_mutex_unlock(&thread->mutex);
 
+	frame_decoder_set_profile(thread->decoder, fast_decode ? FRAME_DECODE_FAST : FRAME_DECODE_QUALITY);
+
+	// Only the newest frame of a batch gets displayed, the others would
+	// be painted over before they are ever seen. If it does not decode,
+	// drop it and fall back to the one before. Convert from JPEG to
+	// pixels in Cairo's format, outside of the lock:
+	for (unsigned int i = nframes; i-- > 0; ) {
+		if ((pixels = frame_decode(thread->decoder, frames[i], thread->pixpool, view_width, view_height)) != NULL) {
+			frame = frames[i];
+			break;
+		}
+		frame_destroy(&frames[i]);
+	}
+	if (frame != NULL) {
+		surface = create_surface(pixels, frame_get_width(frame), frame_get_height(frame), frame_get_row_stride(frame));
+	}
 	gdk_threads_enter();
 	g_mutex_lock(&thread->mutex);
 
-	g_assert(width > 0);
-	g_assert(height > 0);
-	g_assert(row_stride > 0);
+	// Replace existing surface:
+	if (surface != NULL) {
+		g_assert(frame_get_width(frame) > 0);
+		g_assert(frame_get_height(frame) > 0);
 
-	thread->width  = width;
-	thread->height = height;
+		thread->width  = frame_get_width(frame);
+		thread->height = frame_get_height(frame);
 
-	if ((int)height != thread->canvas->allocation.height
-	 || (int)width != thread->canvas->allocation.width) {
-		gtk_widget_set_size_request(thread->canvas, width, height);
-	}
-	// Replace existing pixbuf:
-	if (thread->pixbuf != NULL) {
-		g_object_unref(thread->pixbuf);
+		if (thread->surface != NULL) {
+			cairo_surface_destroy(thread->surface);
+		}
+		thread->surface = surface;
+		thread->blinker = 1 - thread->blinker;
+		gtk_widget_queue_draw(thread->canvas);
 	}
-	thread->pixbuf = gdk_pixbuf_new_from_data(
-		pixels,			// data
-		GDK_COLORSPACE_RGB,	// colorspace
-		FALSE,			// has_alpha
-		8,			// bits_per_sample
-		width,			// width
-		height,			// height
-		row_stride,		// row stride in bytes
-		destroy_pixels,		// destroy function for pixel data
-		NULL			// user argument to the above
-	);
-	thread->blinker = 1 - thread->blinker;
-	gtk_widget_queue_draw(thread->canvas);
-
+	// Every frame still counts towards the framerate:
 	g_mutex_lock(&thread->framerate_mutex);
-	framerate_insert_datapoint(thread->framerate, frame_get_timestamp(frame));
+	for (unsigned int i = 0; i < nframes; i++) {
+		if (frames[i] != NULL) {
+			framerate_insert_datapoint(thread->framerate, frame_get_timestamp(frames[i]));
+		}
+	}
 	g_mutex_unlock(&thread->framerate_mutex);
 
 	g_mutex_unlock(&thread->mutex);
 	gdk_threads_leave();
 
-	framebuf_append(thread->framebuf, frame);
+	for (unsigned int i = 0; i < nframes; i++) {
+		if (frames[i] != NULL) {
+			framebuf_append(thread->framebuf, frames[i]);
+		}
+	}
 	update_framebuf_label(thread);
 }
 
@@ -495,6 +656,7 @@ framerate_thread_main (void *user_data)
 {
 	float fps;
 	char buf[20];
+	unsigned int stalled = 0;
 	struct mjv_thread *t = (struct mjv_thread *)user_data;
 
 	pthread_detach(pthread_self());
@@ -514,6 +676,16 @@ framerate_thread_main (void *user_data)
 		else {
 			strcpy(buf, "stalled");
 		}
+		// When stalled for too long, shut the connection down. The
+		// pending read then returns, and the thread reconnects:
+		stalled = (fps > 0.0) ? 0 : stalled + 1;
+		if (stalled == STALL_SECONDS) {
+			g_mutex_lock(&t->source_mutex);
+			if (t->source->fd >= 0) {
+				shutdown(t->source->fd, SHUT_RDWR);
+			}
+			g_mutex_unlock(&t->source_mutex);
+		}
 		// Change label:
 		gdk_threads_enter();
 		gtk_label_set_text(GTK_LABEL(t->statusbar.lbl_fps), buf);
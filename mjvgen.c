@@ -0,0 +1,126 @@
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <getopt.h>
+
+#include "mjv_log.c"
+#include "streamgen.h"
+
+// Writes a made-up MJPEG stream to a file, for use as test and benchmark
+// input. The same options and seed always give the same file, so that
+// results from different builds can be compared.
+
+static void
+usage (void)
+{
+	fprintf(stderr,
+		"Usage: mjvgen [options]\n"
+		"  -o, --output FILE      write to this file (stdout)\n"
+		"  -s, --seed N           seed for the random choices (1)\n"
+		"  -n, --frames N         number of frames (1000)\n"
+		"  -m, --min-size N       smallest image, in bytes (10240)\n"
+		"  -M, --max-size N       largest image, in bytes (204800)\n"
+		"  -b, --boundary-len N   length of the boundary, 1 to 70 (16)\n"
+		"  -L, --lf               end lines with LF instead of CRLF\n"
+		"  -c, --casing CASE      header casing: upper, lower or mixed (upper)\n"
+		"  -N, --no-length PCT    percentage of parts without Content-Length (0)\n"
+		"  -g, --garbage PCT      percentage of parts followed by junk (0)\n");
+}
+
+static bool
+parse_casing (const char *arg, enum streamgen_casing *casing)
+{
+	if (strcmp(arg, "upper") == 0) {
+		*casing = STREAMGEN_CASING_UPPER;
+		return true;
+	}
+	if (strcmp(arg, "lower") == 0) {
+		*casing = STREAMGEN_CASING_LOWER;
+		return true;
+	}
+	if (strcmp(arg, "mixed") == 0) {
+		*casing = STREAMGEN_CASING_MIXED;
+		return true;
+	}
+	log_error("Error: invalid casing '%s'\n", arg);
+	return false;
+}
+
+static bool
+process_cmdline (int argc, char **argv, struct streamgen_opts *opts, const char **output)
+{
+	int c;
+	int option_index = 0;
+	static struct option long_options[] = {
+		{ "boundary-len", 1, 0, 'b' },
+		{ "casing", 1, 0, 'c' },
+		{ "garbage", 1, 0, 'g' },
+		{ "help", 0, 0, 'h' },
+		{ "lf", 0, 0, 'L' },
+		{ "min-size", 1, 0, 'm' },
+		{ "max-size", 1, 0, 'M' },
+		{ "frames", 1, 0, 'n' },
+		{ "no-length", 1, 0, 'N' },
+		{ "output", 1, 0, 'o' },
+		{ "seed", 1, 0, 's' },
+		{ 0, 0, 0, 0 }
+	};
+	for (;;) {
+		if ((c = getopt_long(argc, argv, "b:c:g:hLm:M:n:N:o:s:", long_options, &option_index)) == -1) {
+			break;
+		}
+		switch (c)
+		{
+			case 'b': opts->boundary_len = atoi(optarg); break;
+			case 'g': opts->garbage_pct = atoi(optarg); break;
+			case 'L': opts->lf = true; break;
+			case 'm': opts->min_size = atoi(optarg); break;
+			case 'M': opts->max_size = atoi(optarg); break;
+			case 'n': opts->frames = atoi(optarg); break;
+			case 'N': opts->no_length_pct = atoi(optarg); break;
+			case 'o': *output = optarg; break;
+			case 's': opts->seed = strtoul(optarg, NULL, 0); break;
+			case 'c': if (parse_casing(optarg, &opts->casing)) break; return false;
+
+			case 'h':
+			default:
+				usage();
+				return false;
+		}
+	}
+	return true;
+}
+
+int
+main (int argc, char **argv)
+{
+	struct streamgen_opts opts;
+	const char *output = NULL;
+	FILE *fp = stdout;
+	size_t nbytes;
+	int ret = 0;
+
+	streamgen_defaults(&opts);
+
+	if (!process_cmdline(argc, argv, &opts, &output)) {
+		return 1;
+	}
+	if (output != NULL && (fp = fopen(output, "w")) == NULL) {
+		perror("fopen");
+		return 1;
+	}
+	if ((nbytes = streamgen_write(fp, &opts)) == 0) {
+		log_error("Error: could not write stream\n");
+		ret = 1;
+	}
+	// Not to stdout, which may hold the stream:
+	else if (fp != stdout) {
+		log_info("Wrote %u frames, %zu bytes\n", opts.frames, nbytes);
+	}
+	if (fp != stdout && fclose(fp) != 0) {
+		perror("fclose");
+		ret = 1;
+	}
+	return ret;
+}
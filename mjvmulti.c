@@ -5,8 +5,6 @@
 #include <string.h>
 #include <signal.h>
 #include <getopt.h>
-#include <sys/stat.h>
-#include <fcntl.h>
 #include <pthread.h>
 
 #include "mjv_config.h"
@@ -18,23 +16,30 @@
 #include "filename.h"
 #include "framerate.h"
 #include "mjv_grabber.h"
-#include "selfpipe.h"
+#include "evloop.h"
 
 // This is a really simple framegrabber for mjpeg streams. It is intended to
 // compile with the least possible dependencies, to make it useful on headless,
 // underpowered systems. It also keeps the rest of the modules "honest" in
 // terms of simple interfaces and modularity.
 
-struct thread {
+// Seconds of silence after which a source is dropped:
+#define SOURCE_TIMEOUT	10
+
+struct stream {
 	struct source *s;
 	struct mjv_grabber *g;
 	struct framerate *fr;
 	int n_frames;
-	int read_fd;
-	int write_fd;
 
+	struct stream *next;
+};
+
+// One event loop per core; each drives a share of the streams:
+struct loop {
+	struct evloop *ev;
 	pthread_t pthread;
-	struct thread *next;
+	bool running;
 };
 
 static int quit_flag = 0;
@@ -63,37 +68,21 @@ process_cmdline (int argc, char **argv, char **filename)
 }
 
 static void
-thread_destroy (struct thread **t)
+stream_destroy (struct stream **t)
 {
 	if (t == NULL || *t == NULL) {
 		return;
 	}
-	if ((*t)->read_fd >= 0) {
-		close((*t)->read_fd);
-	}
-	if ((*t)->write_fd >= 0) {
-		close((*t)->write_fd);
-	}
 	framerate_destroy(&(*t)->fr);
 	mjv_grabber_destroy(&(*t)->g);
-	selfpipe_read_close(&(*t)->read_fd);
 	free(*t);
 	*t = NULL;
 }
 
-static void
-thread_cancel (struct thread *t)
+static struct stream *
+stream_create (struct source *s)
 {
-	// Terminate a thread by sending a byte of data through the write end
-	// of the self-pipe. The grabber catches this and exits gracefully:
-	selfpipe_write_close(&t->write_fd);
-	pthread_join(t->pthread, NULL);
-}
-
-static struct thread *
-thread_create (struct source *s)
-{
-	struct thread *t;
+	struct stream *t;
 
 	if ((t = malloc(sizeof(*t))) == NULL) {
 		return NULL;
@@ -104,102 +93,42 @@ thread_create (struct source *s)
 	t->n_frames = 0;
 	t->s = s;
 
-	if (selfpipe_pair(&t->read_fd, &t->write_fd) == false) {
-		goto err;
-	}
 	if ((t->g = mjv_grabber_create(t->s)) == NULL) {
 		goto err;
 	}
-	source_set_selfpipe(s, t->read_fd);
-
 	if ((t->fr = framerate_create(15)) == NULL) {
 		goto err;
 	}
 	return t;
 
-err:	thread_destroy(&t);
+err:	stream_destroy(&t);
 	return NULL;
 }
 
-static void
-timestamp_file (const char *const filename, const struct timespec *const timestamp)
-{
-	struct timespec times[2];
-
-	times[0].tv_sec = timestamp->tv_sec;
-	times[0].tv_nsec = timestamp->tv_nsec;
-
-	times[1].tv_sec = timestamp->tv_sec;
-	times[1].tv_nsec = timestamp->tv_nsec;
-
-	utimensat(AT_FDCWD, filename, times, 0);
-}
-
-static void
-write_image_file (char *data, size_t nbytes, const char *const srcname, unsigned int framenum, const struct timespec *const timestamp)
-{
-	FILE *fp;
-	char *filename;
-
-	if (data == NULL || nbytes == 0) {
-		log_error("Error: frame contains no data\n");
-		return;
-	}
-	if (framenum >= 1000000000) {
-		log_error("Error: framenum too large (over 9 digits)\n");
-		return;
-	}
-	// TODO: let user specify the pattern:
-	if ((filename = filename_forge(srcname, framenum, "%n_%f.jpg")) == NULL) {
-		log_error("Error: could not forge filename\n");
-		return;
-	}
-	if ((fp = fopen(filename, "w")) == NULL) {
-		perror("fopen");
-	}
-	else {
-		log_debug("writing %s\n", filename);
-		fwrite(data, nbytes, 1, fp);
-		fclose(fp);
-		timestamp_file(filename, timestamp);
-	}
-	free(filename);
-}
-
 static void
 got_frame_callback (struct frame *f, void *data)
 {
-	struct thread *t = data;
+	struct stream *t = data;
 
 	t->n_frames++;
 
 	// Feed the framerate estimator, get estimate:
 	framerate_insert_datapoint(t->fr, frame_get_timestamp(f));
 
-	// Write to file:
-	write_image_file((char *)frame_get_rawbits(f), frame_get_num_rawbits(f), source_get_name(t->s), t->n_frames, frame_get_timestamp(f));
+	// Write to file. TODO: let user specify the pattern:
+	filename_write_image("%n_%f.jpg", source_get_name(t->s), t->n_frames, (char *)frame_get_rawbits(f), frame_get_num_rawbits(f), frame_get_timestamp(f));
 
 	// We are responsible for freeing the frame when we're done with it:
 	frame_destroy(&f);
 }
 
 static void *
-thread_main (void *data)
+loop_main (void *data)
 {
-	struct source *s = ((struct thread *)data)->s;
-	struct mjv_grabber *g = ((struct thread *)data)->g;
-
-	if (s->open(s) == false) {
-		log_error("Error: could not open config source\n");
-		goto exit;
-	}
-	// Grabbed frames will be handled by got_frame_callback():
-	mjv_grabber_set_callback(g, got_frame_callback, data);
-
-	// Run the grabber; control stays here until the stream or the thread terminates:
-	mjv_grabber_run(g);
-
-exit:	return NULL;
+	// Control stays here until all streams end or the loop is stopped;
+	// grabbed frames will be handled by got_frame_callback():
+	evloop_run(((struct loop *)data)->ev);
+	return NULL;
 }
 
 static void
@@ -226,6 +155,17 @@ sig_setup (void)
 	sigaction(SIGINT, &act, NULL);
 }
 
+static unsigned int
+num_loops (unsigned int n_streams)
+{
+	long n_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+	if (n_cpus < 1) {
+		n_cpus = 1;
+	}
+	return ((unsigned long)n_cpus < n_streams) ? (unsigned int)n_cpus : n_streams;
+}
+
 int
 main (int argc, char **argv)
 {
@@ -233,10 +173,13 @@ main (int argc, char **argv)
 	char *filename = NULL;
 	struct mjv_config *config = NULL;
 	struct source *source = NULL;
-	pthread_attr_t pthread_attr;
-	struct thread *first = NULL;
-	struct thread *t = NULL;
-	struct thread *c = NULL;
+	struct stream *first = NULL;
+	struct stream *t = NULL;
+	struct stream *c = NULL;
+	struct loop *loops = NULL;
+	unsigned int n_streams = 0;
+	unsigned int n_loops = 0;
+	unsigned int i;
 
 	process_cmdline(argc, argv, &filename);
 
@@ -251,7 +194,7 @@ main (int argc, char **argv)
 	}
 	// For each source, allocate a helper structure:
 	for (source = mjv_config_source_first(config); source; source = mjv_config_source_next(config)) {
-		if ((t = thread_create(source)) == NULL) {
+		if ((t = stream_create(source)) == NULL) {
 			// TODO: error!
 			break;
 		}
@@ -262,30 +205,60 @@ main (int argc, char **argv)
 			c->next = t;
 		}
 		c = t;
+		n_streams++;
 	}
-	pthread_attr_init(&pthread_attr);
-
-	// For each helper structure, kick off a thread:
-	for (t = first; t; t = t->next) {
-		if (pthread_create(&t->pthread, &pthread_attr, thread_main, t) != 0) {
+	if (n_streams == 0) {
+		goto exit;
+	}
+	// Create the event loops:
+	n_loops = num_loops(n_streams);
+	if ((loops = calloc(n_loops, sizeof(*loops))) == NULL) {
+		ret = 1;
+		goto exit;
+	}
+	for (i = 0; i < n_loops; i++) {
+		if ((loops[i].ev = evloop_create(SOURCE_TIMEOUT)) == NULL) {
+			ret = 1;
+			goto exit;
+		}
+	}
+	// Shard the streams across the loops:
+	for (i = 0, t = first; t; t = t->next, i++) {
+		if (!evloop_add(loops[i % n_loops].ev, t->s, t->g, got_frame_callback, t)) {
+			ret = 1;
+			goto exit;
+		}
+	}
+	// For each loop, kick off a thread:
+	for (i = 0; i < n_loops; i++) {
+		if (pthread_create(&loops[i].pthread, NULL, loop_main, &loops[i]) != 0) {
 			// TODO: error!
 			break;
 		}
+		loops[i].running = true;
 	}
-	// Wait for threads to terminate, or for user to interrupt:
+	// Wait for the user to interrupt:
 	sig_setup();
 	while (!quit_flag) {
 		sleep(60);
 	}
-	// Ask the threads to terminate:
-	for (t = first; t; t = t->next) {
-		thread_cancel(t);
+	// Ask the loops to terminate:
+	for (i = 0; i < n_loops; i++) {
+		if (loops[i].running) {
+			evloop_stop(loops[i].ev);
+			pthread_join(loops[i].pthread, NULL);
+		}
 	}
 
-	pthread_attr_destroy(&pthread_attr);
-exit:	for (t = first; t; t = c) {
+exit:	if (loops) {
+		for (i = 0; i < n_loops; i++) {
+			evloop_destroy(&loops[i].ev);
+		}
+		free(loops);
+	}
+	for (t = first; t; t = c) {
 		c = t->next;
-		thread_destroy(&t);
+		stream_destroy(&t);
 	}
 	if (config) {
 		mjv_config_destroy(&config);
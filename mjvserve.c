@@ -0,0 +1,905 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <errno.h>
+#include <getopt.h>
+#include <signal.h>
+#include <time.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/timerfd.h>
+#include <jpeglib.h>
+
+#include "mjv_log.c"
+#include "frame.h"
+#include "source.h"
+#include "source_file.h"
+#include "mjv_grabber.h"
+#include "selfpipe.h"
+
+// A fake camera, for load and latency testing without a network. Serves
+// an MJPEG stream over HTTP to any number of clients at once, from a single
+// thread. The frames come from a recorded stream, or are made up. The shape
+// of the stream can be tuned, and the camera can be made to misbehave by
+// sending frames late or hanging up on its clients.
+
+#define NSEC_PER_SEC	1000000000LL
+#define MAX_EVENTS	64
+#define MAX_REQUEST	4096
+#define STATUS_SEC	5
+
+// Number of made-up frames, shown in a loop:
+#define SYNTHETIC_FRAMES	25
+
+struct cmdopts {
+	char *address;
+	int port;
+	char *filename;
+	unsigned int width;
+	unsigned int height;
+	int quality;
+	double fps;
+	char *boundary;
+	bool lf;
+	bool no_length;
+	bool timestamp;
+	unsigned int jitter_msec;
+	unsigned int disconnect;
+	unsigned int max_clients;
+};
+
+struct image {
+	unsigned char *data;
+	size_t len;
+};
+
+// A piece of the stream, shared by all clients it goes out to:
+struct part {
+	unsigned int refs;
+	size_t len;
+	char data[];
+};
+
+enum client_state
+{ CLIENT_REQUEST
+, CLIENT_STREAMING
+};
+
+struct client {
+	int fd;
+	enum client_state state;
+	unsigned int request_len;
+	unsigned int newlines;		// consecutive newlines in the request;
+	bool want_out;			// waiting for the socket to drain;
+	bool dead;			// to be closed after this round of events;
+	struct part *part;		// being sent;
+	size_t sent;			// bytes of it that went out;
+	unsigned long frames;
+	struct client *prev;
+	struct client *next;
+};
+
+struct server {
+	const struct cmdopts *opts;
+	int epfd;
+	int listenfd;
+	int timerfd;
+
+	struct image *images;
+	unsigned int n_images;
+	unsigned int cur_image;
+
+	struct part *header;
+	struct client *clients;
+	unsigned int n_clients;
+
+	// The frame clock:
+	long long interval;
+	long long start;
+	unsigned long long tick;
+	long long next_status;
+
+	// Counters:
+	unsigned long accepted;
+	unsigned long refused;
+	unsigned long frames_sent;
+	unsigned long frames_skipped;
+	unsigned long disconnects;
+};
+
+// Markers for the descriptors in the epoll set that are not clients:
+static int watch_listen;
+static int watch_timer;
+static int watch_quit;
+
+static int read_fd = -1, write_fd = -1;
+
+static bool
+copy_string (const char *const src, char **const dst)
+{
+	size_t len = strlen(src) + 1;
+
+	free(*dst);
+	if ((*dst = malloc(len)) == NULL) {
+		log_error("Error: out of memory\n");
+		return false;
+	}
+	memcpy(*dst, src, len);
+	return true;
+}
+
+static void
+usage (void)
+{
+	fprintf(stderr,
+		"Usage: mjvserve [options]\n"
+		"  -a, --address ADDR     listen on this IPv4 address (127.0.0.1)\n"
+		"  -q, --port PORT        listen on this port (8080)\n"
+		"  -f, --filename FILE    serve the frames from a recorded stream\n"
+		"  -s, --size WxH         size of the made-up frames (640x480)\n"
+		"  -Q, --quality N        JPEG quality of the made-up frames (85)\n"
+		"  -r, --fps N            frames per second (25)\n"
+		"  -b, --boundary STR     multipart boundary (mjvserve)\n"
+		"  -L, --lf               end lines with LF instead of CRLF\n"
+		"  -N, --no-length        leave out the Content-Length header\n"
+		"  -T, --timestamp        add an X-Timestamp header to each frame\n"
+		"  -J, --jitter MSEC      send each frame up to MSEC late\n"
+		"  -D, --disconnect N     hang up on each client after N frames\n"
+		"  -c, --max-clients N    refuse clients beyond N (1000)\n"
+		"  -d, --debug            print debug messages\n");
+}
+
+static bool
+process_cmdline (int argc, char **argv, struct cmdopts *opts)
+{
+	int c;
+	int option_index = 0;
+	static struct option long_options[] = {
+		{ "address", 1, 0, 'a' },
+		{ "boundary", 1, 0, 'b' },
+		{ "max-clients", 1, 0, 'c' },
+		{ "debug", 0, 0, 'd' },
+		{ "disconnect", 1, 0, 'D' },
+		{ "filename", 1, 0, 'f' },
+		{ "help", 0, 0, 'h' },
+		{ "jitter", 1, 0, 'J' },
+		{ "lf", 0, 0, 'L' },
+		{ "no-length", 0, 0, 'N' },
+		{ "port", 1, 0, 'q' },
+		{ "quality", 1, 0, 'Q' },
+		{ "fps", 1, 0, 'r' },
+		{ "size", 1, 0, 's' },
+		{ "timestamp", 0, 0, 'T' },
+		{ 0, 0, 0, 0 }
+	};
+	for (;;) {
+		if ((c = getopt_long(argc, argv, "a:b:c:dD:f:hJ:LNq:Q:r:s:T", long_options, &option_index)) == -1) {
+			break;
+		}
+		switch (c)
+		{
+			case 'c': opts->max_clients = atoi(optarg); break;
+			case 'd': log_debug_on(); break;
+			case 'D': opts->disconnect = atoi(optarg); break;
+			case 'J': opts->jitter_msec = atoi(optarg); break;
+			case 'L': opts->lf = true; break;
+			case 'N': opts->no_length = true; break;
+			case 'q': opts->port = atoi(optarg); break;
+			case 'Q': opts->quality = atoi(optarg); break;
+			case 'r': opts->fps = atof(optarg); break;
+			case 'T': opts->timestamp = true; break;
+			case 'a': if (copy_string(optarg, &opts->address)) break; return false;
+			case 'b': if (copy_string(optarg, &opts->boundary)) break; return false;
+			case 'f': if (copy_string(optarg, &opts->filename)) break; return false;
+			case 's':
+				if (sscanf(optarg, "%ux%u", &opts->width, &opts->height) == 2 && opts->width > 0 && opts->height > 0) {
+					break;
+				}
+				log_error("Error: invalid size '%s'\n", optarg);
+				return false;
+
+			case 'h':
+			default:
+				usage();
+				return false;
+		}
+	}
+	if (opts->fps <= 0.0) {
+		log_error("Error: invalid frame rate\n");
+		return false;
+	}
+	return true;
+}
+
+static long long
+now_nsec (void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
+}
+
+static bool
+add_image (struct server *srv, const unsigned char *data, size_t len)
+{
+	struct image *images;
+
+	if ((images = realloc(srv->images, (srv->n_images + 1) * sizeof(*images))) == NULL) {
+		return false;
+	}
+	srv->images = images;
+	if ((images[srv->n_images].data = malloc(len)) == NULL) {
+		return false;
+	}
+	memcpy(images[srv->n_images].data, data, len);
+	images[srv->n_images].len = len;
+	srv->n_images++;
+	return true;
+}
+
+static void
+got_frame_callback (struct frame *f, void *data)
+{
+	struct server *srv = data;
+
+	if (!add_image(srv, frame_get_rawbits(f), frame_get_num_rawbits(f))) {
+		log_error("Error: out of memory, dropping frame\n");
+	}
+	frame_destroy(&f);
+}
+
+static bool
+load_images (struct server *srv, const char *filename)
+{
+	struct source *s;
+	struct mjv_grabber *g;
+
+	// Take the frames from a recorded stream, and keep them in memory:
+	if ((s = source_file_create("mjvserve", filename, 0)) == NULL) {
+		return false;
+	}
+	source_set_mmap(s, true);
+	if ((g = mjv_grabber_create(s)) == NULL) {
+		s->destroy(&s);
+		return false;
+	}
+	// The callback copies each frame, so it need not outlive the call:
+	mjv_grabber_set_frames(g, MJV_GRABBER_FRAMES_BORROWED);
+	if (s->open(s)) {
+		mjv_grabber_set_callback(g, got_frame_callback, srv);
+		mjv_grabber_run(g);
+	}
+	mjv_grabber_destroy(&g);
+	s->destroy(&s);
+
+	if (srv->n_images == 0) {
+		log_error("Error: no frames found in %s\n", filename);
+		return false;
+	}
+	log_info("Serving %u frames from %s\n", srv->n_images, filename);
+	return true;
+}
+
+static bool
+make_images (struct server *srv, unsigned int width, unsigned int height, int quality)
+{
+	struct jpeg_compress_struct cinfo;
+	struct jpeg_error_mgr jerr;
+	unsigned char *row;
+	bool ret = true;
+
+	if ((row = malloc(width * 3)) == NULL) {
+		return false;
+	}
+	cinfo.err = jpeg_std_error(&jerr);
+	jpeg_create_compress(&cinfo);
+
+	// A color gradient that scrolls sideways, with a bar sweeping across,
+	// so that each frame differs from the last:
+	for (unsigned int i = 0; ret && i < SYNTHETIC_FRAMES; i++) {
+		unsigned char *buf = NULL;
+		unsigned long len = 0;
+		unsigned int bar = width * i / SYNTHETIC_FRAMES;
+
+		jpeg_mem_dest(&cinfo, &buf, &len);
+		cinfo.image_width = width;
+		cinfo.image_height = height;
+		cinfo.input_components = 3;
+		cinfo.in_color_space = JCS_RGB;
+		jpeg_set_defaults(&cinfo);
+		jpeg_set_quality(&cinfo, quality, TRUE);
+		jpeg_start_compress(&cinfo, TRUE);
+
+		while (cinfo.next_scanline < height) {
+			unsigned int y = cinfo.next_scanline;
+
+			for (unsigned int x = 0; x < width; x++) {
+				bool on_bar = (x >= bar && x < bar + width / 16 + 1);
+
+				row[x * 3 + 0] = on_bar ? 255 : (x * 256 / width + i * 256 / SYNTHETIC_FRAMES) & 0xFF;
+				row[x * 3 + 1] = on_bar ? 255 : y * 256 / height;
+				row[x * 3 + 2] = on_bar ? 255 : 128;
+			}
+			jpeg_write_scanlines(&cinfo, &row, 1);
+		}
+		jpeg_finish_compress(&cinfo);
+		ret = add_image(srv, buf, len);
+		free(buf);
+	}
+	jpeg_destroy_compress(&cinfo);
+	free(row);
+
+	if (ret) {
+		log_info("Serving %u made-up frames of %ux%u\n", srv->n_images, width, height);
+	}
+	return ret;
+}
+
+static struct part *
+part_create (size_t size)
+{
+	struct part *p;
+
+	if ((p = malloc(sizeof(*p) + size)) == NULL) {
+		return NULL;
+	}
+	p->refs = 1;
+	p->len = 0;
+	return p;
+}
+
+static struct part *
+part_ref (struct part *p)
+{
+	p->refs++;
+	return p;
+}
+
+static void
+part_unref (struct part **p)
+{
+	if (p == NULL || *p == NULL) {
+		return;
+	}
+	if (--(*p)->refs == 0) {
+		free(*p);
+	}
+	*p = NULL;
+}
+
+static struct part *
+make_header (const struct cmdopts *opts)
+{
+	const char *nl = opts->lf ? "\n" : "\r\n";
+	struct part *p;
+	size_t size = 200 + strlen(opts->boundary);
+
+	if ((p = part_create(size)) == NULL) {
+		return NULL;
+	}
+	p->len = snprintf(p->data, size,
+		"HTTP/1.0 200 OK%s"
+		"Content-Type: multipart/x-mixed-replace; boundary=%s%s"
+		"%s", nl, opts->boundary, nl, nl);
+	return p;
+}
+
+static struct part *
+make_frame (const struct cmdopts *opts, const struct image *image)
+{
+	const char *nl = opts->lf ? "\n" : "\r\n";
+	struct part *p;
+	struct timespec ts;
+	size_t size = 200 + strlen(opts->boundary) + image->len;
+
+	if ((p = part_create(size)) == NULL) {
+		return NULL;
+	}
+	p->len = snprintf(p->data, size, "--%s%sContent-Type: image/jpeg%s", opts->boundary, nl, nl);
+	if (!opts->no_length) {
+		p->len += snprintf(p->data + p->len, size - p->len, "Content-Length: %zu%s", image->len, nl);
+	}
+	if (opts->timestamp) {
+		clock_gettime(CLOCK_REALTIME, &ts);
+		p->len += snprintf(p->data + p->len, size - p->len, "X-Timestamp: %ld.%06ld%s", (long)ts.tv_sec, ts.tv_nsec / 1000, nl);
+	}
+	p->len += snprintf(p->data + p->len, size - p->len, "%s", nl);
+	memcpy(p->data + p->len, image->data, image->len);
+	p->len += image->len;
+	p->len += snprintf(p->data + p->len, size - p->len, "%s", nl);
+	return p;
+}
+
+static void
+client_free (struct server *srv, struct client *c)
+{
+	log_debug("Closing client %d after %lu frames\n", c->fd, c->frames);
+
+	epoll_ctl(srv->epfd, EPOLL_CTL_DEL, c->fd, NULL);
+	close(c->fd);
+	part_unref(&c->part);
+
+	if (c->prev) {
+		c->prev->next = c->next;
+	}
+	else {
+		srv->clients = c->next;
+	}
+	if (c->next) {
+		c->next->prev = c->prev;
+	}
+	srv->n_clients--;
+	free(c);
+}
+
+// Other events for the client may still be pending, so
+// only mark it now, and close it after handling them:
+static void
+client_close (struct client *c)
+{
+	c->dead = true;
+}
+
+static void
+reap_clients (struct server *srv)
+{
+	struct client *c;
+	struct client *next;
+
+	for (c = srv->clients; c; c = next) {
+		next = c->next;
+		if (c->dead) {
+			client_free(srv, c);
+		}
+	}
+}
+
+static bool
+client_watch (struct server *srv, struct client *c, bool want_out)
+{
+	struct epoll_event ev;
+
+	if (c->want_out == want_out) {
+		return true;
+	}
+	ev.events = EPOLLIN | EPOLLRDHUP | (want_out ? EPOLLOUT : 0);
+	ev.data.ptr = c;
+	c->want_out = want_out;
+	return (epoll_ctl(srv->epfd, EPOLL_CTL_MOD, c->fd, &ev) == 0);
+}
+
+// Send as much of the current part as the socket takes. Returns false
+// if the client is gone:
+static bool
+client_flush (struct server *srv, struct client *c)
+{
+	ssize_t n;
+
+	while (c->part != NULL) {
+		if ((n = send(c->fd, c->part->data + c->sent, c->part->len - c->sent, MSG_NOSIGNAL | MSG_DONTWAIT)) < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			if (errno == EAGAIN || errno == EWOULDBLOCK) {
+				return client_watch(srv, c, true);
+			}
+			return false;
+		}
+		if ((c->sent += n) < c->part->len) {
+			continue;
+		}
+		if (c->part != srv->header) {
+			c->frames++;
+			srv->frames_sent++;
+		}
+		part_unref(&c->part);
+
+		// Induced disconnect:
+		if (srv->opts->disconnect > 0 && c->frames >= srv->opts->disconnect) {
+			srv->disconnects++;
+			return false;
+		}
+	}
+	return client_watch(srv, c, false);
+}
+
+// Read the request, which is answered once it ends with an empty line.
+// Anything sent after that is ignored. Returns false if the client is gone:
+static bool
+client_read (struct server *srv, struct client *c)
+{
+	char buf[1024];
+	ssize_t n;
+
+	for (;;) {
+		if ((n = recv(c->fd, buf, sizeof(buf), MSG_DONTWAIT)) == 0) {
+			return false;
+		}
+		if (n < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return (errno == EAGAIN || errno == EWOULDBLOCK);
+		}
+		if (c->state != CLIENT_REQUEST) {
+			continue;
+		}
+		for (ssize_t i = 0; i < n; i++) {
+			if (buf[i] == '\n') {
+				c->newlines++;
+			}
+			else if (buf[i] != '\r') {
+				c->newlines = 0;
+			}
+			if (c->newlines == 2) {
+				c->state = CLIENT_STREAMING;
+				c->part = part_ref(srv->header);
+				c->sent = 0;
+				if (!client_flush(srv, c)) {
+					return false;
+				}
+				break;
+			}
+		}
+		if (c->state == CLIENT_REQUEST && (c->request_len += n) > MAX_REQUEST) {
+			log_debug("Client %d: request too long\n", c->fd);
+			return false;
+		}
+	}
+}
+
+static void
+accept_clients (struct server *srv)
+{
+	struct epoll_event ev;
+	struct client *c;
+	int fd;
+	int one = 1;
+
+	while ((fd = accept4(srv->listenfd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0) {
+		if (srv->n_clients >= srv->opts->max_clients) {
+			srv->refused++;
+			close(fd);
+			continue;
+		}
+		if ((c = calloc(1, sizeof(*c))) == NULL) {
+			close(fd);
+			continue;
+		}
+		// Send each frame as soon as it is ready:
+		setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+		c->fd = fd;
+		c->state = CLIENT_REQUEST;
+		ev.events = EPOLLIN | EPOLLRDHUP;
+		ev.data.ptr = c;
+		if (epoll_ctl(srv->epfd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+			close(fd);
+			free(c);
+			continue;
+		}
+		if ((c->next = srv->clients) != NULL) {
+			c->next->prev = c;
+		}
+		srv->clients = c;
+		srv->n_clients++;
+		srv->accepted++;
+		log_debug("Accepted client %d\n", fd);
+	}
+}
+
+static void
+arm_timer (struct server *srv)
+{
+	struct itimerspec its;
+	long long deadline;
+
+	// The nominal deadlines follow from the start time, so that they do
+	// not drift. Jitter delays a frame without moving the next one:
+	deadline = srv->start + srv->tick * srv->interval;
+	if (srv->opts->jitter_msec > 0) {
+		deadline += (random() % (srv->opts->jitter_msec * 1000LL)) * 1000LL;
+	}
+	memset(&its, 0, sizeof(its));
+	its.it_value.tv_sec = deadline / NSEC_PER_SEC;
+	its.it_value.tv_nsec = deadline % NSEC_PER_SEC;
+	timerfd_settime(srv->timerfd, TFD_TIMER_ABSTIME, &its, NULL);
+}
+
+static void
+broadcast (struct server *srv)
+{
+	const struct image *image = &srv->images[srv->cur_image];
+	struct client *c;
+	struct part *p = NULL;
+
+	srv->cur_image = (srv->cur_image + 1) % srv->n_images;
+
+	for (c = srv->clients; c; c = c->next) {
+		if (c->dead || c->state != CLIENT_STREAMING) {
+			continue;
+		}
+		// Like a real camera, skip frames for a client that cannot
+		// keep up, rather than queueing them:
+		if (c->part != NULL) {
+			srv->frames_skipped++;
+			continue;
+		}
+		if (p == NULL && (p = make_frame(srv->opts, image)) == NULL) {
+			log_error("Error: out of memory\n");
+			return;
+		}
+		c->part = part_ref(p);
+		c->sent = 0;
+		if (!client_flush(srv, c)) {
+			client_close(c);
+		}
+	}
+	part_unref(&p);
+}
+
+static void
+handle_timer (struct server *srv)
+{
+	uint64_t expirations;
+	long long now = now_nsec();
+
+	if (read(srv->timerfd, &expirations, sizeof(expirations)) < 0) {
+		return;
+	}
+	broadcast(srv);
+
+	// If the loop fell far behind, start the clock over:
+	if (now - (srv->start + srv->tick * srv->interval) > NSEC_PER_SEC) {
+		srv->start = now;
+		srv->tick = 0;
+	}
+	srv->tick++;
+	arm_timer(srv);
+
+	if (now >= srv->next_status) {
+		log_info("%u clients, %lu accepted, %lu refused, %lu frames sent, %lu skipped, %lu disconnects\n",
+			srv->n_clients, srv->accepted, srv->refused, srv->frames_sent, srv->frames_skipped, srv->disconnects);
+		srv->next_status = now + STATUS_SEC * NSEC_PER_SEC;
+	}
+}
+
+static void
+handle_client (struct server *srv, struct client *c, uint32_t events)
+{
+	if (c->dead) {
+		return;
+	}
+	if ((events & EPOLLIN) && !client_read(srv, c)) {
+		client_close(c);
+		return;
+	}
+	if ((events & EPOLLOUT) && !client_flush(srv, c)) {
+		client_close(c);
+		return;
+	}
+	if (events & (EPOLLERR | EPOLLHUP | EPOLLRDHUP)) {
+		client_close(c);
+	}
+}
+
+static int
+listen_on (const char *address, int port)
+{
+	struct sockaddr_in addr;
+	int fd;
+	int one = 1;
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(port);
+	if (inet_pton(AF_INET, address, &addr.sin_addr) != 1) {
+		log_error("Error: invalid address '%s'\n", address);
+		return -1;
+	}
+	if ((fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0)) < 0) {
+		log_error("Error: socket: %s\n", strerror(errno));
+		return -1;
+	}
+	setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+	if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(fd, SOMAXCONN) < 0) {
+		log_error("Error: cannot listen on %s:%d: %s\n", address, port, strerror(errno));
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+static bool
+watch (int epfd, int fd, int *marker)
+{
+	struct epoll_event ev;
+
+	ev.events = EPOLLIN;
+	ev.data.ptr = marker;
+	return (epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev) == 0);
+}
+
+static void
+run (struct server *srv)
+{
+	struct epoll_event events[MAX_EVENTS];
+	int n;
+
+	srv->start = now_nsec();
+	srv->next_status = srv->start + STATUS_SEC * NSEC_PER_SEC;
+	arm_timer(srv);
+
+	for (;;) {
+		if ((n = epoll_wait(srv->epfd, events, MAX_EVENTS, -1)) < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			log_error("Error: epoll_wait: %s\n", strerror(errno));
+			return;
+		}
+		for (int i = 0; i < n; i++) {
+			if (events[i].data.ptr == &watch_quit) {
+				return;
+			}
+			if (events[i].data.ptr == &watch_listen) {
+				accept_clients(srv);
+			}
+			else if (events[i].data.ptr == &watch_timer) {
+				handle_timer(srv);
+			}
+			else {
+				handle_client(srv, events[i].data.ptr, events[i].events);
+			}
+		}
+		reap_clients(srv);
+	}
+}
+
+static void
+raise_fd_limit (void)
+{
+	struct rlimit rl;
+
+	// Each client takes a descriptor:
+	if (getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur < rl.rlim_max) {
+		rl.rlim_cur = rl.rlim_max;
+		setrlimit(RLIMIT_NOFILE, &rl);
+	}
+}
+
+static void
+sig_handler (int signum, siginfo_t *info, void *ptr)
+{
+	(void)signum;
+	(void)info;
+	(void)ptr;
+
+	selfpipe_write_close(&write_fd);
+}
+
+static void
+sig_setup (void)
+{
+	struct sigaction act;
+
+	memset(&act, 0, sizeof(act));
+
+	act.sa_sigaction = sig_handler;
+	act.sa_flags = SA_SIGINFO;
+
+	sigaction(SIGTERM, &act, NULL);
+	sigaction(SIGINT, &act, NULL);
+
+	signal(SIGPIPE, SIG_IGN);
+}
+
+int
+main (int argc, char **argv)
+{
+	int ret = 0;
+	struct server srv;
+
+	struct cmdopts opts =
+		{ .address = NULL
+		, .port = 8080
+		, .filename = NULL
+		, .width = 640
+		, .height = 480
+		, .quality = 85
+		, .fps = 25.0
+		, .boundary = NULL
+		, .lf = false
+		, .no_length = false
+		, .timestamp = false
+		, .jitter_msec = 0
+		, .disconnect = 0
+		, .max_clients = 1000
+		} ;
+
+	memset(&srv, 0, sizeof(srv));
+	srv.opts = &opts;
+	srv.epfd = srv.listenfd = srv.timerfd = -1;
+
+	if (!process_cmdline(argc, argv, &opts)) {
+		ret = 1;
+		goto exit;
+	}
+	if ((opts.address == NULL && !copy_string("127.0.0.1", &opts.address))
+	 || (opts.boundary == NULL && !copy_string("mjvserve", &opts.boundary))) {
+		ret = 1;
+		goto exit;
+	}
+	if (!(opts.filename ? load_images(&srv, opts.filename) : make_images(&srv, opts.width, opts.height, opts.quality))) {
+		log_error("Error: could not get frames to serve\n");
+		ret = 1;
+		goto exit;
+	}
+	if ((srv.header = make_header(&opts)) == NULL) {
+		ret = 1;
+		goto exit;
+	}
+	raise_fd_limit();
+	srandom(time(NULL));
+	srv.interval = NSEC_PER_SEC / opts.fps;
+
+	if ((srv.listenfd = listen_on(opts.address, opts.port)) < 0) {
+		ret = 1;
+		goto exit;
+	}
+	if ((srv.epfd = epoll_create1(EPOLL_CLOEXEC)) < 0
+	 || (srv.timerfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC)) < 0
+	 || !selfpipe_pair(&read_fd, &write_fd)) {
+		log_error("Error: could not create descriptors\n");
+		ret = 1;
+		goto exit;
+	}
+	if (!watch(srv.epfd, srv.listenfd, &watch_listen)
+	 || !watch(srv.epfd, srv.timerfd, &watch_timer)
+	 || !watch(srv.epfd, read_fd, &watch_quit)) {
+		log_error("Error: could not watch descriptors\n");
+		ret = 1;
+		goto exit;
+	}
+	sig_setup();
+	log_info("Listening on %s:%d at %.2f fps\n", opts.address, opts.port, opts.fps);
+
+	run(&srv);
+
+	log_info("Frames sent: %lu, skipped for slow clients: %lu\n", srv.frames_sent, srv.frames_skipped);
+
+exit:	while (srv.clients) {
+		client_free(&srv, srv.clients);
+	}
+	part_unref(&srv.header);
+	for (unsigned int i = 0; i < srv.n_images; i++) {
+		free(srv.images[i].data);
+	}
+	free(srv.images);
+	selfpipe_read_close(&read_fd);
+	if (write_fd >= 0) {
+		close(write_fd);
+	}
+	if (srv.timerfd >= 0) {
+		close(srv.timerfd);
+	}
+	if (srv.listenfd >= 0) {
+		close(srv.listenfd);
+	}
+	if (srv.epfd >= 0) {
+		close(srv.epfd);
+	}
+	free(opts.boundary);
+	free(opts.filename);
+	free(opts.address);
+	return ret;
+}
@@ -5,8 +5,6 @@
 #include <stdio.h>
 #include <getopt.h>
 #include <signal.h>
-#include <sys/stat.h>
-#include <fcntl.h>
 
 #include "mjv_log.c"
 #include "frame.h"
@@ -16,6 +14,7 @@
 #include "filename.h"
 #include "framerate.h"
 #include "mjv_grabber.h"
+#include "chunker.h"
 #include "selfpipe.h"
 
 // This is a really simple framegrabber for mjpeg streams. It is intended to
@@ -24,7 +23,7 @@
 // terms of simple interfaces and modularity.
 
 static int n_frames = 0;
-static int read_fd, write_fd;
+static int read_fd = -1, write_fd = -1;
 
 static bool
 copy_string (const char *const src, char **const dst)
@@ -47,6 +46,11 @@ struct cmdopts {
 	char *pass;
 	int port;
 	int usec;
+	bool original_timing;
+	double speed;
+	bool io_uring;
+	bool mmap;
+	unsigned int jobs;
 };
 
 static bool
@@ -65,10 +69,15 @@ process_cmdline (int argc, char **argv, struct cmdopts *opts)
 		{ "pass", 1, 0, 'p' },
 		{ "path", 1, 0, 'P' },
 		{ "port", 1, 0, 'q' },
+		{ "io-uring", 0, 0, 'U' },
+		{ "mmap", 0, 0, 'M' },
+		{ "jobs", 1, 0, 'j' },
+		{ "original-timing", 0, 0, 'T' },
+		{ "speed", 1, 0, 'S' },
 		{ 0, 0, 0, 0 }
 	};
 	for (;;) {
-		if ((c = getopt_long(argc, argv, "df:hH:n:m:u:p:P:q:", long_options, &option_index)) == -1) {
+		if ((c = getopt_long(argc, argv, "df:hH:j:n:m:Mu:p:P:q:S:TU", long_options, &option_index)) == -1) {
 			break;
 		}
 		switch (c)
@@ -77,6 +86,11 @@ process_cmdline (int argc, char **argv, struct cmdopts *opts)
 			case 'h': break;
 			case 'm': opts->usec = atoi(optarg); break;
 			case 'q': opts->port = atoi(optarg); break;
+			case 'U': opts->io_uring = true; break;
+			case 'M': opts->mmap = true; break;
+			case 'j': opts->jobs = atoi(optarg); break;
+			case 'T': opts->original_timing = true; break;
+			case 'S': opts->speed = atof(optarg); break;
 			case 'f': if (copy_string(optarg, &opts->filename)) break; return false;
 			case 'H': if (copy_string(optarg, &opts->host)) break; return false;
 			case 'n': if (copy_string(optarg, &opts->name)) break; return false;
@@ -88,20 +102,6 @@ process_cmdline (int argc, char **argv, struct cmdopts *opts)
 	return true;
 }
 
-static void
-timestamp_file (const char *const filename, const struct timespec *const timestamp)
-{
-	struct timespec times[2];
-
-	times[0].tv_sec = timestamp->tv_sec;
-	times[0].tv_nsec = timestamp->tv_nsec;
-
-	times[1].tv_sec = timestamp->tv_sec;
-	times[1].tv_nsec = timestamp->tv_nsec;
-
-	utimensat(AT_FDCWD, filename, times, 0);
-}
-
 static void
 print_info (unsigned int framenum, float fps)
 {
@@ -140,37 +140,6 @@ print_info (unsigned int framenum, float fps)
 	fsync(STDOUT_FILENO);
 }
 
-static void
-write_image_file (char *data, size_t nbytes, char *const srcname, unsigned int framenum, const struct timespec *const timestamp)
-{
-	FILE *fp;
-	char *filename;
-
-	if (data == NULL || nbytes == 0) {
-		log_error("Error: frame contains no data\n");
-		return;
-	}
-	if (framenum >= 1000000000) {
-		log_error("Error: framenum too large (over 9 digits)\n");
-		return;
-	}
-	// TODO: let user specify the pattern:
-	if ((filename = filename_forge(srcname, framenum, "%f.jpg")) == NULL) {
-		log_error("Error: could not forge filename\n");
-		return;
-	}
-	if ((fp = fopen(filename, "w")) == NULL) {
-		perror("fopen");
-	}
-	else {
-		log_debug("writing %s\n", filename);
-		fwrite(data, nbytes, 1, fp);
-		fclose(fp);
-		timestamp_file(filename, timestamp);
-	}
-	free(filename);
-}
-
 static void
 got_frame_callback (struct frame *f, void *data)
 {
@@ -183,13 +152,23 @@ got_frame_callback (struct frame *f, void *data)
 	framerate_insert_datapoint(fr, frame_get_timestamp(f));
 	print_info(n_frames, framerate_estimate(fr));
 
-	// Write to file:
-	write_image_file((char *)frame_get_rawbits(f), frame_get_num_rawbits(f), NULL, n_frames, frame_get_timestamp(f));
+	// Write to file. TODO: let user specify the pattern:
+	filename_write_image("%f.jpg", NULL, n_frames, (char *)frame_get_rawbits(f), frame_get_num_rawbits(f), frame_get_timestamp(f));
 
 	// We are responsible for freeing the frame when we're done with it:
 	frame_destroy(&f);
 }
 
+static void
+got_numbered_frame_callback (struct frame *f, unsigned long framenum, void *data)
+{
+	(void)data;
+
+	// Called from many threads at once, with frames out of order:
+	filename_write_image("%f.jpg", NULL, framenum, (char *)frame_get_rawbits(f), frame_get_num_rawbits(f), frame_get_timestamp(f));
+	frame_destroy(&f);
+}
+
 static void
 sig_handler (int signum, siginfo_t *info, void *ptr)
 {
@@ -223,6 +202,7 @@ main (int argc, char **argv)
 	struct source *s = NULL;
 	struct mjv_grabber *g = NULL;
 	struct framerate *fr = NULL;
+	struct mjv_grabber_stats stats;
 
 	struct cmdopts opts =
 		{ .name = NULL
@@ -233,6 +213,11 @@ main (int argc, char **argv)
 		, .pass = NULL
 		, .port = 0
 		, .usec = 100
+		, .original_timing = false
+		, .speed = 1.0
+		, .io_uring = false
+		, .mmap = false
+		, .jobs = 1
 		} ;
 
 	if (!process_cmdline(argc, argv, &opts)) {
@@ -245,6 +230,7 @@ main (int argc, char **argv)
 			ret = 1;
 			goto exit;
 		}
+		source_set_pace(s, (opts.usec > 0) ? opts.usec : 0, opts.original_timing, opts.speed);
 	}
 	else if (opts.host != NULL) {
 		if ((s = source_network_create(opts.name, opts.host, opts.path, opts.user, opts.pass, opts.port)) == NULL) {
@@ -258,11 +244,18 @@ main (int argc, char **argv)
 		ret = 1;
 		goto exit;
 	}
+	source_set_io_uring(s, opts.io_uring);
+	// Parsing on several threads works on a mapped file:
+	source_set_mmap(s, opts.mmap || opts.jobs > 1);
+
 	if ((g = mjv_grabber_create(s)) == NULL) {
 		log_error("Error: could not create grabber\n");	// TODO: non-descriptive error messages...
 		ret = 1;
 		goto exit;
 	}
+	// Frames are written out and destroyed in the callback,
+	// so they can be left in the read buffer:
+	mjv_grabber_set_frames(g, MJV_GRABBER_FRAMES_BORROWED);
 	if ((fr = framerate_create(15)) == NULL) {
 		log_error("Error: could not create framerate estimator\n");
 		ret = 1;
@@ -273,25 +266,49 @@ main (int argc, char **argv)
 		ret = 1;
 		goto exit;
 	}
-	// Create pipe pair to signal quit message to grabber, using the self-pipe trick:
-	if (selfpipe_pair(&read_fd, &write_fd) == false) {
-		log_error("Error: could not create pipe\n");
-		ret = 1;
-		goto exit;
+	// Offline mode: split the file up among several threads:
+	if (opts.jobs > 1) {
+		if (source_get_map(s) == NULL) {
+			log_error("Error: parsing on several threads needs a file that can be mapped\n");
+			ret = 1;
+			goto exit;
+		}
+		// The stats still count what was parsed before an error:
+		if (chunker_run(source_get_map(s), opts.jobs, got_numbered_frame_callback, NULL, &stats) != MJV_GRABBER_SUCCESS) {
+			log_error("Error: could not parse the stream\n");
+			ret = 1;
+		}
+		n_frames = stats.frames;
 	}
-	source_set_selfpipe(s, read_fd);
+	else {
+		// Create pipe pair to signal quit message to grabber, using the self-pipe trick:
+		if (selfpipe_pair(&read_fd, &write_fd) == false) {
+			log_error("Error: could not create pipe\n");
+			ret = 1;
+			goto exit;
+		}
+		source_set_selfpipe(s, read_fd);
 
-	// Grabbed frames will be handled by got_frame_callback():
-	mjv_grabber_set_callback(g, got_frame_callback, fr);
+		// Grabbed frames will be handled by got_frame_callback():
+		mjv_grabber_set_callback(g, got_frame_callback, fr);
 
-	// Install signal handler to trap INT and TERM:
-	sig_setup();
+		// Install signal handler to trap INT and TERM:
+		sig_setup();
 
-	// Run the grabber; control stays here until the stream terminates or the user interrupts:
-	mjv_grabber_run(g);
+		// Run the grabber; control stays here until the stream terminates or the user interrupts:
+		mjv_grabber_run(g);
 
+		mjv_grabber_get_stats(g, &stats);
+	}
 	log_info("Frames processed: %d\n", n_frames);
 
+	if (stats.bad_start + stats.bad_end + stats.bad_segment > 0) {
+		log_info("Malformed frames dropped: %lu\n", stats.bad_start + stats.bad_end + stats.bad_segment);
+	}
+	if (stats.oversize > 0) {
+		log_info("Oversize frames dropped: %lu\n", stats.oversize);
+	}
+
 exit:	framerate_destroy(&fr);
 	if (g) {
 		selfpipe_read_close(&read_fd);
@@ -0,0 +1,210 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <time.h>
+#include <sys/timerfd.h>
+
+#include "pacer.h"
+
+#define NSEC_PER_SEC	1000000000LL
+
+// If the frames fall further behind than this, for instance because the
+// reader stalled, start the schedule over rather than catch up in a burst:
+#define MAX_LAG		(1 * NSEC_PER_SEC)
+
+// A jump in capture times larger than this is a discontinuity in the
+// recording; continue at the regular interval from there:
+#define MAX_GAP		(10 * NSEC_PER_SEC)
+
+struct pacer {
+	int timerfd;
+	long long interval;	// time between frames, in nsec;
+	bool original;		// follow the capture times;
+	double speed;
+
+	bool started;		// a frame went out since the last reset;
+	bool pending;		// the deadline for the next frame is set;
+	long long deadline;	// of the next frame, on the monotonic clock;
+	long long last;		// deadline of the previous frame;
+
+	// Capture time that corresponds with the base deadline:
+	bool have_base;
+	long long base;
+	long long base_capture;
+	long long last_capture;
+};
+
+static long long
+now_nsec (void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
+}
+
+static inline long long
+to_nsec (const struct timespec *ts)
+{
+	return ts->tv_sec * NSEC_PER_SEC + ts->tv_nsec;
+}
+
+struct pacer *
+pacer_create (unsigned int interval_usec, bool original_timing, double speed)
+{
+	struct pacer *p;
+
+	if ((p = malloc(sizeof(*p))) == NULL) {
+		return NULL;
+	}
+	if ((p->timerfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC)) < 0) {
+		free(p);
+		return NULL;
+	}
+	p->speed = (speed > 0.0) ? speed : 1.0;
+	p->interval = interval_usec * 1000LL / p->speed;
+	p->original = original_timing;
+	pacer_reset(p);
+	return p;
+}
+
+void
+pacer_destroy (struct pacer **p)
+{
+	if (p == NULL || *p == NULL) {
+		return;
+	}
+	close((*p)->timerfd);
+	free(*p);
+	*p = NULL;
+}
+
+static void
+arm_timer (struct pacer *p, long long deadline)
+{
+	struct itimerspec its;
+
+	// A zero value would disarm the timer:
+	memset(&its, 0, sizeof(its));
+	its.it_value.tv_sec = deadline / NSEC_PER_SEC;
+	its.it_value.tv_nsec = deadline % NSEC_PER_SEC;
+	if (its.it_value.tv_sec == 0 && its.it_value.tv_nsec == 0) {
+		its.it_value.tv_nsec = 1;
+	}
+	timerfd_settime(p->timerfd, TFD_TIMER_ABSTIME, &its, NULL);
+}
+
+void
+pacer_reset (struct pacer *p)
+{
+	struct itimerspec its;
+
+	memset(&its, 0, sizeof(its));
+	timerfd_settime(p->timerfd, 0, &its, NULL);
+	p->started = false;
+	p->pending = false;
+	p->have_base = false;
+}
+
+static long long
+next_deadline (struct pacer *p, const struct timespec *capture, long long now)
+{
+	long long deadline;
+	long long c;
+
+	if (!p->started) {
+		deadline = now;
+	}
+	else {
+		deadline = p->last + p->interval;
+	}
+	if (!p->original || capture == NULL) {
+		p->have_base = false;
+		return deadline;
+	}
+	// Follow the capture times, relative to the first frame that had
+	// one. Start a new base after a discontinuity in the recording:
+	c = to_nsec(capture);
+	if (p->started && p->have_base && c >= p->last_capture && c - p->last_capture <= MAX_GAP) {
+		deadline = p->base + (long long)((c - p->base_capture) / p->speed);
+	}
+	else {
+		p->have_base = true;
+		p->base = deadline;
+		p->base_capture = c;
+	}
+	p->last_capture = c;
+	return deadline;
+}
+
+bool
+pacer_ready (struct pacer *p, const struct timespec *capture)
+{
+	long long now = now_nsec();
+
+	if (!p->pending) {
+		p->deadline = next_deadline(p, capture, now);
+		p->pending = true;
+
+		// Too far behind; shift the schedule to start from now:
+		if (now - p->deadline > MAX_LAG) {
+			if (p->have_base) {
+				p->base += now - p->deadline;
+			}
+			p->deadline = now;
+		}
+	}
+	if (now >= p->deadline) {
+		return true;
+	}
+	arm_timer(p, p->deadline);
+	return false;
+}
+
+void
+pacer_advance (struct pacer *p)
+{
+	p->last = p->deadline;
+	p->pending = false;
+	p->started = true;
+}
+
+bool
+pacer_wait (struct pacer *p, const struct timespec *capture, int cancel_fd)
+{
+	struct pollfd fds[2];
+	uint64_t expirations;
+
+	fds[0].fd = p->timerfd;
+	fds[0].events = POLLIN;
+	fds[1].fd = cancel_fd;
+	fds[1].events = POLLIN;
+
+	while (!pacer_ready(p, capture)) {
+		if (poll(fds, (cancel_fd >= 0) ? 2 : 1, -1) < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			break;
+		}
+		if (cancel_fd >= 0 && fds[1].revents != 0) {
+			return false;
+		}
+		// Drain the timer:
+		if (read(p->timerfd, &expirations, sizeof(expirations)) < 0 && errno != EAGAIN) {
+			break;
+		}
+	}
+	pacer_advance(p);
+	return true;
+}
+
+int
+pacer_get_fd (const struct pacer *p)
+{
+	return p->timerfd;
+}
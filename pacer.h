@@ -0,0 +1,35 @@
+#ifndef PACER_H
+#define PACER_H
+
+// Plays frames at a steady rate, or at the rate at which they were
+// captured. Each frame gets a deadline on the monotonic clock, computed
+// from the previous deadline rather than from the time the previous
+// frame actually went out, so that late wakeups do not add up to drift.
+// Waiting is done on a timerfd armed with absolute deadlines; event loops
+// can poll its descriptor instead of blocking.
+
+struct pacer;
+
+// One frame every interval, or at the original capture times when the
+// frames carry them, sped up by a factor:
+struct pacer *pacer_create (unsigned int interval_usec, bool original_timing, double speed);
+void pacer_destroy (struct pacer **);
+
+// Start over, for instance after reopening the source; the next frame
+// is due right away:
+void pacer_reset (struct pacer *);
+
+// Whether the next frame, with the given capture time or NULL, is due.
+// If not, the timer is armed for its deadline. Call pacer_advance()
+// once the frame has gone out:
+bool pacer_ready (struct pacer *, const struct timespec *capture);
+void pacer_advance (struct pacer *);
+
+// Blocking version of the above. Returns false if cancel_fd became
+// readable before the frame was due:
+bool pacer_wait (struct pacer *, const struct timespec *capture, int cancel_fd);
+
+// Readable when the deadline passes:
+int pacer_get_fd (const struct pacer *);
+
+#endif	// PACER_H
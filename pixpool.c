@@ -0,0 +1,178 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <pthread.h>
+
+#include "pixpool.h"
+
+// Buffers kept for reuse. One is shown while the next one is decoded,
+// so a few are plenty:
+#define MAX_FREE	4
+
+// The header in front of each buffer, padded so
+// that the pixels start on a cache line:
+#define HEADER_SIZE	64
+
+struct header {
+	struct pixpool *pool;
+	struct header *next;
+	unsigned int width;
+	unsigned int height;
+	unsigned int row_stride;
+};
+
+struct pixpool {
+	pthread_mutex_t mutex;
+	struct header *free;
+	unsigned int nfree;
+	unsigned int outstanding;	// buffers handed out and not yet back;
+	bool destroyed;
+	unsigned int width;
+	unsigned int height;
+	unsigned int row_stride;
+};
+
+#define HEADER_OF(pixels)	((struct header *)((pixels) - HEADER_SIZE))
+#define PIXELS_OF(h)		((unsigned char *)(h) + HEADER_SIZE)
+
+static void
+free_unused (struct pixpool *p)
+{
+	struct header *h;
+
+	while ((h = p->free) != NULL) {
+		p->free = h->next;
+		free(h);
+	}
+	p->nfree = 0;
+}
+
+struct pixpool *
+pixpool_create (void)
+{
+	struct pixpool *p;
+
+	if ((p = malloc(sizeof(*p))) == NULL) {
+		return NULL;
+	}
+	if (pthread_mutex_init(&p->mutex, NULL) != 0) {
+		free(p);
+		return NULL;
+	}
+	p->free = NULL;
+	p->nfree = 0;
+	p->outstanding = 0;
+	p->destroyed = false;
+	p->width = 0;
+	p->height = 0;
+	p->row_stride = 0;
+	return p;
+}
+
+static void
+pixpool_free (struct pixpool *p)
+{
+	pthread_mutex_destroy(&p->mutex);
+	free(p);
+}
+
+void
+pixpool_destroy (struct pixpool **p)
+{
+	bool last;
+
+	if (p == NULL || *p == NULL) {
+		return;
+	}
+	pthread_mutex_lock(&(*p)->mutex);
+	free_unused(*p);
+	(*p)->destroyed = true;
+	last = ((*p)->outstanding == 0);
+	pthread_mutex_unlock(&(*p)->mutex);
+
+	// Else the last buffer to come back frees the pool:
+	if (last) {
+		pixpool_free(*p);
+	}
+	*p = NULL;
+}
+
+unsigned char *
+pixpool_get (struct pixpool *p, unsigned int width, unsigned int height, unsigned int row_stride)
+{
+	struct header *h;
+	void *mem;
+
+	pthread_mutex_lock(&p->mutex);
+
+	// On a change of resolution, the unused buffers are of no more use:
+	if (width != p->width || height != p->height || row_stride != p->row_stride) {
+		free_unused(p);
+		p->width = width;
+		p->height = height;
+		p->row_stride = row_stride;
+	}
+	if ((h = p->free) != NULL) {
+		p->free = h->next;
+		p->nfree--;
+		p->outstanding++;
+		pthread_mutex_unlock(&p->mutex);
+		return PIXELS_OF(h);
+	}
+	pthread_mutex_unlock(&p->mutex);
+
+	// Allocate outside of the lock:
+	if (posix_memalign(&mem, HEADER_SIZE, HEADER_SIZE + (size_t)height * row_stride) != 0) {
+		return NULL;
+	}
+	h = mem;
+	h->pool = p;
+	h->next = NULL;
+	h->width = width;
+	h->height = height;
+	h->row_stride = row_stride;
+
+	pthread_mutex_lock(&p->mutex);
+	p->outstanding++;
+	pthread_mutex_unlock(&p->mutex);
+
+	return PIXELS_OF(h);
+}
+
+void
+pixpool_put (unsigned char *pixels)
+{
+	struct header *h;
+	struct pixpool *p;
+	bool last = false;
+
+	if (pixels == NULL) {
+		return;
+	}
+	h = HEADER_OF(pixels);
+	p = h->pool;
+
+	pthread_mutex_lock(&p->mutex);
+	p->outstanding--;
+
+	// Keep the buffer only if it can be used again:
+	if (!p->destroyed
+	 && p->nfree < MAX_FREE
+	 && h->width == p->width
+	 && h->height == p->height
+	 && h->row_stride == p->row_stride) {
+		h->next = p->free;
+		p->free = h;
+		p->nfree++;
+		h = NULL;
+	}
+	else {
+		last = (p->destroyed && p->outstanding == 0);
+	}
+	pthread_mutex_unlock(&p->mutex);
+
+	free(h);
+	if (last) {
+		pixpool_free(p);
+	}
+}
@@ -0,0 +1,20 @@
+#ifndef PIXPOOL_H
+#define PIXPOOL_H
+
+// A pool of pixel buffers to decode frames into, so that a source does
+// not allocate a new buffer for every frame. Buffers are taken out when
+// a frame is decoded and put back when the image that shows it is let
+// go, which may happen on another thread. All buffers in the pool have
+// the dimensions and stride of the last request; when those change, the
+// buffers of the old size are freed as they come back. The pool itself
+// is freed when it has been destroyed and its last buffer is back.
+
+struct pixpool;
+
+struct pixpool *pixpool_create (void);
+void pixpool_destroy (struct pixpool **);
+
+unsigned char *pixpool_get (struct pixpool *, unsigned int width, unsigned int height, unsigned int row_stride);
+void pixpool_put (unsigned char *pixels);
+
+#endif	// PIXPOOL_H
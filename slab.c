@@ -0,0 +1,89 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+
+#include "slab.h"
+
+struct slab {
+	unsigned int refcount;
+	bool mapped;	// data is a file mapping, not part of this allocation;
+	size_t size;
+	char *data;
+	char inline_data[];
+};
+
+struct slab *
+slab_create (unsigned int size)
+{
+	struct slab *s;
+
+	// Allocate the header and the data in one go:
+	if ((s = malloc(sizeof(*s) + size)) == NULL) {
+		return NULL;
+	}
+	s->refcount = 1;
+	s->mapped = false;
+	s->size = size;
+	s->data = s->inline_data;
+	return s;
+}
+
+struct slab *
+slab_create_mapped (int fd, size_t size)
+{
+	struct slab *s;
+
+	if ((s = malloc(sizeof(*s))) == NULL) {
+		return NULL;
+	}
+	// A private, read-only mapping; the file can be closed after this:
+	if ((s->data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0)) == MAP_FAILED) {
+		free(s);
+		return NULL;
+	}
+	s->refcount = 1;
+	s->mapped = true;
+	s->size = size;
+	return s;
+}
+
+struct slab *
+slab_ref (struct slab *s)
+{
+	__atomic_add_fetch(&s->refcount, 1, __ATOMIC_RELAXED);
+	return s;
+}
+
+void
+slab_unref (struct slab **s)
+{
+	if (s == NULL || *s == NULL) {
+		return;
+	}
+	if (__atomic_sub_fetch(&(*s)->refcount, 1, __ATOMIC_ACQ_REL) == 0) {
+		if ((*s)->mapped) {
+			munmap((*s)->data, (*s)->size);
+		}
+		free(*s);
+	}
+	*s = NULL;
+}
+
+char *
+slab_data (struct slab *s)
+{
+	return s->data;
+}
+
+size_t
+slab_size (const struct slab *const s)
+{
+	return s->size;
+}
+
+bool
+slab_is_shared (const struct slab *const s)
+{
+	return __atomic_load_n(&s->refcount, __ATOMIC_ACQUIRE) > 1;
+}
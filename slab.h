@@ -0,0 +1,20 @@
+#ifndef SLAB_H
+#define SLAB_H
+
+// A reference-counted chunk of memory. The last party to drop its
+// reference frees it. References may be dropped from any thread.
+// A slab can also wrap a read-only mapping of a file, which is
+// unmapped when the last reference is dropped.
+
+struct slab;
+
+struct slab *slab_create (unsigned int size);
+struct slab *slab_create_mapped (int fd, size_t size);
+struct slab *slab_ref (struct slab *);
+void slab_unref (struct slab **);
+
+char *slab_data (struct slab *);
+size_t slab_size (const struct slab *const);
+bool slab_is_shared (const struct slab *const);
+
+#endif	// SLAB_H
@@ -7,6 +7,10 @@
 
 #include "mjv_log.h"
 #include "source.h"
+#include "uring.h"
+#include "slab.h"
+
+#define READ_TIMEOUT_SEC	10
 
 bool
 source_init (
@@ -22,10 +26,21 @@ source_init (
 		return false;
 	}
 	s->open = open;
+	s->open_prepare = NULL;
+	s->open_nowait = NULL;
 	s->close = close;
 	s->destroy = destroy;
 	s->fd = -1;
 	s->selfpipe_readfd = -1;
+	s->max_frame_size = 0;
+	s->use_io_uring = false;
+	s->uring = NULL;
+	s->use_mmap = false;
+	s->map = NULL;
+	s->pace_usec = 0;
+	s->pace_original = false;
+	s->pace_speed = 1.0;
+	s->fast_decode = false;
 	return true;
 }
 
@@ -33,6 +48,7 @@ void
 source_deinit (struct source *s)
 {
 	if (s != NULL) {
+		source_release_io(s);
 		free(s->name);
 	}
 }
@@ -45,6 +61,111 @@ source_set_selfpipe (struct source *s, int pipe_read_fd)
 	}
 }
 
+void
+source_set_max_frame_size (struct source *s, unsigned int max_frame_size)
+{
+	// Zero means: use the grabber's default:
+	if (s != NULL) {
+		s->max_frame_size = max_frame_size;
+	}
+}
+
+unsigned int
+source_get_max_frame_size (const struct source *const s)
+{
+	return s->max_frame_size;
+}
+
+void
+source_set_io_uring (struct source *s, bool enable)
+{
+	// Takes effect from the first read after opening:
+	if (s != NULL) {
+		s->use_io_uring = enable;
+	}
+}
+
+void
+source_set_mmap (struct source *s, bool enable)
+{
+	// Takes effect from the next open:
+	if (s != NULL) {
+		s->use_mmap = enable;
+	}
+}
+
+struct slab *
+source_get_map (const struct source *const s)
+{
+	return s->map;
+}
+
+void
+source_set_pace (struct source *s, unsigned int interval_usec, bool original_timing, double speed)
+{
+	if (s != NULL) {
+		s->pace_usec = interval_usec;
+		s->pace_original = original_timing;
+		s->pace_speed = (speed > 0.0) ? speed : 1.0;
+	}
+}
+
+bool
+source_get_pace (const struct source *const s, unsigned int *interval_usec, bool *original_timing, double *speed)
+{
+	*interval_usec = s->pace_usec;
+	*original_timing = s->pace_original;
+	*speed = s->pace_speed;
+	return (s->pace_usec > 0 || s->pace_original);
+}
+
+void
+source_set_fast_decode (struct source *s, bool enable)
+{
+	if (s != NULL) {
+		s->fast_decode = enable;
+	}
+}
+
+bool
+source_get_fast_decode (const struct source *const s)
+{
+	return s->fast_decode;
+}
+
+void
+source_release_io (struct source *s)
+{
+	// Called by the source's close function, before closing
+	// the descriptor; stops any reads still in flight. Frames
+	// may still refer to the mapping, which stays until the
+	// last of them is gone:
+	slab_unref(&s->map);
+#ifdef HAVE_IO_URING
+	uring_destroy(&s->uring);
+#endif
+}
+
+#ifdef HAVE_IO_URING
+static bool
+io_uring_ready (struct source *s)
+{
+	if (s->uring != NULL) {
+		return true;
+	}
+	if (!s->use_io_uring) {
+		return false;
+	}
+	// Set up on first read; fall back to select() if not possible:
+	if ((s->uring = uring_create(s->fd)) == NULL) {
+		log_info("%s: io_uring not available, using select()\n", s->name);
+		s->use_io_uring = false;
+		return false;
+	}
+	return true;
+}
+#endif
+
 ssize_t
 source_read (struct source *s, void *buf, size_t bufsize)
 {
@@ -53,6 +174,18 @@ source_read (struct source *s, void *buf, size_t bufsize)
 	struct timeval timeout;
 	ssize_t nread;
 
+#ifdef HAVE_IO_URING
+	if (io_uring_ready(s)) {
+		if ((nread = uring_read(s->uring, buf, bufsize, READ_TIMEOUT_SEC, s->selfpipe_readfd)) >= 0 || errno != EOPNOTSUPP) {
+			return nread;
+		}
+		// Nothing was read yet, so carry on without:
+		log_info("%s: io_uring receive not supported, using select()\n", s->name);
+		uring_destroy(&s->uring);
+		s->use_io_uring = false;
+	}
+#endif
+
 	// FD_SET contains the source's file descriptor,
 	// and the selfpipe file descriptor for canceling a pending read:
 	FD_ZERO(&fdset);
@@ -64,7 +197,7 @@ source_read (struct source *s, void *buf, size_t bufsize)
 			fdmax = s->selfpipe_readfd + 1;
 		}
 	}
-	timeout.tv_sec = 10;
+	timeout.tv_sec = READ_TIMEOUT_SEC;
 	timeout.tv_usec = 0;
 
 	while ((available = select(fdmax, &fdset, NULL, NULL, &timeout)) == -1 && errno == EINTR) {
@@ -91,6 +224,41 @@ source_read (struct source *s, void *buf, size_t bufsize)
 	return nread;
 }
 
+ssize_t
+source_read_min (struct source *s, void *buf, size_t bufsize, size_t minsize)
+{
+	ssize_t nread;
+	size_t total = 0;
+
+	// Keep reading till at least minsize bytes are in. Like recv() with
+	// MSG_WAITALL, but still honoring the timeout and the self-pipe.
+	// Returns a short count only on end of file or error:
+	while (total < minsize) {
+		if ((nread = source_read(s, (char *)buf + total, bufsize - total)) <= 0) {
+			return (total > 0) ? (ssize_t)total : nread;
+		}
+		total += nread;
+	}
+	return total;
+}
+
+ssize_t
+source_read_nowait (struct source *s, void *buf, size_t bufsize)
+{
+	ssize_t nread;
+
+	// For callers that wait for readability themselves, such as an
+	// event loop. Leaves errno at EAGAIN if no data is available on
+	// a nonblocking descriptor:
+	while ((nread = read(s->fd, buf, bufsize)) < 0 && errno == EINTR) {
+		continue;
+	}
+	if (nread < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
+		log_error("Read error: %s\n", strerror(errno));
+	}
+	return nread;
+}
+
 const char *
 source_get_name (struct source *const s)
 {
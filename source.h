@@ -1,10 +1,36 @@
+struct uring;
+struct slab;
+
+// Progress of an open in steps, see below:
+enum source_open_status
+{ SOURCE_OPEN_DONE
+, SOURCE_OPEN_PENDING
+, SOURCE_OPEN_FAILED
+};
+
 struct source {
 	char *name;
 	bool (*open)(struct source *);
+	// Optional: open in steps, for event loops. The prepare step may
+	// block (a name lookup), so call it off the loop thread. The other
+	// step does not block, and keeps its own deadlines; while it returns
+	// pending, call it again once wait_fd is readable or wait_msec has
+	// passed, whichever comes first. Close gives up on the open:
+	bool (*open_prepare)(struct source *);
+	enum source_open_status (*open_nowait)(struct source *, int *wait_fd, int *wait_msec);
 	void (*close)(struct source *);
 	void (*destroy)(struct source **);
 	int  fd;
 	int  selfpipe_readfd;
+	unsigned int max_frame_size;
+	bool use_io_uring;
+	struct uring *uring;
+	bool use_mmap;
+	struct slab *map;	// the whole file, when mapped into memory;
+	unsigned int pace_usec;	// interval between frames when paced;
+	bool pace_original;	// pace at the recorded capture times;
+	double pace_speed;
+	bool fast_decode;	// decode for speed over quality when viewed;
 };
 
 bool source_init (
@@ -16,5 +42,31 @@ bool source_init (
 
 void source_deinit (struct source *);
 void source_set_selfpipe (struct source *, int pipe_read_fd);
+void source_set_max_frame_size (struct source *, unsigned int);
+unsigned int source_get_max_frame_size (const struct source *const);
+void source_set_io_uring (struct source *, bool);
+
+// Ask a file source to map the whole file into memory when it is opened,
+// instead of reading it. The grabber then parses the mapping in place;
+// sources that can not be mapped are read as usual:
+void source_set_mmap (struct source *, bool);
+struct slab *source_get_map (const struct source *const);
+
+// Play the frames one per interval, or at the capture times recorded in
+// the stream, where it has them; sped up by a factor. Zero interval and
+// no original timing means as fast as possible. Returns false if so:
+void source_set_pace (struct source *, unsigned int interval_usec, bool original_timing, double speed);
+bool source_get_pace (const struct source *const, unsigned int *interval_usec, bool *original_timing, double *speed);
+
+// Whether a viewer should decode this source with the fast profile:
+void source_set_fast_decode (struct source *, bool);
+bool source_get_fast_decode (const struct source *const);
+
+void source_release_io (struct source *);
 ssize_t source_read (struct source *, void *buf, size_t bufsize);
+ssize_t source_read_min (struct source *, void *buf, size_t bufsize, size_t minsize);
+
+// Plain read for event loops. Does not go through io_uring, so do not mix
+// with the calls above on the same open source:
+ssize_t source_read_nowait (struct source *, void *buf, size_t bufsize);
 const char *source_get_name (struct source *const);
@@ -4,16 +4,41 @@
 #include <unistd.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
 #include <fcntl.h>
 
+#include "mjv_log.h"
+#include "slab.h"
 #include "source.h"
 
 struct source_file {
 	struct source source;
 	char *path;
-	int usec;
 };
 
+static void
+map_file (struct source *s)
+{
+	struct stat st;
+
+	// Only regular files of nonzero size can be mapped;
+	// anything else is read as usual:
+	if (fstat(s->fd, &st) < 0 || !S_ISREG(st.st_mode) || st.st_size == 0) {
+		log_info("%s: cannot map file, reading it instead\n", s->name);
+		return;
+	}
+	if ((s->map = slab_create_mapped(s->fd, st.st_size)) == NULL) {
+		log_info("%s: cannot map file, reading it instead\n", s->name);
+		return;
+	}
+	// The file is parsed front to back, once. Ask for aggressive
+	// readahead, and for huge pages where the filesystem has them:
+	madvise(slab_data(s->map), st.st_size, MADV_SEQUENTIAL);
+#ifdef MADV_HUGEPAGE
+	madvise(slab_data(s->map), st.st_size, MADV_HUGEPAGE);
+#endif
+}
+
 static bool
 open_file (struct source *s)
 {
@@ -25,12 +50,18 @@ open_file (struct source *s)
 	if ((s->fd = open(sf->path, O_RDONLY)) < 0) {
 		return false;
 	}
+	// Keep the descriptor open even when mapped,
+	// so that it can still be polled:
+	if (s->use_mmap) {
+		map_file(s);
+	}
 	return true;
 }
 
 static void
 close_file (struct source *s)
 {
+	source_release_io(s);
 	if (s->fd >= 0) {
 		close(s->fd);
 		s->fd = -1;
@@ -69,7 +100,7 @@ source_file_create (const char *const name, const char *const path, const int us
 		goto err2;
 	}
 	sf->source.fd = -1;
-	sf->usec = usec;
+	source_set_pace(&sf->source, (usec > 0) ? usec : 0, false, 1.0);
 	return &sf->source;
 
 err2:	source_deinit(&sf->source);
@@ -3,10 +3,18 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <time.h>
 #include <netdb.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
 
 #include "mjv_log.h"
 #include "source.h"
+#include "source_network.h"
+#include "dnscache.h"
 
 static char err_write_failed[] = "Write failed\n";
 static char err_malloc_failed[] = "malloc() failed\n";
@@ -37,6 +45,19 @@ struct source_network {
 	char *user;
 	char *pass;
 	int   port;
+	char  port_str[6];
+	struct dnscache_addr *addrs;	// looked up by the last prepare;
+	unsigned int n_addrs;
+	unsigned int next_addr;
+
+	// Connect attempts in flight, raced against each other:
+	bool  connecting;
+	int   attempt_fd[SOURCE_NETWORK_MAX_ATTEMPTS];
+	long  attempt_deadline[SOURCE_NETWORK_MAX_ATTEMPTS];
+	unsigned int n_attempts;
+	long  connect_start;
+	long  next_start;	// of the next attempt;
+	int   attempt_epfd;	// readable when an attempt is done;
 };
 
 static void
@@ -155,16 +176,62 @@ err:	free(buffer);
 	return ret;
 }
 
+static long
+now_msec (void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000L + ts.tv_nsec / 1000000L;
+}
+
+static void
+interleave_families (struct dnscache_addr *addrs, unsigned int n)
+{
+	struct dnscache_addr sorted[n];
+	int first = addrs[0].family;
+	unsigned int i = 0, j = 0, k = 0;
+
+	// Alternate between address families, starting with the resolver's
+	// first choice, so that a broken IPv6 or IPv4 path costs at most one
+	// head start. Within a family, keep the resolver's order:
+	while (k < n) {
+		while (i < n && addrs[i].family != first) {
+			i++;
+		}
+		if (i < n) {
+			sorted[k++] = addrs[i++];
+		}
+		while (j < n && addrs[j].family == first) {
+			j++;
+		}
+		if (j < n) {
+			sorted[k++] = addrs[j++];
+		}
+	}
+	memcpy(addrs, sorted, n * sizeof(*addrs));
+}
+
+static int
+start_attempt (const struct dnscache_addr *a)
+{
+	int fd;
+
+	if ((fd = socket(a->family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, IPPROTO_TCP)) < 0) {
+		return -1;
+	}
+	if (connect(fd, (const struct sockaddr *)&a->addr, a->addrlen) == 0 || errno == EINPROGRESS) {
+		return fd;
+	}
+	close(fd);
+	return -1;
+}
+
 static bool
-open_network (struct source *s)
+prepare_network (struct source *s)
 {
 	struct source_network *sn = (struct source_network *)s;
 
-	char port_str[6];
-	struct addrinfo hints;
-	struct addrinfo *result;
-	struct addrinfo *rp;
-
 	// Validate port:
 	if (sn->port < 0 || sn->port > 65535) {
 		log_error("Invalid port: %d\n", sn->port);
@@ -175,41 +242,204 @@ open_network (struct source *s)
 		log_error("No host\n");
 		return false;
 	}
-	memset(&hints, 0, sizeof(struct addrinfo));
-	hints.ai_family = AF_UNSPEC;
-	hints.ai_socktype = SOCK_STREAM;
-	hints.ai_flags = 0;
-	hints.ai_protocol = IPPROTO_TCP;
-
-	// The second argument of getaddrinfo() is the port number
-	// as a string, so snprintf it:
-	snprintf(port_str, sizeof(port_str), "%u", sn->port);
-	if (getaddrinfo(sn->host, port_str, &hints, &result) != 0) {
-		log_error("getaddrinfo()");
+	// Forget the previous lookup:
+	free(sn->addrs);
+	sn->addrs = NULL;
+	sn->n_addrs = 0;
+	sn->next_addr = 0;
+
+	// The port number is looked up as a string, so snprintf it:
+	snprintf(sn->port_str, sizeof(sn->port_str), "%u", sn->port);
+	if ((sn->n_addrs = dnscache_lookup(sn->host, sn->port_str, &sn->addrs)) == 0) {
 		return false;
 	}
-	// Loop over results, trying them all till we find a descriptor
-	// that works:
-	for (rp = result; rp != NULL; rp = rp->ai_next) {
-		if ((s->fd = socket(rp->ai_family, rp->ai_socktype, rp->ai_protocol)) < 0) {
+	interleave_families(sn->addrs, sn->n_addrs);
+	return true;
+}
+
+static void
+connect_failed (struct source_network *sn)
+{
+	// Look the host up again next time:
+	dnscache_expire(sn->host, sn->port_str);
+	log_error("%s: could not connect to %s\n", sn->source.name, sn->host);
+}
+
+static int
+connect_status (int fd)
+{
+	struct sockaddr_storage peer;
+	socklen_t peerlen = sizeof(peer);
+	int err = 0;
+	socklen_t len = sizeof(err);
+
+	// Returns 1 if connected, 0 if still connecting, -1 if failed.
+	// Writability alone is not proof, the event may be stale:
+	if (getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &len) < 0 || err != 0) {
+		return -1;
+	}
+	if (getpeername(fd, (struct sockaddr *)&peer, &peerlen) == 0) {
+		return 1;
+	}
+	return (errno == ENOTCONN) ? 0 : -1;
+}
+
+static void
+stop_connecting (struct source_network *sn)
+{
+	// Closing the descriptors also removes them from the epoll set:
+	for (unsigned int i = 0; i < sn->n_attempts; i++) {
+		close(sn->attempt_fd[i]);
+	}
+	if (sn->connecting) {
+		close(sn->attempt_epfd);
+	}
+	sn->n_attempts = 0;
+	sn->connecting = false;
+}
+
+static bool
+start_next_attempt (struct source_network *sn, long now)
+{
+	struct epoll_event ev;
+	int fd;
+
+	// Returns true if an attempt was started:
+	while (sn->next_addr < sn->n_addrs && sn->next_addr < SOURCE_NETWORK_MAX_ATTEMPTS) {
+		if ((fd = start_attempt(&sn->addrs[sn->next_addr++])) < 0) {
+			continue;
+		}
+		ev.events = EPOLLOUT;
+		ev.data.fd = fd;
+		if (epoll_ctl(sn->attempt_epfd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+			close(fd);
+			continue;
+		}
+		sn->attempt_fd[sn->n_attempts] = fd;
+		sn->attempt_deadline[sn->n_attempts++] = now + SOURCE_NETWORK_ATTEMPT_TIMEOUT;
+		sn->next_start = now + SOURCE_NETWORK_HEAD_START;
+		return true;
+	}
+	return false;
+}
+
+static enum source_open_status
+open_network_nowait (struct source *s, int *wait_fd, int *wait_msec)
+{
+	struct source_network *sn = (struct source_network *)s;
+	long now = now_msec();
+	long wait;
+
+	if (!sn->connecting) {
+		if ((sn->attempt_epfd = epoll_create1(EPOLL_CLOEXEC)) < 0) {
+			log_error("epoll_create1: %s\n", strerror(errno));
+			return SOURCE_OPEN_FAILED;
+		}
+		sn->connecting = true;
+		sn->connect_start = now;
+		sn->next_start = now;
+	}
+	// See how the attempts in flight are doing:
+	for (unsigned int i = 0; i < sn->n_attempts; i++) {
+		int status = connect_status(sn->attempt_fd[i]);
+
+		if (status == 0 && now < sn->attempt_deadline[i]) {
 			continue;
 		}
-		if (connect(s->fd, rp->ai_addr, rp->ai_addrlen) >= 0) {
-			break;
+		// The first to connect wins:
+		if (status == 1) {
+			s->fd = sn->attempt_fd[i];
+			sn->attempt_fd[i] = sn->attempt_fd[--sn->n_attempts];
+			stop_connecting(sn);
+			if (!write_http_request(sn)) {
+				close(s->fd);
+				s->fd = -1;
+				return SOURCE_OPEN_FAILED;
+			}
+			return SOURCE_OPEN_DONE;
 		}
-		close(s->fd);
+		// Failed or timed out; give the next address a go:
+		close(sn->attempt_fd[i]);
+		sn->n_attempts--;
+		sn->attempt_fd[i] = sn->attempt_fd[sn->n_attempts];
+		sn->attempt_deadline[i] = sn->attempt_deadline[sn->n_attempts];
+		sn->next_start = now;
+		i--;
 	}
-	freeaddrinfo(result);
-	if (rp == NULL) {
-		s->fd = -1;
+	if (now - sn->connect_start >= SOURCE_NETWORK_CONNECT_TIMEOUT) {
+		log_error("Connect timeout\n");
+		goto fail;
+	}
+	// Start the next attempt when due, or right away if
+	// nothing else is in flight:
+	if (sn->n_attempts == 0 || now >= sn->next_start) {
+		start_next_attempt(sn, now);
+	}
+	if (sn->n_attempts == 0) {
+		goto fail;
+	}
+	// Call again when an attempt is done, or at the earliest deadline:
+	wait = sn->connect_start + SOURCE_NETWORK_CONNECT_TIMEOUT;
+	if (sn->next_addr < sn->n_addrs && sn->next_addr < SOURCE_NETWORK_MAX_ATTEMPTS && sn->next_start < wait) {
+		wait = sn->next_start;
+	}
+	for (unsigned int i = 0; i < sn->n_attempts; i++) {
+		if (sn->attempt_deadline[i] < wait) {
+			wait = sn->attempt_deadline[i];
+		}
+	}
+	*wait_fd = sn->attempt_epfd;
+	*wait_msec = (wait > now) ? wait - now : 0;
+	return SOURCE_OPEN_PENDING;
+
+fail:	stop_connecting(sn);
+	connect_failed(sn);
+	return SOURCE_OPEN_FAILED;
+}
+
+static bool
+open_network (struct source *s)
+{
+	struct source_network *sn = (struct source_network *)s;
+	enum source_open_status status;
+	struct pollfd pfd[2];
+	int wait_msec;
+	int flags;
+
+	if (!prepare_network(s)) {
 		return false;
 	}
-	return write_http_request(sn);
+	// Race the addresses; the self-pipe cancels a pending connect:
+	pfd[1].fd = s->selfpipe_readfd;
+	pfd[1].events = POLLIN;
+	pfd[1].revents = 0;
+
+	while ((status = open_network_nowait(s, &pfd[0].fd, &wait_msec)) == SOURCE_OPEN_PENDING) {
+		pfd[0].events = POLLIN;
+		if (poll(pfd, (s->selfpipe_readfd >= 0) ? 2 : 1, wait_msec) < 0 && errno != EINTR) {
+			stop_connecting(sn);
+			return false;
+		}
+		if (pfd[1].revents) {
+			stop_connecting(sn);
+			return false;
+		}
+	}
+	if (status != SOURCE_OPEN_DONE) {
+		return false;
+	}
+	// The rest of the code expects a blocking socket:
+	if ((flags = fcntl(s->fd, F_GETFL)) >= 0) {
+		fcntl(s->fd, F_SETFL, flags & ~O_NONBLOCK);
+	}
+	return true;
 }
 
 static void
 close_network (struct source *s)
 {
+	stop_connecting((struct source_network *)s);
+	source_release_io(s);
 	if (s->fd >= 0) {
 		close(s->fd);
 		s->fd = -1;
@@ -224,6 +454,7 @@ source_network_destroy (struct source **s)
 	if (sn == NULL || *sn == NULL) {
 		return;
 	}
+	free((*sn)->addrs);
 	free((*sn)->pass);
 	free((*sn)->user);
 	free((*sn)->path);
@@ -252,10 +483,17 @@ source_network_create (
 	if (source_init(&sn->source, name, open_network, close_network, source_network_destroy) == false) {
 		goto err1;
 	}
+	sn->source.open_prepare = prepare_network;
+	sn->source.open_nowait = open_network_nowait;
 	sn->host = NULL;
 	sn->path = NULL;
 	sn->user = NULL;
 	sn->pass = NULL;
+	sn->addrs = NULL;
+	sn->n_addrs = 0;
+	sn->next_addr = 0;
+	sn->connecting = false;
+	sn->n_attempts = 0;
 
 	// Copy strings:
 	if (host != NULL && (sn->host = strdup(host)) == NULL) {
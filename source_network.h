@@ -1,3 +1,15 @@
+#ifndef SOURCE_NETWORK_H
+#define SOURCE_NETWORK_H
+
+// Connection deadlines, in milliseconds, for both the blocking open and
+// the open in steps. A new address is tried when the previous ones have
+// not connected within the head start, without giving up on them; the
+// first to connect wins:
+#define SOURCE_NETWORK_CONNECT_TIMEOUT	10000
+#define SOURCE_NETWORK_ATTEMPT_TIMEOUT	3000
+#define SOURCE_NETWORK_HEAD_START	250
+#define SOURCE_NETWORK_MAX_ATTEMPTS	8
+
 struct source *source_network_create (
 	const char *const name,
 	const char *const host,
@@ -5,3 +17,5 @@ struct source *source_network_create (
 	const char *const user,
 	const char *const pass,
 	const int port);
+
+#endif	// SOURCE_NETWORK_H
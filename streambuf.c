@@ -0,0 +1,276 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "mjv_log.h"
+#include "slab.h"
+#include "streambuf.h"
+
+struct streambuf {
+	enum streambuf_type type;
+	char *base;
+	size_t size;
+	struct slab *slab;
+};
+
+static unsigned int
+round_to_pages (unsigned int size)
+{
+	unsigned long pagesize = sysconf(_SC_PAGESIZE);
+
+	return (size + pagesize - 1) / pagesize * pagesize;
+}
+
+static char *
+mirror_map (unsigned int size)
+{
+	int fd;
+	char *base;
+
+	// Back the buffer with an anonymous file:
+	if ((fd = memfd_create("streambuf", MFD_CLOEXEC)) < 0) {
+		return NULL;
+	}
+	if (ftruncate(fd, size) < 0) {
+		goto err0;
+	}
+	// Reserve address space for two copies, then map the file
+	// into both halves:
+	if ((base = mmap(NULL, 2UL * size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0)) == MAP_FAILED) {
+		goto err0;
+	}
+	if (mmap(base, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED) {
+		goto err1;
+	}
+	if (mmap(base + size, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED) {
+		goto err1;
+	}
+	// The mappings keep the file alive:
+	close(fd);
+	return base;
+
+err1:	munmap(base, 2UL * size);
+err0:	close(fd);
+	return NULL;
+}
+
+static bool
+alloc_buf (struct streambuf *sb, unsigned int size, enum streambuf_type type)
+{
+	// Try the mirrored buffer first if requested,
+	// and fall back to a flat buffer if that fails:
+	if (type == STREAMBUF_MIRRORED) {
+		unsigned int mirror_size = round_to_pages(size);
+		if ((sb->base = mirror_map(mirror_size)) != NULL) {
+			sb->type = STREAMBUF_MIRRORED;
+			sb->size = mirror_size;
+			return true;
+		}
+		log_debug("Could not create mirrored buffer, using flat buffer\n");
+	}
+	if (type == STREAMBUF_SLAB) {
+		if ((sb->slab = slab_create(size)) == NULL) {
+			return false;
+		}
+		sb->type = STREAMBUF_SLAB;
+		sb->base = slab_data(sb->slab);
+		sb->size = size;
+		return true;
+	}
+	if ((sb->base = malloc(size)) == NULL) {
+		return false;
+	}
+	sb->type = STREAMBUF_FLAT;
+	sb->size = size;
+	return true;
+}
+
+static void
+free_buf (struct streambuf *sb)
+{
+	switch (sb->type)
+	{
+		case STREAMBUF_MIRRORED:
+			munmap(sb->base, 2UL * sb->size);
+			break;
+
+		case STREAMBUF_SLAB:
+		case STREAMBUF_MAPPED:
+			// Others may still hold references:
+			slab_unref(&sb->slab);
+			break;
+
+		case STREAMBUF_FLAT:
+			free(sb->base);
+			break;
+	}
+	sb->base = NULL;
+}
+
+struct streambuf *
+streambuf_create (unsigned int size, enum streambuf_type type)
+{
+	struct streambuf *sb;
+
+	if ((sb = malloc(sizeof(*sb))) == NULL) {
+		return NULL;
+	}
+	sb->slab = NULL;
+	if (!alloc_buf(sb, size, type)) {
+		free(sb);
+		return NULL;
+	}
+	return sb;
+}
+
+struct streambuf *
+streambuf_create_mapped (struct slab *slab)
+{
+	struct streambuf *sb;
+
+	if ((sb = malloc(sizeof(*sb))) == NULL) {
+		return NULL;
+	}
+	sb->type = STREAMBUF_MAPPED;
+	sb->slab = slab_ref(slab);
+	sb->base = slab_data(slab);
+	sb->size = slab_size(slab);
+	return sb;
+}
+
+void
+streambuf_destroy (struct streambuf **sb)
+{
+	if (sb == NULL || *sb == NULL) {
+		return;
+	}
+	free_buf(*sb);
+	free(*sb);
+	*sb = NULL;
+}
+
+char *
+streambuf_base (const struct streambuf *const sb)
+{
+	return sb->base;
+}
+
+size_t
+streambuf_size (const struct streambuf *const sb)
+{
+	return sb->size;
+}
+
+enum streambuf_type
+streambuf_get_type (const struct streambuf *const sb)
+{
+	return sb->type;
+}
+
+struct slab *
+streambuf_get_slab (const struct streambuf *const sb)
+{
+	return sb->slab;
+}
+
+unsigned int
+streambuf_space (const struct streambuf *const sb, const char *keepfrom, const char *head)
+{
+	// In a mirrored buffer, the free space wraps around behind the
+	// bytes to keep; in a flat buffer, it ends at the end. A mapped
+	// buffer is full from the start:
+	if (sb->type == STREAMBUF_MAPPED) {
+		return 0;
+	}
+	return (sb->type == STREAMBUF_MIRRORED)
+		? (ptrdiff_t)sb->size - (head - keepfrom)
+		: sb->base + sb->size - head;
+}
+
+static ptrdiff_t
+move_to_start (struct streambuf *sb, char *keepfrom, char *head)
+{
+	struct slab *slab;
+	unsigned int used = head - keepfrom;
+
+	// Others may refer to the bytes in a shared slab;
+	// leave those alone and move to a fresh slab:
+	if (sb->type == STREAMBUF_SLAB && slab_is_shared(sb->slab)) {
+		if ((slab = slab_create(sb->size)) == NULL) {
+			return 0;
+		}
+		memcpy(slab_data(slab), keepfrom, used);
+		slab_unref(&sb->slab);
+		sb->slab = slab;
+		sb->base = slab_data(slab);
+		return sb->base - keepfrom;
+	}
+	memmove(sb->base, keepfrom, used);
+	return sb->base - keepfrom;
+}
+
+ptrdiff_t
+streambuf_compact (struct streambuf *sb, char *keepfrom, char *head)
+{
+	// A mapped buffer holds the whole file and stays put:
+	if (sb->type == STREAMBUF_MAPPED) {
+		return 0;
+	}
+	// If nothing to keep, and nobody else looking,
+	// rewind to the start of the buffer:
+	if (keepfrom == head && (sb->type != STREAMBUF_SLAB || !slab_is_shared(sb->slab))) {
+		return sb->base - head;
+	}
+	// In a mirrored buffer, once the window has moved into the second
+	// copy, shift it back by one buffer length. Same bytes, no copy:
+	if (sb->type == STREAMBUF_MIRRORED) {
+		return (keepfrom >= sb->base + sb->size) ? -(ptrdiff_t)sb->size : 0;
+	}
+	// In other buffers, only pay for a move when the free space
+	// at the end is getting scarce. In a shared slab, this also
+	// leaves the bytes that others refer to alone for as long
+	// as possible:
+	if (keepfrom == sb->base || streambuf_space(sb, keepfrom, head) >= sb->size / 4) {
+		return 0;
+	}
+	return move_to_start(sb, keepfrom, head);
+}
+
+ptrdiff_t
+streambuf_reserve (struct streambuf *sb, unsigned int space, char *keepfrom, char *head)
+{
+	// Nothing to do if there is room already, or if there can never be.
+	// A mirrored buffer always has all of its free space available:
+	if (streambuf_space(sb, keepfrom, head) >= space
+	 || (unsigned int)(head - keepfrom) + space > sb->size
+	 || sb->type == STREAMBUF_MIRRORED
+	 || sb->type == STREAMBUF_MAPPED) {
+		return 0;
+	}
+	return move_to_start(sb, keepfrom, head);
+}
+
+bool
+streambuf_resize (struct streambuf *sb, unsigned int size, char *keepfrom, char *head, ptrdiff_t *shift)
+{
+	struct streambuf old = *sb;
+	unsigned int used = head - keepfrom;
+
+	// Never cut off bytes that are still in use,
+	// and never reallocate a mapped file:
+	if (size < used || old.type == STREAMBUF_MAPPED) {
+		return false;
+	}
+	if (!alloc_buf(sb, size, old.type)) {
+		*sb = old;
+		return false;
+	}
+	// Copy the bytes to keep to the start of the new buffer:
+	memcpy(sb->base, keepfrom, used);
+	*shift = sb->base - keepfrom;
+	free_buf(&old);
+	return true;
+}
@@ -0,0 +1,55 @@
+#ifndef STREAMBUF_H
+#define STREAMBUF_H
+
+// A read buffer for a byte stream. The caller keeps its own pointers into
+// the buffer; functions that move the contents return the distance by
+// which the caller must shift those pointers.
+//
+// A flat buffer is a plain allocation that is compacted by moving the
+// bytes to keep back to the start. A mirrored buffer maps the same pages
+// twice, back to back, so that any window of up to 'size' bytes is
+// contiguous in memory and compaction never copies. A slab buffer is a
+// reference-counted slab; others may hold references to its bytes, so
+// instead of overwriting them, compaction moves on to a fresh slab. A
+// mapped buffer wraps a slab holding a whole file that is mapped into
+// memory. It is full from the start, can not be written to, and never
+// moves or releases its contents.
+
+enum streambuf_type
+{ STREAMBUF_FLAT
+, STREAMBUF_MIRRORED
+, STREAMBUF_SLAB
+, STREAMBUF_MAPPED
+};
+
+struct slab;
+struct streambuf;
+
+struct streambuf *streambuf_create (unsigned int size, enum streambuf_type type);
+void streambuf_destroy (struct streambuf **);
+
+// Wrap a mapped slab; takes a reference of its own:
+struct streambuf *streambuf_create_mapped (struct slab *);
+
+char *streambuf_base (const struct streambuf *const);
+size_t streambuf_size (const struct streambuf *const);
+enum streambuf_type streambuf_get_type (const struct streambuf *const);
+
+// The slab backing a slab or mapped buffer, or NULL for other types:
+struct slab *streambuf_get_slab (const struct streambuf *const);
+
+// Number of bytes that can be written at head, when the bytes
+// from keepfrom up to head must be preserved:
+unsigned int streambuf_space (const struct streambuf *const, const char *keepfrom, const char *head);
+
+// Release the bytes before keepfrom:
+ptrdiff_t streambuf_compact (struct streambuf *, char *keepfrom, char *head);
+
+// Make room for at least 'space' more bytes at head, if the buffer is
+// large enough, by moving the bytes from keepfrom up to head right away:
+ptrdiff_t streambuf_reserve (struct streambuf *, unsigned int space, char *keepfrom, char *head);
+
+// Change the buffer size, preserving the bytes from keepfrom up to head:
+bool streambuf_resize (struct streambuf *, unsigned int size, char *keepfrom, char *head, ptrdiff_t *shift);
+
+#endif	// STREAMBUF_H
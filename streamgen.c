@@ -0,0 +1,197 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "streamgen.h"
+
+// Smallest image that holds all the markers written below:
+#define MIN_IMAGE	64
+
+// Most junk bytes between two parts:
+#define MAX_GARBAGE	500
+
+// Boundaries are at most 70 characters, says RFC 2046:
+#define MAX_BOUNDARY	70
+
+// A small generator of our own rather than rand(),
+// whose sequence differs between C libraries (splitmix64):
+static uint64_t
+next_random (uint64_t *state)
+{
+	uint64_t z = (*state += 0x9E3779B97F4A7C15ULL);
+
+	z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+	z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+	return z ^ (z >> 31);
+}
+
+static unsigned int
+random_below (uint64_t *state, unsigned int n)
+{
+	return (n == 0) ? 0 : next_random(state) % n;
+}
+
+static inline bool
+random_pct (uint64_t *state, unsigned int pct)
+{
+	return random_below(state, 100) < pct;
+}
+
+void
+streamgen_defaults (struct streamgen_opts *opts)
+{
+	opts->seed = 1;
+	opts->frames = 1000;
+	opts->min_size = 10 * 1024;
+	opts->max_size = 200 * 1024;
+	opts->boundary_len = 16;
+	opts->lf = false;
+	opts->casing = STREAMGEN_CASING_UPPER;
+	opts->no_length_pct = 0;
+	opts->garbage_pct = 0;
+}
+
+static void
+make_boundary (uint64_t *state, char *boundary, unsigned int len)
+{
+	static const char chars[] =
+		"ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789";
+
+	for (unsigned int i = 0; i < len; i++) {
+		boundary[i] = chars[random_below(state, sizeof(chars) - 1)];
+	}
+	boundary[len] = '\0';
+}
+
+static void
+make_image (uint64_t *state, unsigned char *buf, unsigned int size, unsigned int framenum)
+{
+	static const unsigned char soi_app0[] = {
+		0xFF, 0xD8,
+		0xFF, 0xE0, 0x00, 0x10, 'J', 'F', 'I', 'F', 0x00,
+		0x01, 0x01, 0x00, 0x00, 0x01, 0x00, 0x01, 0x00, 0x00,
+	};
+	static const unsigned char sos[] = {
+		0xFF, 0xDA, 0x00, 0x08, 0x01, 0x01, 0x00, 0x00, 0x3F, 0x00,
+	};
+	unsigned int pos = 0;
+	uint64_t r = 0;
+	unsigned int bits = 0;
+
+	memcpy(buf + pos, soi_app0, sizeof(soi_app0));
+	pos += sizeof(soi_app0);
+
+	// A comment segment with the frame number, to tell frames apart:
+	buf[pos++] = 0xFF;
+	buf[pos++] = 0xFE;
+	buf[pos++] = 0x00;
+	buf[pos++] = 2 + 16;
+	pos += sprintf((char *)buf + pos, "frame %010u", framenum);
+
+	memcpy(buf + pos, sos, sizeof(sos));
+	pos += sizeof(sos);
+
+	// Random scan data. Like real scan data, any 0xFF is
+	// followed by a stuffed zero byte:
+	while (pos < size - 2) {
+		unsigned char c;
+
+		if (bits == 0) {
+			r = next_random(state);
+			bits = 64;
+		}
+		c = r & 0xFF;
+		r >>= 8;
+		bits -= 8;
+
+		if (c != 0xFF) {
+			buf[pos++] = c;
+		}
+		else if (pos + 2 <= size - 2) {
+			buf[pos++] = 0xFF;
+			buf[pos++] = 0x00;
+		}
+		else {
+			buf[pos++] = 0x00;
+		}
+	}
+	buf[pos++] = 0xFF;
+	buf[pos++] = 0xD9;
+}
+
+static size_t
+write_garbage (FILE *fp, uint64_t *state, const char *nl)
+{
+	// Anything but a dash, so that it cannot be taken for a boundary:
+	static const char chars[] =
+		"abcdefghijklmnopqrstuvwxyz0123456789 .:;\r\n";
+	unsigned int len = 1 + random_below(state, MAX_GARBAGE);
+
+	for (unsigned int i = 0; i < len; i++) {
+		fputc(chars[random_below(state, sizeof(chars) - 1)], fp);
+	}
+	return len + fprintf(fp, "%s", nl);
+}
+
+size_t
+streamgen_write (FILE *fp, const struct streamgen_opts *opts)
+{
+	const char *nl = opts->lf ? "\n" : "\r\n";
+	char boundary[MAX_BOUNDARY + 1];
+	unsigned int min_size = (opts->min_size < MIN_IMAGE) ? MIN_IMAGE : opts->min_size;
+	unsigned int max_size = (opts->max_size < min_size) ? min_size : opts->max_size;
+	unsigned int boundary_len = opts->boundary_len;
+	unsigned char *image;
+	uint64_t state = opts->seed;
+	size_t total = 0;
+	bool lower;
+
+	if (boundary_len < 1) {
+		boundary_len = 1;
+	}
+	if (boundary_len > MAX_BOUNDARY) {
+		boundary_len = MAX_BOUNDARY;
+	}
+	if ((image = malloc(max_size)) == NULL) {
+		return 0;
+	}
+	make_boundary(&state, boundary, boundary_len);
+
+	lower = (opts->casing == STREAMGEN_CASING_LOWER)
+		|| (opts->casing == STREAMGEN_CASING_MIXED && random_pct(&state, 50));
+
+	total += fprintf(fp, "HTTP/1.0 200 OK%s", nl);
+	total += fprintf(fp, "%s: multipart/x-mixed-replace; boundary=%s%s", lower ? "Content-type" : "Content-Type", boundary, nl);
+	total += fprintf(fp, "%s", nl);
+
+	for (unsigned int i = 0; i < opts->frames; i++) {
+		unsigned int size = min_size + random_below(&state, max_size - min_size + 1);
+
+		lower = (opts->casing == STREAMGEN_CASING_LOWER)
+			|| (opts->casing == STREAMGEN_CASING_MIXED && random_pct(&state, 50));
+
+		make_image(&state, image, size, i);
+
+		total += fprintf(fp, "--%s%s", boundary, nl);
+		total += fprintf(fp, "%s: image/jpeg%s", lower ? "Content-type" : "Content-Type", nl);
+		if (!random_pct(&state, opts->no_length_pct)) {
+			total += fprintf(fp, "%s: %u%s", lower ? "Content-length" : "Content-Length", size, nl);
+		}
+		total += fprintf(fp, "%s", nl);
+		total += fwrite(image, 1, size, fp);
+		total += fprintf(fp, "%s", nl);
+
+		if (random_pct(&state, opts->garbage_pct)) {
+			total += write_garbage(fp, &state, nl);
+		}
+	}
+	total += fprintf(fp, "--%s--%s", boundary, nl);
+	free(image);
+
+	if (fflush(fp) != 0 || ferror(fp)) {
+		return 0;
+	}
+	return total;
+}
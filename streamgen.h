@@ -0,0 +1,34 @@
+#ifndef STREAMGEN_H
+#define STREAMGEN_H
+
+// Generates made-up MJPEG streams, as a camera would send them, for use
+// as test and benchmark input. The output depends only on the options:
+// the same seed gives the same bytes on every machine and every build.
+// The images have a valid JPEG marker structure, so that the grabber can
+// walk them, but their scan data is random and does not decode.
+
+enum streamgen_casing
+{ STREAMGEN_CASING_UPPER	// "Content-Length", "Content-Type"
+, STREAMGEN_CASING_LOWER	// "Content-length", "Content-type"
+, STREAMGEN_CASING_MIXED	// either, at random for each part
+};
+
+struct streamgen_opts {
+	unsigned long seed;
+	unsigned int frames;
+	unsigned int min_size;		// of an image, in bytes;
+	unsigned int max_size;
+	unsigned int boundary_len;
+	bool lf;			// end lines with LF instead of CRLF;
+	enum streamgen_casing casing;
+	unsigned int no_length_pct;	// parts without a Content-Length;
+	unsigned int garbage_pct;	// parts followed by junk bytes;
+};
+
+void streamgen_defaults (struct streamgen_opts *);
+
+// Writes the HTTP header and all parts. Returns the number of bytes
+// written, or zero on error:
+size_t streamgen_write (FILE *, const struct streamgen_opts *);
+
+#endif	// STREAMGEN_H
@@ -0,0 +1,65 @@
+#include <stdio.h>
+
+#include "../backoff.c"
+
+static int
+test_growth (void)
+{
+	struct backoff *b;
+	unsigned int cap = 100;
+	int ret = 0;
+
+	if ((b = backoff_create(100, 5000)) == NULL) {
+		return 1;
+	}
+	// Each delay lies between half the cap and the cap,
+	// and the cap doubles up to the ceiling:
+	for (int i = 0; i < 20; i++) {
+		unsigned int delay = backoff_next(b);
+
+		if (delay < cap / 2 || delay > cap) {
+			printf("FAIL: attempt %d: delay %u outside [%u, %u]\n", i, delay, cap / 2, cap);
+			ret = 1;
+		}
+		cap = (cap * 2 > 5000) ? 5000 : cap * 2;
+	}
+	// After a reset, start from the bottom again:
+	backoff_reset(b);
+	if (backoff_next(b) > 100) {
+		printf("FAIL: no reset\n");
+		ret = 1;
+	}
+	backoff_destroy(&b);
+	return ret;
+}
+
+static int
+test_bounds (void)
+{
+	struct backoff *b;
+	int ret = 0;
+
+	// A ceiling below the floor is raised to the floor:
+	if ((b = backoff_create(300, 10)) == NULL) {
+		return 1;
+	}
+	for (int i = 0; i < 10; i++) {
+		if (backoff_next(b) > 300) {
+			printf("FAIL: delay above ceiling\n");
+			ret = 1;
+		}
+	}
+	backoff_destroy(&b);
+	return ret;
+}
+
+int
+main ()
+{
+	int ret = 0;
+
+	ret |= test_growth();
+	ret |= test_bounds();
+
+	return ret;
+}
@@ -0,0 +1,156 @@
+#include <stdio.h>
+
+#include "../memscan.c"
+#include "../boundary.c"
+
+struct testcase {
+	char *boundary;
+	char *haystack;
+	int expect;	// offset of first match, or -1
+};
+
+static struct testcase cases[] =
+{
+	{ .boundary = "myboundary"
+	, .haystack = "--myboundary\r\n"
+	, .expect = 2
+	}
+,	{ .boundary = "myboundary"
+	, .haystack = "myboundar myboundary"
+	, .expect = 10
+	}
+,	{ .boundary = "ab"
+	, .haystack = "aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaab"
+	, .expect = 48
+	}
+,	{ .boundary = "x"
+	, .haystack = "................................................x"
+	, .expect = 48
+	}
+,	{ .boundary = "--xyzzy"
+	, .haystack = "--xyz--xyzz-----------------------------------------------------xyzzy"
+	, .expect = 62
+	}
+,	{ .boundary = "boundary"
+	, .haystack = "................................................................boundar"
+	, .expect = -1
+	}
+,	{ .boundary = "boundary"
+	, .haystack = ""
+	, .expect = -1
+	}
+};
+
+static int
+test_engine (enum memscan_engine e)
+{
+	int ret = 0;
+
+	if (!memscan_set_engine(e)) {
+		printf("Skipping unsupported engine %s\n", memscan_engine_name(e));
+		return 0;
+	}
+	for (unsigned int i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+		struct boundary *b;
+		const char *h = cases[i].haystack;
+		const char *match;
+		int found;
+
+		if ((b = boundary_create(cases[i].boundary, strlen(cases[i].boundary))) == NULL) {
+			printf("FAIL: could not create boundary\n");
+			return 1;
+		}
+		match = boundary_find(b, h, h + strlen(h));
+		found = (match == NULL) ? -1 : match - h;
+		if (found != cases[i].expect) {
+			printf("FAIL (%s): case %u: expected %d, got %d\n", memscan_engine_name(e), i, cases[i].expect, found);
+			ret = 1;
+		}
+		boundary_destroy(&b);
+	}
+	return ret;
+}
+
+static int
+test_pair (enum memscan_engine e)
+{
+	char buf[200];
+	int ret = 0;
+
+	if (!memscan_set_engine(e)) {
+		return 0;
+	}
+	// Place an 0xFFD9 pair at every offset, preceded by lone 0xFF's:
+	for (unsigned int pos = 0; pos < sizeof(buf) - 1; pos++) {
+		const char *match;
+
+		memset(buf, 0xff, pos);
+		memset(buf + pos, 0x00, sizeof(buf) - pos);
+		buf[pos] = (char)0xff;
+		buf[pos + 1] = (char)0xd9;
+
+		match = memscan_pair(buf, buf + sizeof(buf), (char)0xff, (char)0xd9, 1);
+		if (match != buf + pos) {
+			printf("FAIL (%s): pair at %u not found\n", memscan_engine_name(e), pos);
+			ret = 1;
+		}
+		// The pair must not be found if the range cuts it in half:
+		if (memscan_pair(buf, buf + pos + 1, (char)0xff, (char)0xd9, 1) != NULL) {
+			printf("FAIL (%s): pair at %u found past end\n", memscan_engine_name(e), pos);
+			ret = 1;
+		}
+	}
+	return ret;
+}
+
+static int
+test_marker (enum memscan_engine e)
+{
+	char buf[200];
+	int ret = 0;
+
+	if (!memscan_set_engine(e)) {
+		return 0;
+	}
+	// Place a marker at every offset, preceded by
+	// stuffed zeros and restart markers:
+	for (unsigned int pos = 0; pos < sizeof(buf) - 1; pos++) {
+		for (unsigned int i = 0; i < pos; i++) {
+			buf[i] = (i % 2) ? ((i % 4 == 1) ? 0x00 : (char)(0xd0 + i % 8)) : (char)0xff;
+		}
+		memset(buf + (pos & ~1U), 0x12, sizeof(buf) - (pos & ~1U));
+		buf[pos] = (char)0xff;
+		buf[pos + 1] = (char)0xc4;
+
+		if (memscan_marker(buf, buf + sizeof(buf)) != buf + pos) {
+			printf("FAIL (%s): marker at %u not found\n", memscan_engine_name(e), pos);
+			ret = 1;
+		}
+		// Nor when the range cuts it in half:
+		if (memscan_marker(buf, buf + pos + 1) != NULL) {
+			printf("FAIL (%s): marker at %u found past end\n", memscan_engine_name(e), pos);
+			ret = 1;
+		}
+	}
+	return ret;
+}
+
+int
+main ()
+{
+	int ret = 0;
+
+	ret |= test_engine(MEMSCAN_SCALAR);
+	ret |= test_engine(MEMSCAN_SSE2);
+	ret |= test_engine(MEMSCAN_AVX2);
+
+	ret |= test_pair(MEMSCAN_SCALAR);
+	ret |= test_pair(MEMSCAN_SSE2);
+	ret |= test_pair(MEMSCAN_AVX2);
+
+	ret |= test_marker(MEMSCAN_SCALAR);
+	ret |= test_marker(MEMSCAN_SSE2);
+	ret |= test_marker(MEMSCAN_AVX2);
+
+	return ret;
+}
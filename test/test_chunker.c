@@ -0,0 +1,126 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "../frame.h"
+#include "../slab.h"
+#include "../mjv_grabber.h"
+#include "../chunker.h"
+
+#define N_FRAMES	200
+#define FAKE_FRAME	77
+
+static unsigned int got[N_FRAMES + 2];
+static unsigned int n_got;
+static pthread_mutex_t got_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void
+put_part (FILE *fp, unsigned int id, const char *extra)
+{
+	char image[2000];
+	unsigned int len;
+
+	// A fake image that carries its number, padded to a varying size:
+	len = sprintf(image, "\xff\xd8%06u", id);
+	len += sprintf(image + len, "%s", extra);
+	while (len < 200 + (id * 37) % 1500) {
+		image[len++] = 'x';
+	}
+	image[len++] = (char)0xff;
+	image[len++] = (char)0xd9;
+
+	fprintf(fp, "--bndry\r\nContent-Type: image/jpeg\r\nContent-Length: %u\r\n\r\n", len);
+	fwrite(image, len, 1, fp);
+	fprintf(fp, "\r\n");
+}
+
+static struct slab *
+make_stream (void)
+{
+	char path[] = "/tmp/test_chunker_XXXXXX";
+	struct slab *map;
+	FILE *fp;
+	int fd;
+
+	if ((fd = mkstemp(path)) < 0) {
+		return NULL;
+	}
+	unlink(path);
+	fp = fdopen(fd, "w+");
+	fprintf(fp, "HTTP/1.0 200 OK\r\nContent-Type: multipart/x-mixed-replace; boundary=bndry\r\n\r\n");
+	for (unsigned int i = 0; i < N_FRAMES; i++) {
+		// One image contains what looks like a whole part,
+		// to trip up a search starting in its middle:
+		put_part(fp, i, (i == FAKE_FRAME)
+			? "\r\n--bndry\r\nContent-Type: image/jpeg\r\nContent-Length: 12\r\n\r\n\xff\xd8" "999999\xff\xd9\r\n"
+			: "");
+	}
+	fflush(fp);
+	map = slab_create_mapped(fd, ftell(fp));
+	fclose(fp);
+	return map;
+}
+
+static void
+got_frame (struct frame *f, unsigned long framenum, void *user_pointer)
+{
+	(void)user_pointer;
+
+	pthread_mutex_lock(&got_lock);
+	if (framenum >= 1 && framenum <= N_FRAMES + 1) {
+		got[framenum - 1] = atoi((char *)frame_get_rawbits(f) + 2);
+	}
+	n_got++;
+	pthread_mutex_unlock(&got_lock);
+	frame_destroy(&f);
+}
+
+static int
+test_split (struct slab *map, unsigned int n_workers)
+{
+	struct mjv_grabber_stats stats;
+	enum mjv_grabber_status status;
+
+	memset(got, 0xff, sizeof(got));
+	n_got = 0;
+
+	if ((status = chunker_run(map, n_workers, got_frame, NULL, &stats)) != MJV_GRABBER_SUCCESS) {
+		printf("FAIL: %u workers: status %d\n", n_workers, status);
+		return 1;
+	}
+	if (n_got != N_FRAMES || stats.frames != N_FRAMES) {
+		printf("FAIL: %u workers: got %u frames, stats say %lu, expected %u\n", n_workers, n_got, stats.frames, N_FRAMES);
+		return 1;
+	}
+	// All frames, in order, numbered from one:
+	for (unsigned int i = 0; i < N_FRAMES; i++) {
+		if (got[i] != i) {
+			printf("FAIL: %u workers: frame %u is image %u\n", n_workers, i + 1, got[i]);
+			return 1;
+		}
+	}
+	return 0;
+}
+
+int
+main ()
+{
+	struct slab *map;
+	int ret = 0;
+
+	if ((map = make_stream()) == NULL) {
+		printf("FAIL: could not create stream\n");
+		return 1;
+	}
+	for (unsigned int n = 1; n <= 64; n++) {
+		ret |= test_split(map, n);
+	}
+	ret |= test_split(map, 1000);
+
+	slab_unref(&map);
+	return ret;
+}
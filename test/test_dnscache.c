@@ -0,0 +1,116 @@
+#include <stdio.h>
+
+#include "../mjv_log.c"
+#include "../dnscache.c"
+
+#define N_THREADS	8
+
+static unsigned int results[N_THREADS];
+
+static int
+test_lookup (void)
+{
+	struct dnscache_addr *a;
+	struct dnscache_addr *b;
+	unsigned int na, nb;
+	int ret = 0;
+
+	if ((na = dnscache_lookup("127.0.0.1", "80", &a)) == 0) {
+		printf("FAIL: could not look up 127.0.0.1\n");
+		return 1;
+	}
+	if (a[0].family != AF_INET) {
+		printf("FAIL: wrong family\n");
+		ret = 1;
+	}
+	// The second lookup comes from the cache, and is a separate copy:
+	if ((nb = dnscache_lookup("127.0.0.1", "80", &b)) != na || b == a) {
+		printf("FAIL: cached lookup differs\n");
+		ret = 1;
+	}
+	else if (memcmp(a, b, na * sizeof(*a)) != 0) {
+		printf("FAIL: cached addresses differ\n");
+		ret = 1;
+	}
+	free(b);
+
+	// After expiry, the name is resolved again:
+	dnscache_expire("127.0.0.1", "80");
+	if ((nb = dnscache_lookup("127.0.0.1", "80", &b)) != na) {
+		printf("FAIL: lookup after expiry differs\n");
+		ret = 1;
+	}
+	free(b);
+	free(a);
+	return ret;
+}
+
+static int
+test_ports (void)
+{
+	struct dnscache_addr *a;
+	struct dnscache_addr *b;
+	int ret = 0;
+
+	// Different ports are different entries:
+	if (dnscache_lookup("127.0.0.1", "80", &a) == 0) {
+		return 1;
+	}
+	if (dnscache_lookup("127.0.0.1", "8080", &b) == 0) {
+		free(a);
+		return 1;
+	}
+	if (((struct sockaddr_in *)&a->addr)->sin_port == ((struct sockaddr_in *)&b->addr)->sin_port) {
+		printf("FAIL: ports not kept apart\n");
+		ret = 1;
+	}
+	free(b);
+	free(a);
+	return ret;
+}
+
+static void *
+lookup_thread (void *data)
+{
+	struct dnscache_addr *a;
+	unsigned int *n = data;
+
+	if ((*n = dnscache_lookup("127.0.0.2", "554", &a)) > 0) {
+		free(a);
+	}
+	return NULL;
+}
+
+static int
+test_concurrent (void)
+{
+	pthread_t threads[N_THREADS];
+	int ret = 0;
+
+	// Concurrent lookups of a new name all get the same answer:
+	for (int i = 0; i < N_THREADS; i++) {
+		pthread_create(&threads[i], NULL, lookup_thread, &results[i]);
+	}
+	for (int i = 0; i < N_THREADS; i++) {
+		pthread_join(threads[i], NULL);
+	}
+	for (int i = 0; i < N_THREADS; i++) {
+		if (results[i] == 0 || results[i] != results[0]) {
+			printf("FAIL: concurrent lookup %d got %u addresses\n", i, results[i]);
+			ret = 1;
+		}
+	}
+	return ret;
+}
+
+int
+main ()
+{
+	int ret = 0;
+
+	ret |= test_lookup();
+	ret |= test_ports();
+	ret |= test_concurrent();
+
+	return ret;
+}
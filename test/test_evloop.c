@@ -0,0 +1,228 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#include "../frame.h"
+#include "../source.h"
+#include "../source_network.h"
+#include "../mjv_grabber.h"
+#include "../streamgen.h"
+#include "../evloop.h"
+
+// How long the slow source takes to look up its name, in seconds:
+#define SLOW_PREPARE_SEC	2
+
+struct server {
+	int listenfd;
+	char *stream;
+	size_t len;
+};
+
+struct got {
+	struct evloop *ev;
+	struct timespec start;
+	double seconds;
+	unsigned int frames;
+};
+
+static double
+seconds_since (const struct timespec *then)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (now.tv_sec - then->tv_sec) + (now.tv_nsec - then->tv_nsec) / 1e9;
+}
+
+static void *
+server_main (void *data)
+{
+	struct server *sv = data;
+	char buf[1000];
+	int fd;
+
+	// Serve one client: skip its request, send the stream,
+	// and hold the connection open till the client closes it:
+	if ((fd = accept(sv->listenfd, NULL, NULL)) < 0) {
+		return NULL;
+	}
+	if (read(fd, buf, sizeof(buf)) > 0 && write(fd, sv->stream, sv->len) == (ssize_t)sv->len) {
+		while (read(fd, buf, sizeof(buf)) > 0) {
+			continue;
+		}
+	}
+	close(fd);
+	return NULL;
+}
+
+static int
+server_listen (int *port)
+{
+	struct sockaddr_in sin;
+	socklen_t len = sizeof(sin);
+	int fd;
+
+	if ((fd = socket(AF_INET, SOCK_STREAM, 0)) < 0) {
+		return -1;
+	}
+	memset(&sin, 0, sizeof(sin));
+	sin.sin_family = AF_INET;
+	sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	if (bind(fd, (struct sockaddr *)&sin, sizeof(sin)) < 0
+	 || listen(fd, 1) < 0
+	 || getsockname(fd, (struct sockaddr *)&sin, &len) < 0) {
+		close(fd);
+		return -1;
+	}
+	*port = ntohs(sin.sin_port);
+	return fd;
+}
+
+// A source whose name lookup hangs for a while, then fails:
+static bool
+slow_open (struct source *s)
+{
+	(void)s;
+	sleep(SLOW_PREPARE_SEC);
+	return false;
+}
+
+static bool
+slow_prepare (struct source *s)
+{
+	(void)s;
+	sleep(SLOW_PREPARE_SEC);
+	return false;
+}
+
+static enum source_open_status
+slow_open_nowait (struct source *s, int *wait_fd, int *wait_msec)
+{
+	(void)s;
+	(void)wait_fd;
+	(void)wait_msec;
+	return SOURCE_OPEN_FAILED;
+}
+
+static void
+slow_close (struct source *s)
+{
+	(void)s;
+}
+
+static void
+slow_destroy (struct source **s)
+{
+	source_deinit(*s);
+	*s = NULL;
+}
+
+static void
+got_frame (struct frame *f, void *data)
+{
+	struct got *got = data;
+
+	if (got->frames++ == 0) {
+		got->seconds = seconds_since(&got->start);
+		evloop_stop(got->ev);
+	}
+	frame_destroy(&f);
+}
+
+static int
+test_slow_neighbour (void)
+{
+	struct streamgen_opts opts;
+	struct server sv;
+	struct got got;
+	struct source slow;
+	struct source *slow_ptr = &slow;
+	struct source *net;
+	struct mjv_grabber *slow_g, *net_g;
+	pthread_t server;
+	FILE *fp;
+	int port;
+	int ret = 1;
+
+	// A stream of a few frames to serve:
+	streamgen_defaults(&opts);
+	opts.frames = 3;
+	if ((fp = open_memstream(&sv.stream, &sv.len)) == NULL) {
+		goto err0;
+	}
+	streamgen_write(fp, &opts);
+	fclose(fp);
+
+	if ((sv.listenfd = server_listen(&port)) < 0) {
+		goto err1;
+	}
+	if (pthread_create(&server, NULL, server_main, &sv) != 0) {
+		goto err2;
+	}
+	if ((net = source_network_create("net", "127.0.0.1", "/", NULL, NULL, port)) == NULL) {
+		goto err3;
+	}
+	if (!source_init(&slow, "slow", slow_open, slow_close, slow_destroy)) {
+		goto err4;
+	}
+	slow.open_prepare = slow_prepare;
+	slow.open_nowait = slow_open_nowait;
+
+	if ((net_g = mjv_grabber_create(net)) == NULL) {
+		goto err5;
+	}
+	if ((slow_g = mjv_grabber_create(&slow)) == NULL) {
+		goto err6;
+	}
+	if ((got.ev = evloop_create(10)) == NULL) {
+		goto err7;
+	}
+	got.frames = 0;
+	got.seconds = 0.0;
+
+	// The slow source is added last, so that it is opened first:
+	if (!evloop_add(got.ev, net, net_g, got_frame, &got)
+	 || !evloop_add(got.ev, &slow, slow_g, got_frame, &got)) {
+		goto err8;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &got.start);
+	evloop_run(got.ev);
+
+	// The network source must not wait for the slow lookup:
+	if (got.frames == 0) {
+		printf("FAIL: no frames\n");
+	}
+	else if (got.seconds >= SLOW_PREPARE_SEC / 2.0) {
+		printf("FAIL: first frame after %.2f s\n", got.seconds);
+	}
+	else {
+		ret = 0;
+	}
+err8:	evloop_destroy(&got.ev);
+err7:	mjv_grabber_destroy(&slow_g);
+err6:	mjv_grabber_destroy(&net_g);
+err5:	slow_destroy(&slow_ptr);
+err4:	net->destroy(&net);
+err3:	shutdown(sv.listenfd, SHUT_RDWR);
+	pthread_join(server, NULL);
+err2:	close(sv.listenfd);
+err1:	free(sv.stream);
+err0:	return ret;
+}
+
+int
+main ()
+{
+	int ret = 0;
+
+	ret |= test_slow_neighbour();
+
+	return ret;
+}
@@ -1,5 +1,8 @@
 #include <stdio.h>
+#include <unistd.h>
+#include <sys/stat.h>
 
+#include "../mjv_log.c"
 #include "../filename.c"
 
 struct testcase {
@@ -9,8 +12,8 @@ struct testcase {
 	char *expect;
 };
 
-int
-main ()
+static int
+test_forge (void)
 {
 	char *out;
 	int ret = 0;
@@ -58,3 +61,63 @@ main ()
 	}
 	return ret;
 }
+
+static int
+test_write_image (void)
+{
+	char dir[] = "/tmp/test_filename_XXXXXX";
+	char pat[100];
+	char path[100];
+	char data[] = "not really a jpeg";
+	char buf[sizeof(data)];
+	struct timespec ts = { .tv_sec = 1000000000, .tv_nsec = 0 };
+	struct stat st;
+	FILE *fp;
+	int ret = 1;
+
+	if (mkdtemp(dir) == NULL) {
+		return 1;
+	}
+	snprintf(pat, sizeof(pat), "%s/%%n_%%f.jpg", dir);
+	snprintf(path, sizeof(path), "%s/cam_42.jpg", dir);
+
+	// The file should hold the data, and carry the frame's timestamp:
+	if (!filename_write_image(pat, "cam", 42, data, sizeof(data), &ts)) {
+		printf("FAIL: could not write %s\n", path);
+		goto out;
+	}
+	if ((fp = fopen(path, "r")) == NULL) {
+		printf("FAIL: %s not found\n", path);
+		goto out;
+	}
+	if (fread(buf, 1, sizeof(buf), fp) != sizeof(data) || memcmp(buf, data, sizeof(data)) != 0) {
+		printf("FAIL: %s has the wrong contents\n", path);
+	}
+	else if (stat(path, &st) < 0 || st.st_mtime != ts.tv_sec) {
+		printf("FAIL: %s has the wrong time\n", path);
+	}
+	else {
+		ret = 0;
+	}
+	fclose(fp);
+
+	// Frames without data are not written:
+	if (filename_write_image(pat, "cam", 43, data, 0, &ts)) {
+		printf("FAIL: wrote an empty frame\n");
+		ret = 1;
+	}
+out:	unlink(path);
+	rmdir(dir);
+	return ret;
+}
+
+int
+main ()
+{
+	int ret = 0;
+
+	ret |= test_forge();
+	ret |= test_write_image();
+
+	return ret;
+}
@@ -0,0 +1,276 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <jpeglib.h>
+
+#include "../frame.h"
+#include "../pixpool.h"
+
+#define WIDTH	64
+#define HEIGHT	48
+
+static unsigned char *
+make_jpeg (unsigned long *len)
+{
+	struct jpeg_compress_struct cinfo;
+	struct jpeg_error_mgr jerr;
+	unsigned char *buf = NULL;
+	unsigned char row[WIDTH * 3];
+
+	cinfo.err = jpeg_std_error(&jerr);
+	jpeg_create_compress(&cinfo);
+	jpeg_mem_dest(&cinfo, &buf, len);
+	cinfo.image_width = WIDTH;
+	cinfo.image_height = HEIGHT;
+	cinfo.input_components = 3;
+	cinfo.in_color_space = JCS_RGB;
+	jpeg_set_defaults(&cinfo);
+	jpeg_start_compress(&cinfo, TRUE);
+
+	while (cinfo.next_scanline < HEIGHT) {
+		for (unsigned int x = 0; x < sizeof(row); x++) {
+			row[x] = (x + cinfo.next_scanline * 4) & 0xFF;
+		}
+		jpeg_write_scanlines(&cinfo, (JSAMPROW[]){ row }, 1);
+	}
+	jpeg_finish_compress(&cinfo);
+	jpeg_destroy_compress(&cinfo);
+	return buf;
+}
+
+static int
+test_decoder_reuse (void)
+{
+	struct frame_decoder *d;
+	struct pixpool *pool;
+	struct frame *good;
+	struct frame *bad;
+	unsigned char *jpeg;
+	unsigned char *once;
+	unsigned char *pixels;
+	unsigned long len;
+	int ret = 0;
+
+	if ((jpeg = make_jpeg(&len)) == NULL) {
+		return 1;
+	}
+	good = frame_create((char *)jpeg, len);
+
+	// A start marker followed by garbage makes libjpeg bail out:
+	bad = frame_create("\xff\xd8\x01\x02\x03\x04\x05\x06\xff\xd9", 10);
+
+	pool = pixpool_create();
+	d = frame_decoder_create();
+
+	// The reference, decoded by a one-off decoder:
+	if ((once = frame_to_pixbuf(good, NULL, 0, 0)) == NULL) {
+		printf("FAIL: could not decode\n");
+		return 1;
+	}
+	if (frame_get_width(good) != WIDTH || frame_get_height(good) != HEIGHT || frame_get_row_stride(good) != WIDTH * 3) {
+		printf("FAIL: wrong dimensions\n");
+		ret = 1;
+	}
+	// The same decoder gives the same pixels each time,
+	// also after it has failed on a bad frame:
+	for (int i = 0; i < 3; i++) {
+		if ((pixels = frame_decode(d, good, pool, 0, 0)) == NULL) {
+			printf("FAIL: round %d: could not decode\n", i);
+			ret = 1;
+			break;
+		}
+		if (memcmp(pixels, once, WIDTH * HEIGHT * 3) != 0) {
+			printf("FAIL: round %d: pixels differ\n", i);
+			ret = 1;
+		}
+		pixpool_put(pixels);
+
+		if (frame_decode(d, bad, pool, 0, 0) != NULL) {
+			printf("FAIL: round %d: decoded a bad frame\n", i);
+			ret = 1;
+		}
+	}
+	free(once);
+	frame_decoder_destroy(&d);
+	pixpool_destroy(&pool);
+	frame_destroy(&good);
+	frame_destroy(&bad);
+	free(jpeg);
+	return ret;
+}
+
+static int
+test_scale (void)
+{
+	struct {
+		unsigned int width;
+		unsigned int height;
+		unsigned int expect_width;
+		unsigned int expect_height;
+	}
+	tests[] = {
+		{  0,  0, 64, 48 },	// full size;
+		{ 64, 48, 64, 48 },
+		{ 99, 99, 64, 48 },	// no upscaling;
+		{ 32, 24, 32, 24 },
+		{ 21, 16, 32, 24 },	// a third: decode at a half, shrink the rest;
+		{ 16, 12, 16, 12 },
+		{ 16, 99, 16, 12 },	// the tighter side limits;
+		{ 99, 12, 16, 12 },
+		{  1,  1,  8,  6 },	// no smaller than an eighth;
+	};
+	struct frame_decoder *d;
+	struct frame *f;
+	unsigned char *jpeg;
+	unsigned char *pixels;
+	unsigned long len;
+	int ret = 0;
+
+	if ((jpeg = make_jpeg(&len)) == NULL) {
+		return 1;
+	}
+	f = frame_create((char *)jpeg, len);
+	d = frame_decoder_create();
+
+	for (unsigned int i = 0; i < sizeof(tests) / sizeof(tests[0]); i++) {
+		if ((pixels = frame_decode(d, f, NULL, tests[i].width, tests[i].height)) == NULL) {
+			printf("FAIL: could not decode for %ux%u\n", tests[i].width, tests[i].height);
+			ret = 1;
+			continue;
+		}
+		if (frame_get_width(f) != tests[i].expect_width
+		 || frame_get_height(f) != tests[i].expect_height
+		 || frame_get_row_stride(f) != tests[i].expect_width * 3) {
+			printf("FAIL: decoded %ux%u for %ux%u, expected %ux%u\n",
+				frame_get_width(f), frame_get_height(f),
+				tests[i].width, tests[i].height,
+				tests[i].expect_width, tests[i].expect_height);
+			ret = 1;
+		}
+		free(pixels);
+	}
+	frame_decoder_destroy(&d);
+	frame_destroy(&f);
+	free(jpeg);
+	return ret;
+}
+
+static int
+test_profile (void)
+{
+	struct frame_decoder *d;
+	struct frame *f;
+	unsigned char *jpeg;
+	unsigned char *quality;
+	unsigned char *fast;
+	unsigned char *again;
+	unsigned long len;
+	unsigned long diff = 0;
+	int ret = 0;
+
+	if ((jpeg = make_jpeg(&len)) == NULL) {
+		return 1;
+	}
+	f = frame_create((char *)jpeg, len);
+	d = frame_decoder_create();
+
+	quality = frame_decode(d, f, NULL, 0, 0);
+	frame_decoder_set_profile(d, FRAME_DECODE_FAST);
+	fast = frame_decode(d, f, NULL, 0, 0);
+	frame_decoder_set_profile(d, FRAME_DECODE_QUALITY);
+	again = frame_decode(d, f, NULL, 0, 0);
+
+	if (quality == NULL || fast == NULL || again == NULL) {
+		printf("FAIL: could not decode\n");
+		ret = 1;
+		goto out;
+	}
+	// The fast profile gives the same size and nearly the same pixels:
+	if (frame_get_width(f) != WIDTH || frame_get_height(f) != HEIGHT) {
+		printf("FAIL: fast profile changed the size\n");
+		ret = 1;
+	}
+	for (unsigned int i = 0; i < WIDTH * HEIGHT * 3; i++) {
+		diff += abs(quality[i] - fast[i]);
+	}
+	if (diff / (WIDTH * HEIGHT * 3) > 4) {
+		printf("FAIL: fast profile is off by %lu on average\n", diff / (WIDTH * HEIGHT * 3));
+		ret = 1;
+	}
+	// Switching back gives the exact same pixels as before:
+	if (memcmp(quality, again, WIDTH * HEIGHT * 3) != 0) {
+		printf("FAIL: quality profile not restored\n");
+		ret = 1;
+	}
+out:	free(quality);
+	free(fast);
+	free(again);
+	frame_decoder_destroy(&d);
+	frame_destroy(&f);
+	free(jpeg);
+	return ret;
+}
+
+static int
+test_format (void)
+{
+	struct frame_decoder *d;
+	struct frame *f;
+	unsigned char *jpeg;
+	unsigned char *rgb;
+	unsigned char *xrgb;
+	unsigned long len;
+	int ret = 0;
+
+	if ((jpeg = make_jpeg(&len)) == NULL) {
+		return 1;
+	}
+	f = frame_create((char *)jpeg, len);
+	d = frame_decoder_create();
+
+	rgb = frame_decode(d, f, NULL, 0, 0);
+	frame_decoder_set_format(d, FRAME_FORMAT_XRGB32);
+	xrgb = frame_decode(d, f, NULL, 0, 0);
+
+	if (rgb == NULL || xrgb == NULL) {
+		printf("FAIL: could not decode\n");
+		ret = 1;
+		goto out;
+	}
+	if (frame_get_row_stride(f) != WIDTH * 4) {
+		printf("FAIL: row stride %u, expected %u\n", frame_get_row_stride(f), WIDTH * 4);
+		ret = 1;
+	}
+	// Same pixels, as 32-bit words of 0x00RRGGBB:
+	for (unsigned int i = 0; i < WIDTH * HEIGHT; i++) {
+		uint32_t word = ((uint32_t *)xrgb)[i] & 0xFFFFFF;
+		uint32_t expect = (rgb[i * 3] << 16) | (rgb[i * 3 + 1] << 8) | rgb[i * 3 + 2];
+
+		if (word != expect) {
+			printf("FAIL: pixel %u is %06x, expected %06x\n", i, word, expect);
+			ret = 1;
+			break;
+		}
+	}
+out:	free(rgb);
+	free(xrgb);
+	frame_decoder_destroy(&d);
+	frame_destroy(&f);
+	free(jpeg);
+	return ret;
+}
+
+int
+main ()
+{
+	int ret = 0;
+
+	ret |= test_decoder_reuse();
+	ret |= test_scale();
+	ret |= test_profile();
+	ret |= test_format();
+
+	return ret;
+}
@@ -0,0 +1,977 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+
+#include "../frame.h"
+#include "../source.h"
+#include "../mjv_grabber.h"
+
+// Differential test of the grabber. Streams are handed to the grabber in
+// pieces of random size, so that reads end at every possible place, and
+// the frames that come out are compared byte for byte with those found
+// by a simple reference parser that sees the whole stream at once.
+//
+// Run with a seed as argument to repeat a failing round.
+
+#define ROUNDS		300
+#define MAX_FRAMES	200
+
+enum feed_mode
+{ FEED_COMMIT		// mjv_grabber_write_ptr() and mjv_grabber_commit()
+, FEED_READ		// mjv_grabber_read() from a source
+, FEED_RUN		// mjv_grabber_run() on a source, fed from a thread
+, FEED_MODES
+};
+
+static const char *mode_names[] = { "commit", "read", "run" };
+static const char *frames_names[] = { "shared", "copied", "borrowed" };
+
+struct ref_frame {
+	size_t off;
+	size_t len;
+	bool has_capture;
+	struct timespec capture;
+};
+
+struct buf {
+	char *data;
+	size_t len;
+	size_t size;
+};
+
+struct got {
+	struct frame *frames[MAX_FRAMES];
+	unsigned int n;
+	bool overflow;
+	bool borrowed;	// frames must be copied before the next read;
+};
+
+static uint64_t rng;
+
+static uint32_t
+random_u32 (void)
+{
+	// xorshift64*:
+	rng ^= rng >> 12;
+	rng ^= rng << 25;
+	rng ^= rng >> 27;
+	return (rng * 0x2545F4914F6CDD1DULL) >> 32;
+}
+
+static unsigned int
+random_below (unsigned int n)
+{
+	return (n == 0) ? 0 : random_u32() % n;
+}
+
+static void
+put (struct buf *b, const void *data, size_t len)
+{
+	if (b->len + len > b->size) {
+		while (b->len + len > b->size) {
+			b->size = (b->size == 0) ? 65536 : b->size * 2;
+		}
+		if ((b->data = realloc(b->data, b->size)) == NULL) {
+			abort();
+		}
+	}
+	memcpy(b->data + b->len, data, len);
+	b->len += len;
+}
+
+static void
+put_str (struct buf *b, const char *s)
+{
+	put(b, s, strlen(s));
+}
+
+static void
+put_byte (struct buf *b, unsigned char c)
+{
+	put(b, &c, 1);
+}
+
+// Junk that cannot contain a boundary, which is alphanumeric:
+static void
+put_junk (struct buf *b, unsigned int max)
+{
+	static const char chars[] = " .:;,!\r\n";
+	unsigned int len = 1 + random_below(max);
+
+	for (unsigned int i = 0; i < len; i++) {
+		put_byte(b, chars[random_below(sizeof(chars) - 1)]);
+	}
+}
+
+// An image with a valid marker structure, and in it as many things
+// as possible that could trip up a parser:
+static void
+put_image (struct buf *b, const char *boundary, unsigned int size, bool broken)
+{
+	size_t start = b->len;
+
+	put_str(b, "\xff\xd8");
+
+	// Fill bytes before a marker are allowed:
+	if (random_below(4) == 0) {
+		put_str(b, "\xff\xff");
+	}
+	// An application segment that holds an end marker and the boundary:
+	{
+		char payload[100];
+		unsigned int len = snprintf(payload, sizeof(payload), "\xff\xd9--%s\r\n\xff\xd8", boundary);
+
+		put_str(b, "\xff\xe1");
+		put_byte(b, (len + 2) >> 8);
+		put_byte(b, (len + 2) & 0xFF);
+		put(b, payload, len);
+	}
+	// Start of scan:
+	put(b, "\xff\xda\x00\x08\x01\x01\x00\x00\x3f\x00", 10);
+
+	// Scan data with stuffed bytes and restart markers:
+	while (b->len - start < size) {
+		unsigned char c = random_u32() & 0xFF;
+
+		if (c != 0xFF) {
+			put_byte(b, c);
+		}
+		else if (random_below(8) == 0) {
+			put_byte(b, 0xFF);
+			put_byte(b, 0xD0 + random_below(8));
+		}
+		else {
+			put_byte(b, 0xFF);
+			put_byte(b, 0x00);
+		}
+	}
+	// A broken image lacks its end marker:
+	if (!broken) {
+		put_str(b, "\xff\xd9");
+	}
+}
+
+static void
+make_stream (struct buf *b)
+{
+	static const char chars[] =
+		"ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789";
+	bool lf = random_below(3) == 0;
+	const char *nl = lf ? "\n" : "\r\n";
+	unsigned int n_parts = 1 + random_below(25);
+	char boundary[71];
+	unsigned int blen = 1 + random_below(random_below(2) ? 8 : 70);
+	char line[200];
+
+	for (unsigned int i = 0; i < blen; i++) {
+		boundary[i] = chars[random_below(sizeof(chars) - 1)];
+	}
+	boundary[blen] = '\0';
+
+	b->len = 0;
+	snprintf(line, sizeof(line), "HTTP/1.%u 200 OK%s", random_below(2), nl);
+	put_str(b, line);
+	if (random_below(2)) {
+		snprintf(line, sizeof(line), "Server: test%sCache-Control: no-cache%s", nl, nl);
+		put_str(b, line);
+	}
+	snprintf(line, sizeof(line), "%s: multipart/x-mixed-replace;%sboundary=%s%s%s",
+		random_below(2) ? "Content-Type" : "Content-type",
+		random_below(2) ? " " : "",
+		boundary,
+		random_below(4) == 0 ? "; charset=x" : "",
+		nl);
+	put_str(b, line);
+	put_str(b, nl);
+
+	for (unsigned int i = 0; i < n_parts; i++) {
+		unsigned int size = 64 + random_below(random_below(8) == 0 ? 400000 : 20000);
+		bool broken = random_below(20) == 0;
+		bool has_length = random_below(3) != 0;
+		size_t image_start;
+		size_t length_pos = 0;
+
+		if (random_below(4) == 0) {
+			put_junk(b, 300);
+		}
+		// Now and then a boundary that is not followed by a line end:
+		if (random_below(10) == 0) {
+			snprintf(line, sizeof(line), "%s--%s -%s", nl, boundary, nl);
+			put_str(b, line);
+		}
+		snprintf(line, sizeof(line), "--%s%s", boundary, nl);
+		put_str(b, line);
+
+		snprintf(line, sizeof(line), "%s: image/jpeg%s", random_below(2) ? "Content-Type" : "Content-type", nl);
+		put_str(b, line);
+		if (random_below(2)) {
+			snprintf(line, sizeof(line), "X-Timestamp: %u.%0*u%s", 1000000000 + random_below(100000), 1 + random_below(9), random_below(1000), nl);
+			put_str(b, line);
+		}
+		if (has_length) {
+			snprintf(line, sizeof(line), "%s: ", random_below(2) ? "Content-Length" : "Content-length");
+			put_str(b, line);
+			length_pos = b->len;
+
+			// Room for the number, filled in below:
+			put_str(b, "          ");
+			put_str(b, nl);
+		}
+		if (random_below(5) == 0) {
+			snprintf(line, sizeof(line), "X-Other: --%s%s", boundary, nl);
+			put_str(b, line);
+		}
+		put_str(b, nl);
+
+		// Junk before the start marker is skipped:
+		if (random_below(6) == 0) {
+			put_str(b, "abc\xff");
+		}
+		image_start = b->len;
+		put_image(b, boundary, size, broken);
+
+		if (has_length) {
+			// Some cameras count the line end in the length:
+			size_t len = b->len - image_start + (random_below(4) == 0 ? strlen(nl) : 0);
+			char num[11];
+
+			snprintf(num, sizeof(num), "%-10zu", len);
+			memcpy(b->data + length_pos, num, 10);
+		}
+		put_str(b, nl);
+	}
+	snprintf(line, sizeof(line), "--%s--%s", boundary, nl);
+	put_str(b, line);
+}
+
+// Reference parser, for the whole stream at once:
+
+static bool
+next_line (const char *buf, size_t len, size_t *pos, const char **line, size_t *line_len)
+{
+	const char *nl;
+
+	if (*pos >= len || (nl = memchr(buf + *pos, '\n', len - *pos)) == NULL) {
+		return false;
+	}
+	*line = buf + *pos;
+	*line_len = nl - *line;
+	if (*line_len > 0 && nl[-1] == '\r') {
+		(*line_len)--;
+	}
+	*pos = nl + 1 - buf;
+	return true;
+}
+
+static bool
+starts_with (const char *line, size_t line_len, const char *prefix)
+{
+	size_t len = strlen(prefix);
+
+	return line_len >= len && strncmp(line, prefix, len) == 0;
+}
+
+static void
+parse_capture (const char *cur, const char *end, struct ref_frame *f)
+{
+	long scale = 100000000;
+
+	while (cur < end && *cur == ' ') {
+		cur++;
+	}
+	if (cur >= end || *cur < '0' || *cur > '9') {
+		f->has_capture = false;
+		return;
+	}
+	f->has_capture = true;
+	f->capture.tv_sec = 0;
+	f->capture.tv_nsec = 0;
+	while (cur < end && *cur >= '0' && *cur <= '9') {
+		f->capture.tv_sec = f->capture.tv_sec * 10 + (*cur++ - '0');
+	}
+	if (cur < end && *cur == '.') {
+		while (++cur < end && *cur >= '0' && *cur <= '9' && scale > 0) {
+			f->capture.tv_nsec += (*cur - '0') * scale;
+			scale /= 10;
+		}
+	}
+}
+
+static bool
+find_boundary (const char *buf, size_t len, size_t *pos, const char *boundary, size_t blen)
+{
+	const char *match;
+	size_t from = *pos;
+
+	while (from < len && (match = memmem(buf + from, len - from, boundary, blen)) != NULL) {
+		size_t eol = match + blen - buf;
+
+		if (eol < len && buf[eol] == '\r') {
+			eol++;
+		}
+		if (eol >= len) {
+			return false;
+		}
+		if (buf[eol] == '\n') {
+			*pos = eol + 1;
+			return true;
+		}
+		from = match + 1 - buf;
+	}
+	return false;
+}
+
+// Walks the JPEG markers from the start of the image. Returns the length
+// of the image, zero if it is malformed, or -1 if it runs out of bytes:
+static long
+walk_segments (const unsigned char *img, size_t avail)
+{
+	size_t pos = 2;
+	bool entropy = false;
+
+	for (;;) {
+		if (pos >= avail) {
+			return -1;
+		}
+		if (entropy) {
+			const unsigned char *p = memchr(img + pos, 0xFF, avail - pos);
+
+			if (p == NULL) {
+				return -1;
+			}
+			pos = p - img;
+			if (pos + 1 >= avail) {
+				return -1;
+			}
+			if (img[pos + 1] == 0x00 || (img[pos + 1] >= 0xD0 && img[pos + 1] <= 0xD7)) {
+				pos += 2;
+				continue;
+			}
+			entropy = false;
+			continue;
+		}
+		if (pos + 1 >= avail) {
+			return -1;
+		}
+		if (img[pos] != 0xFF) {
+			return 0;
+		}
+		if (img[pos + 1] == 0xFF) {
+			pos++;
+			continue;
+		}
+		if (img[pos + 1] == 0xD9) {
+			return pos + 2;
+		}
+		if (img[pos + 1] == 0xD8) {
+			return 0;
+		}
+		if (img[pos + 1] == 0x01 || (img[pos + 1] >= 0xD0 && img[pos + 1] <= 0xD7)) {
+			pos += 2;
+			continue;
+		}
+		if (pos + 3 >= avail) {
+			return -1;
+		}
+		if (((img[pos + 2] << 8) | img[pos + 3]) < 2) {
+			return 0;
+		}
+		if (img[pos + 1] == 0xDA) {
+			entropy = true;
+		}
+		pos += 2 + ((img[pos + 2] << 8) | img[pos + 3]);
+	}
+}
+
+static unsigned int
+reference_parse (const char *buf, size_t len, struct ref_frame *frames)
+{
+	const char *line;
+	const char *boundary = NULL;
+	size_t line_len;
+	size_t blen = 0;
+	size_t pos = 0;
+	unsigned int n = 0;
+
+	// The status line and the header:
+	if (!next_line(buf, len, &pos, &line, &line_len)
+	 || !starts_with(line, line_len, "HTTP/1.")
+	 || line_len < 12
+	 || (line[7] != '0' && line[7] != '1')
+	 || strncmp(line + 8, " 200", 4) != 0) {
+		return 0;
+	}
+	for (;;) {
+		if (!next_line(buf, len, &pos, &line, &line_len)) {
+			return 0;
+		}
+		if (line_len == 0) {
+			break;
+		}
+		if (starts_with(line, line_len, "Content-Type:") || starts_with(line, line_len, "Content-type:")) {
+			const char *b = memmem(line, line_len, "boundary=", 9);
+
+			if (b != NULL) {
+				boundary = b + 9;
+				blen = 0;
+				while (boundary + blen < line + line_len && boundary[blen] != ';') {
+					blen++;
+				}
+			}
+		}
+	}
+	if (boundary == NULL || blen == 0) {
+		return 0;
+	}
+	while (n < MAX_FRAMES && find_boundary(buf, len, &pos, boundary, blen)) {
+		struct ref_frame *f = &frames[n];
+		size_t content_length = 0;
+		size_t start;
+
+		f->has_capture = false;
+
+		// The part header:
+		for (;;) {
+			if (!next_line(buf, len, &pos, &line, &line_len)) {
+				return n;
+			}
+			if (line_len == 0) {
+				break;
+			}
+			if (starts_with(line, line_len, "Content-Length:") || starts_with(line, line_len, "Content-length:")) {
+				const char *c = line + 15;
+				size_t digits = 0;
+
+				while (*c == ' ') {
+					c++;
+				}
+				while (c[digits] >= '0' && c[digits] <= '9') {
+					digits++;
+				}
+				// The grabber takes lengths of two digits or more:
+				if (digits >= 2) {
+					content_length = strtoul(c, NULL, 10);
+				}
+			}
+			else if (starts_with(line, line_len, "X-Timestamp:")) {
+				parse_capture(line + 12, line + line_len, f);
+			}
+		}
+		// The start of the image:
+		while (pos + 1 < len && !((unsigned char)buf[pos] == 0xFF && (unsigned char)buf[pos + 1] == 0xD8)) {
+			pos++;
+		}
+		if (pos + 1 >= len) {
+			return n;
+		}
+		start = pos;
+
+		if (content_length > 0) {
+			if (start + content_length > len) {
+				return n;
+			}
+			pos = start + content_length;
+			f->off = start;
+			f->len = 0;
+
+			// Allow for a few bytes of padding behind the end marker:
+			for (size_t i = 0; i < MJV_GRABBER_EOI_SLACK && content_length - i >= 4; i++) {
+				if ((unsigned char)buf[start + content_length - i - 2] == 0xFF
+				 && (unsigned char)buf[start + content_length - i - 1] == 0xD9) {
+					f->len = content_length - i;
+					break;
+				}
+			}
+			if (f->len > 0) {
+				n++;
+			}
+			continue;
+		}
+		long img_len = walk_segments((const unsigned char *)buf + start, len - start);
+
+		if (img_len < 0) {
+			return n;
+		}
+		if (img_len == 0) {
+			pos = start + 2;
+			continue;
+		}
+		f->off = start;
+		f->len = img_len;
+		pos = start + img_len;
+		n++;
+	}
+	return n;
+}
+
+// Feeding the grabber:
+
+static size_t
+random_piece (size_t space)
+{
+	// Mostly small pieces, so that reads end everywhere,
+	// but also whole buffers:
+	switch (random_below(4)) {
+		case 0: return 1 + random_below(8);
+		case 1: return 1 + random_below(512);
+		case 2: return 1 + random_below(16384);
+		default: return space;
+	}
+}
+
+static void
+collect (struct got *got, struct frame *f)
+{
+	if (got->n == MAX_FRAMES) {
+		got->overflow = true;
+		frame_destroy(&f);
+		return;
+	}
+	if (got->borrowed) {
+		struct frame *copy = frame_create((char *)frame_get_rawbits(f), frame_get_num_rawbits(f));
+
+		if (copy != NULL && frame_get_capture_time(f) != NULL) {
+			frame_set_capture_time(copy, frame_get_capture_time(f));
+		}
+		frame_destroy(&f);
+		if ((f = copy) == NULL) {
+			got->overflow = true;
+			return;
+		}
+	}
+	got->frames[got->n++] = f;
+}
+
+static void
+got_frame_callback (struct frame *f, void *user_pointer)
+{
+	collect(user_pointer, f);
+}
+
+static void
+got_frames_callback (struct frame **frames, unsigned int n, void *user_pointer)
+{
+	for (unsigned int i = 0; i < n; i++) {
+		collect(user_pointer, frames[i]);
+	}
+}
+
+static void
+drain (struct mjv_grabber *g, struct got *got)
+{
+	struct frame *f;
+
+	while ((f = mjv_grabber_next_frame(g)) != NULL) {
+		collect(got, f);
+	}
+}
+
+static bool
+feed_commit (struct mjv_grabber *g, const char *buf, size_t len, struct got *got)
+{
+	size_t off = 0;
+
+	while (off < len) {
+		size_t space;
+		size_t n;
+		void *p = mjv_grabber_write_ptr(g, &space);
+
+		if (p == NULL || space == 0) {
+			printf("no space at offset %zu\n", off);
+			return false;
+		}
+		if ((n = random_piece(space)) > space) {
+			n = space;
+		}
+		if (n > len - off) {
+			n = len - off;
+		}
+		memcpy(p, buf + off, n);
+		off += n;
+		if (mjv_grabber_commit(g, n) != MJV_GRABBER_SUCCESS) {
+			printf("grabber error at offset %zu\n", off);
+			return false;
+		}
+		drain(g, got);
+	}
+	return true;
+}
+
+struct fake_source {
+	struct source source;
+};
+
+static bool
+fake_open (struct source *s)
+{
+	(void)s;
+	return true;
+}
+
+static void
+fake_close (struct source *s)
+{
+	source_release_io(s);
+}
+
+static void
+fake_destroy (struct source **s)
+{
+	source_deinit(*s);
+	free(*s);
+	*s = NULL;
+}
+
+static struct source *
+fake_source_create (int fd)
+{
+	struct fake_source *fs;
+
+	if ((fs = malloc(sizeof(*fs))) == NULL) {
+		return NULL;
+	}
+	if (!source_init(&fs->source, "fake", fake_open, fake_close, fake_destroy)) {
+		free(fs);
+		return NULL;
+	}
+	fs->source.fd = fd;
+	return &fs->source;
+}
+
+// Replay the stream through a pipe, in pieces of random size. Each
+// piece is read back by the grabber before the next one is written:
+static bool
+feed_read (struct mjv_grabber *g, int wfd, const char *buf, size_t len, struct got *got)
+{
+	enum mjv_grabber_status status;
+	size_t off = 0;
+
+	while (off < len) {
+		size_t n = random_piece(1 << 20);
+		ssize_t written;
+
+		if (n > len - off) {
+			n = len - off;
+		}
+		if ((written = write(wfd, buf + off, n)) <= 0) {
+			printf("pipe write failed: %s\n", strerror(errno));
+			return false;
+		}
+		off += written;
+		while ((status = mjv_grabber_read(g)) == MJV_GRABBER_SUCCESS) {
+			drain(g, got);
+		}
+		if (status != MJV_GRABBER_AGAIN) {
+			printf("grabber error at offset %zu\n", off);
+			return false;
+		}
+		drain(g, got);
+	}
+	return true;
+}
+
+struct writer {
+	int fd;
+	const char *buf;
+	size_t len;
+	uint64_t seed;
+};
+
+static void *
+writer_main (void *user_pointer)
+{
+	struct writer *w = user_pointer;
+	size_t off = 0;
+
+	while (off < w->len) {
+		size_t n = 1 + (w->seed = w->seed * 6364136223846793005ULL + 1) % 65536;
+		ssize_t written;
+
+		if (n > w->len - off) {
+			n = w->len - off;
+		}
+		if ((written = write(w->fd, w->buf + off, n)) <= 0) {
+			break;
+		}
+		off += written;
+		if ((w->seed >> 40) % 4 == 0) {
+			sched_yield();
+		}
+	}
+	close(w->fd);
+	return NULL;
+}
+
+// Run the grabber's own read loop, with a thread writing the stream
+// into a pipe; reads end wherever the timing makes them end:
+static bool
+feed_run (struct mjv_grabber *g, int wfd, const char *buf, size_t len, struct got *got)
+{
+	struct writer w = { wfd, buf, len, random_u32() };
+	enum mjv_grabber_status status;
+	pthread_t thread;
+
+	mjv_grabber_set_callback(g, got_frame_callback, got);
+	if (pthread_create(&thread, NULL, writer_main, &w) != 0) {
+		close(wfd);
+		return false;
+	}
+	status = mjv_grabber_run(g);
+	pthread_join(thread, NULL);
+
+	if (status != MJV_GRABBER_PREMATURE_EOF) {
+		printf("grabber ended with status %d\n", status);
+		return false;
+	}
+	return true;
+}
+
+static bool
+compare (const char *buf, const struct ref_frame *ref, unsigned int n_ref, const struct got *got)
+{
+	if (got->overflow || got->n != n_ref) {
+		printf("got %u frames, reference has %u\n", got->n, n_ref);
+		return false;
+	}
+	for (unsigned int i = 0; i < n_ref; i++) {
+		struct frame *f = got->frames[i];
+		const struct timespec *capture = frame_get_capture_time(f);
+
+		if (frame_get_num_rawbits(f) != ref[i].len
+		 || memcmp(frame_get_rawbits(f), buf + ref[i].off, ref[i].len) != 0) {
+			printf("frame %u differs: %u bytes, reference has %zu at offset %zu\n", i, frame_get_num_rawbits(f), ref[i].len, ref[i].off);
+			return false;
+		}
+		if ((capture != NULL) != ref[i].has_capture
+		 || (capture != NULL && (capture->tv_sec != ref[i].capture.tv_sec || capture->tv_nsec != ref[i].capture.tv_nsec))) {
+			printf("frame %u has the wrong capture time\n", i);
+			return false;
+		}
+	}
+	return true;
+}
+
+static int
+test_round (uint64_t seed, struct buf *stream, struct ref_frame *ref)
+{
+	enum feed_mode mode;
+	struct mjv_grabber *g = NULL;
+	struct source *s = NULL;
+	struct got got;
+	unsigned int n_ref;
+	size_t len;
+	enum mjv_grabber_frames frames;
+	bool ok = false;
+	int pipefd[2] = { -1, -1 };
+
+	rng = seed * 0x9E3779B97F4A7C15ULL + 1;
+	make_stream(stream);
+
+	// Also try streams that end anywhere:
+	len = (random_below(3) == 0) ? random_below(stream->len) : stream->len;
+	n_ref = reference_parse(stream->data, len, ref);
+
+	mode = random_below(FEED_MODES);
+	frames = random_below(3);
+	got.n = 0;
+	got.overflow = false;
+	got.borrowed = (frames == MJV_GRABBER_FRAMES_BORROWED);
+
+	if (mode != FEED_COMMIT) {
+		if (pipe(pipefd) < 0) {
+			return 1;
+		}
+		// Room for the largest pieces:
+		fcntl(pipefd[1], F_SETPIPE_SZ, 1 << 20);
+		if (mode == FEED_READ) {
+			fcntl(pipefd[0], F_SETFL, O_NONBLOCK);
+		}
+		if ((s = fake_source_create(pipefd[0])) == NULL) {
+			goto out;
+		}
+	}
+	if ((g = mjv_grabber_create(s)) == NULL || !mjv_grabber_set_frames(g, frames)) {
+		goto out;
+	}
+	// Borrowed frames can not be queued; take them in batches:
+	if (frames == MJV_GRABBER_FRAMES_BORROWED) {
+		mjv_grabber_set_batch_callback(g, got_frames_callback, &got);
+	}
+	switch (mode) {
+		case FEED_COMMIT: ok = feed_commit(g, stream->data, len, &got); break;
+		case FEED_READ: ok = feed_read(g, pipefd[1], stream->data, len, &got); break;
+		case FEED_RUN: ok = feed_run(g, pipefd[1], stream->data, len, &got); pipefd[1] = -1; break;
+		default: break;
+	}
+	if (ok) {
+		ok = compare(stream->data, ref, n_ref, &got);
+	}
+	if (!ok) {
+		printf("FAIL: seed %llu: %s mode, %s frames, %zu of %zu bytes\n", (unsigned long long)seed, mode_names[mode], frames_names[frames], len, stream->len);
+	}
+
+out:	while (got.n > 0) {
+		frame_destroy(&got.frames[--got.n]);
+	}
+	mjv_grabber_destroy(&g);
+	if (s != NULL) {
+		s->destroy(&s);
+	}
+	if (pipefd[0] >= 0) {
+		close(pipefd[0]);
+	}
+	if (pipefd[1] >= 0) {
+		close(pipefd[1]);
+	}
+	return ok ? 0 : 1;
+}
+
+// Frames right up to the read buffer ceiling must come through, even
+// when there is no room left for anything behind them:
+static int
+test_ceiling (void)
+{
+	const unsigned int max_frame_size = 100000;
+	const unsigned int ceiling = max_frame_size + MJV_GRABBER_BUF_HEADROOM;
+	const unsigned int sizes[] = { ceiling - 300, ceiling - 256, ceiling - 100, ceiling, ceiling + 1 };
+	struct buf b = { NULL, 0, 0 };
+	int ret = 0;
+
+	for (unsigned int i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+		struct mjv_grabber_stats stats;
+		struct mjv_grabber *g;
+		struct source *s;
+		struct frame *f;
+		unsigned int n = 0;
+		size_t start;
+		char line[100];
+
+		b.len = 0;
+		put_str(&b, "HTTP/1.0 200 OK\r\nContent-Type: multipart/x-mixed-replace;boundary=b\r\n\r\n");
+		snprintf(line, sizeof(line), "--b\r\nContent-Type: image/jpeg\r\nContent-Length: %u\r\n\r\n", sizes[i]);
+		put_str(&b, line);
+		start = b.len;
+		put_str(&b, "\xff\xd8");
+		while (b.len - start < sizes[i] - 2) {
+			put_byte(&b, 0x00);
+		}
+		put_str(&b, "\xff\xd9\r\n--b--\r\n");
+
+		if ((s = fake_source_create(-1)) == NULL) {
+			return 1;
+		}
+		source_set_max_frame_size(s, max_frame_size);
+		if ((g = mjv_grabber_create(s)) == NULL) {
+			s->destroy(&s);
+			return 1;
+		}
+		for (size_t off = 0; off < b.len; off += 4096) {
+			mjv_grabber_feed(g, b.data + off, (b.len - off < 4096) ? b.len - off : 4096);
+			while ((f = mjv_grabber_next_frame(g)) != NULL) {
+				if (frame_get_num_rawbits(f) != sizes[i]) {
+					printf("FAIL: ceiling: got %u bytes, expected %u\n", frame_get_num_rawbits(f), sizes[i]);
+					ret = 1;
+				}
+				frame_destroy(&f);
+				n++;
+			}
+		}
+		mjv_grabber_get_stats(g, &stats);
+		if (n != (sizes[i] <= ceiling) || stats.oversize != (sizes[i] > ceiling)) {
+			printf("FAIL: ceiling: %u byte frame: %u frames, %lu oversize\n", sizes[i], n, stats.oversize);
+			ret = 1;
+		}
+		mjv_grabber_destroy(&g);
+		s->destroy(&s);
+	}
+	free(b.data);
+	return ret;
+}
+
+static void
+count_frame (struct frame *f, void *data)
+{
+	(*(unsigned int *)data)++;
+	frame_destroy(&f);
+}
+
+static int
+test_borrowed_pull (void)
+{
+	struct buf b = { NULL, 0, 0 };
+	struct mjv_grabber_stats stats;
+	struct mjv_grabber *g;
+	struct frame *f;
+	unsigned int n = 0;
+	int ret = 0;
+
+	put_str(&b, "HTTP/1.0 200 OK\r\nContent-Type: multipart/x-mixed-replace;boundary=b\r\n\r\n");
+	for (int i = 0; i < 3; i++) {
+		put_str(&b, "--b\r\nContent-Type: image/jpeg\r\nContent-Length: 4\r\n\r\n\xff\xd8\xff\xd9\r\n");
+	}
+	put_str(&b, "--b--\r\n");
+
+	// Borrowed frames must not be queued for the pull interface:
+	if ((g = mjv_grabber_create(NULL)) == NULL || !mjv_grabber_set_frames(g, MJV_GRABBER_FRAMES_BORROWED)) {
+		mjv_grabber_destroy(&g);
+		free(b.data);
+		return 1;
+	}
+	mjv_grabber_feed(g, b.data, b.len);
+	while ((f = mjv_grabber_next_frame(g)) != NULL) {
+		frame_destroy(&f);
+		n++;
+	}
+	mjv_grabber_get_stats(g, &stats);
+	if (n != 0 || stats.frames != 0) {
+		printf("FAIL: borrowed: %u frames queued without a callback\n", n);
+		ret = 1;
+	}
+	mjv_grabber_destroy(&g);
+
+	// With a callback, they come through:
+	if ((g = mjv_grabber_create(NULL)) == NULL || !mjv_grabber_set_frames(g, MJV_GRABBER_FRAMES_BORROWED)) {
+		mjv_grabber_destroy(&g);
+		free(b.data);
+		return 1;
+	}
+	n = 0;
+	mjv_grabber_set_callback(g, count_frame, &n);
+	mjv_grabber_feed(g, b.data, b.len);
+	if (n != 3) {
+		printf("FAIL: borrowed: %u frames through the callback, expected 3\n", n);
+		ret = 1;
+	}
+	mjv_grabber_destroy(&g);
+	free(b.data);
+	return ret;
+}
+
+int
+main (int argc, char **argv)
+{
+	static struct ref_frame ref[MAX_FRAMES];
+	struct buf stream = { NULL, 0, 0 };
+	uint64_t first = (argc > 1) ? strtoull(argv[1], NULL, 0) : 1;
+	uint64_t rounds = (argc > 1) ? 1 : ROUNDS;
+	int ret = 0;
+
+	for (uint64_t seed = first; seed < first + rounds; seed++) {
+		ret |= test_round(seed, &stream, ref);
+	}
+	if (argc == 1) {
+		ret |= test_ceiling();
+		ret |= test_borrowed_pull();
+	}
+	free(stream.data);
+	return ret;
+}
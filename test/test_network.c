@@ -0,0 +1,173 @@
+#include <netinet/in.h>
+
+#include "../mjv_log.c"
+#include "../dnscache.c"
+#include "../source_network.c"
+
+// A listener that never accepts, and whose queue is full, so that
+// connects to it hang till they time out:
+static int
+listen_hanging (struct dnscache_addr *a, int *queued)
+{
+	struct sockaddr_in *sin = (struct sockaddr_in *)&a->addr;
+	int fd;
+
+	if ((fd = socket(AF_INET, SOCK_STREAM, 0)) < 0) {
+		return -1;
+	}
+	memset(a, 0, sizeof(*a));
+	a->family = AF_INET;
+	a->addrlen = sizeof(*sin);
+	sin->sin_family = AF_INET;
+	sin->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	if (bind(fd, (struct sockaddr *)sin, a->addrlen) < 0
+	 || listen(fd, 0) < 0
+	 || getsockname(fd, (struct sockaddr *)sin, &a->addrlen) < 0) {
+		close(fd);
+		return -1;
+	}
+	// Fill the queue:
+	if ((*queued = socket(AF_INET, SOCK_STREAM, 0)) < 0
+	 || connect(*queued, (struct sockaddr *)sin, a->addrlen) < 0) {
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+static int
+listen_open (struct dnscache_addr *a)
+{
+	struct sockaddr_in *sin = (struct sockaddr_in *)&a->addr;
+	int fd;
+
+	if ((fd = socket(AF_INET, SOCK_STREAM, 0)) < 0) {
+		return -1;
+	}
+	memset(a, 0, sizeof(*a));
+	a->family = AF_INET;
+	a->addrlen = sizeof(*sin);
+	sin->sin_family = AF_INET;
+	sin->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	if (bind(fd, (struct sockaddr *)sin, a->addrlen) < 0
+	 || listen(fd, 8) < 0
+	 || getsockname(fd, (struct sockaddr *)sin, &a->addrlen) < 0) {
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+static enum source_open_status
+connect_addrs (struct source *s, struct dnscache_addr *addrs, unsigned int n, long *msec)
+{
+	struct source_network *sn = (struct source_network *)s;
+	enum source_open_status status;
+	struct pollfd pfd;
+	long start = now_msec();
+	int wait_msec;
+
+	// Skip the lookup, and open in steps as an event loop would:
+	free(sn->addrs);
+	if ((sn->addrs = malloc(n * sizeof(*addrs))) == NULL) {
+		return SOURCE_OPEN_FAILED;
+	}
+	memcpy(sn->addrs, addrs, n * sizeof(*addrs));
+	sn->n_addrs = n;
+	sn->next_addr = 0;
+
+	while ((status = open_network_nowait(s, &pfd.fd, &wait_msec)) == SOURCE_OPEN_PENDING) {
+		pfd.events = POLLIN;
+		poll(&pfd, 1, wait_msec);
+	}
+	*msec = now_msec() - start;
+	return status;
+}
+
+static int
+test_race (void)
+{
+	struct dnscache_addr addrs[4];
+	int listenfd[4], queued[3];
+	struct source *s;
+	long msec;
+	int ret = 1;
+
+	// Three addresses that hang, then one that works. Tried one
+	// after another, they would take three attempt timeouts:
+	for (int i = 0; i < 3; i++) {
+		if ((listenfd[i] = listen_hanging(&addrs[i], &queued[i])) < 0) {
+			return 1;
+		}
+	}
+	if ((listenfd[3] = listen_open(&addrs[3])) < 0) {
+		return 1;
+	}
+	if ((s = source_network_create("race", "test", "/", NULL, NULL, 80)) == NULL) {
+		return 1;
+	}
+	if (connect_addrs(s, addrs, 4, &msec) != SOURCE_OPEN_DONE) {
+		printf("FAIL: race: could not connect\n");
+	}
+	else if (msec >= SOURCE_NETWORK_ATTEMPT_TIMEOUT) {
+		printf("FAIL: race: connected after %ld ms\n", msec);
+	}
+	else {
+		ret = 0;
+	}
+	s->close(s);
+	s->destroy(&s);
+	for (int i = 0; i < 4; i++) {
+		close(listenfd[i]);
+	}
+	for (int i = 0; i < 3; i++) {
+		close(queued[i]);
+	}
+	return ret;
+}
+
+static int
+test_deadline (void)
+{
+	struct dnscache_addr addrs[SOURCE_NETWORK_MAX_ATTEMPTS];
+	int listenfd, queued;
+	struct source *s;
+	long msec;
+	int ret = 1;
+
+	// As many addresses as attempts, all hanging. Tried one after
+	// another, they would take far longer than the connect timeout:
+	if ((listenfd = listen_hanging(&addrs[0], &queued)) < 0) {
+		return 1;
+	}
+	for (int i = 1; i < SOURCE_NETWORK_MAX_ATTEMPTS; i++) {
+		addrs[i] = addrs[0];
+	}
+	if ((s = source_network_create("deadline", "test", "/", NULL, NULL, 80)) == NULL) {
+		return 1;
+	}
+	if (connect_addrs(s, addrs, SOURCE_NETWORK_MAX_ATTEMPTS, &msec) != SOURCE_OPEN_FAILED) {
+		printf("FAIL: deadline: connected to nothing\n");
+	}
+	else if (msec > SOURCE_NETWORK_CONNECT_TIMEOUT + 100) {
+		printf("FAIL: deadline: gave up after %ld ms\n", msec);
+	}
+	else {
+		ret = 0;
+	}
+	s->destroy(&s);
+	close(listenfd);
+	close(queued);
+	return ret;
+}
+
+int
+main ()
+{
+	int ret = 0;
+
+	ret |= test_race();
+	ret |= test_deadline();
+
+	return ret;
+}
@@ -0,0 +1,135 @@
+#include <stdio.h>
+
+#include "../pacer.c"
+
+// Allowed scheduling slack, in nsec:
+#define SLACK	(15 * 1000000LL)
+
+static int
+check_elapsed (const char *name, long long start, long long expect)
+{
+	long long elapsed = now_nsec() - start;
+
+	if (elapsed < expect || elapsed > expect + SLACK) {
+		printf("FAIL: %s: took %lld usec, expected %lld\n", name, elapsed / 1000, expect / 1000);
+		return 1;
+	}
+	return 0;
+}
+
+static int
+test_interval (void)
+{
+	struct pacer *p;
+	long long start;
+	int ret = 0;
+
+	// Ten frames at 10 ms, of which the first goes out immediately:
+	if ((p = pacer_create(10000, false, 1.0)) == NULL) {
+		return 1;
+	}
+	start = now_nsec();
+	for (int i = 0; i < 10; i++) {
+		pacer_wait(p, NULL, -1);
+	}
+	ret |= check_elapsed("interval", start, 90 * 1000000LL);
+
+	// Twice as fast:
+	pacer_destroy(&p);
+	if ((p = pacer_create(10000, false, 2.0)) == NULL) {
+		return 1;
+	}
+	start = now_nsec();
+	for (int i = 0; i < 10; i++) {
+		pacer_wait(p, NULL, -1);
+	}
+	ret |= check_elapsed("speed", start, 45 * 1000000LL);
+	pacer_destroy(&p);
+	return ret;
+}
+
+static int
+test_original (void)
+{
+	struct timespec capture[] = {
+		{ 1000, 0 },
+		{ 1000, 20000000 },
+		{ 1000, 70000000 },
+		{ 1000, 80000000 },
+		{ 5000, 0 },		// discontinuity;
+		{ 5000, 30000000 },
+	};
+	struct pacer *p;
+	long long start;
+	int ret = 0;
+
+	if ((p = pacer_create(10000, true, 1.0)) == NULL) {
+		return 1;
+	}
+	// 80 ms for the first four, 10 ms interval over the discontinuity,
+	// then 30 ms:
+	start = now_nsec();
+	for (unsigned int i = 0; i < sizeof(capture) / sizeof(capture[0]); i++) {
+		pacer_wait(p, &capture[i], -1);
+	}
+	ret |= check_elapsed("original", start, 120 * 1000000LL);
+
+	// Frames without a capture time fall back to the interval:
+	pacer_reset(p);
+	start = now_nsec();
+	for (int i = 0; i < 3; i++) {
+		pacer_wait(p, NULL, -1);
+	}
+	ret |= check_elapsed("fallback", start, 20 * 1000000LL);
+	pacer_destroy(&p);
+	return ret;
+}
+
+static int
+test_ready (void)
+{
+	struct pacer *p;
+	int ret = 0;
+
+	if ((p = pacer_create(50000, false, 1.0)) == NULL) {
+		return 1;
+	}
+	// The first frame is due right away, the second is not:
+	if (!pacer_ready(p, NULL)) {
+		printf("FAIL: first frame not ready\n");
+		ret = 1;
+	}
+	pacer_advance(p);
+	if (pacer_ready(p, NULL)) {
+		printf("FAIL: second frame ready too soon\n");
+		ret = 1;
+	}
+	// The descriptor becomes readable when it is:
+	{
+		struct pollfd pfd = { .fd = pacer_get_fd(p), .events = POLLIN };
+		long long start = now_nsec();
+
+		if (poll(&pfd, 1, 1000) != 1) {
+			printf("FAIL: timer did not fire\n");
+			ret = 1;
+		}
+		else if (now_nsec() - start > 50 * 1000000LL + SLACK || !pacer_ready(p, NULL)) {
+			printf("FAIL: timer fired at the wrong time\n");
+			ret = 1;
+		}
+	}
+	pacer_destroy(&p);
+	return ret;
+}
+
+int
+main ()
+{
+	int ret = 0;
+
+	ret |= test_interval();
+	ret |= test_original();
+	ret |= test_ready();
+
+	return ret;
+}
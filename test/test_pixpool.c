@@ -0,0 +1,149 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "../pixpool.c"
+
+static int
+test_reuse (void)
+{
+	struct pixpool *p;
+	unsigned char *a;
+	unsigned char *b;
+	int ret = 0;
+
+	if ((p = pixpool_create()) == NULL) {
+		return 1;
+	}
+	// A buffer that comes back is handed out again:
+	a = pixpool_get(p, 640, 480, 640 * 3);
+	memset(a, 0, 480 * 640 * 3);
+	pixpool_put(a);
+	if ((b = pixpool_get(p, 640, 480, 640 * 3)) != a) {
+		printf("FAIL: buffer was not reused\n");
+		ret = 1;
+	}
+	// Pixels are aligned:
+	if ((uintptr_t)b % HEADER_SIZE != 0) {
+		printf("FAIL: buffer is not aligned\n");
+		ret = 1;
+	}
+	// While one is out, another one is allocated:
+	if ((a = pixpool_get(p, 640, 480, 640 * 3)) == b) {
+		printf("FAIL: buffer handed out twice\n");
+		ret = 1;
+	}
+	pixpool_put(a);
+	pixpool_put(b);
+	if (p->nfree != 2 || p->outstanding != 0) {
+		printf("FAIL: %u free, %u outstanding\n", p->nfree, p->outstanding);
+		ret = 1;
+	}
+	pixpool_destroy(&p);
+	return ret;
+}
+
+static int
+test_resize (void)
+{
+	struct pixpool *p;
+	unsigned char *a;
+	unsigned char *b;
+	int ret = 0;
+
+	if ((p = pixpool_create()) == NULL) {
+		return 1;
+	}
+	// The free buffers go when the dimensions change:
+	a = pixpool_get(p, 640, 480, 640 * 3);
+	b = pixpool_get(p, 640, 480, 640 * 3);
+	pixpool_put(a);
+	a = pixpool_get(p, 1280, 720, 1280 * 3);
+	memset(a, 0, 720 * 1280 * 3);
+	if (p->nfree != 0) {
+		printf("FAIL: old buffers kept after resize\n");
+		ret = 1;
+	}
+	// So does one of the old size that comes back late:
+	pixpool_put(b);
+	if (p->nfree != 0) {
+		printf("FAIL: old buffer taken back after resize\n");
+		ret = 1;
+	}
+	// Same size, different stride:
+	pixpool_put(a);
+	b = pixpool_get(p, 1280, 720, 1280 * 4);
+	if (p->nfree != 0) {
+		printf("FAIL: buffers kept after change of stride\n");
+		ret = 1;
+	}
+	pixpool_put(b);
+	pixpool_destroy(&p);
+	return ret;
+}
+
+static int
+test_limit (void)
+{
+	struct pixpool *p;
+	unsigned char *bufs[MAX_FREE + 3];
+	int ret = 0;
+
+	if ((p = pixpool_create()) == NULL) {
+		return 1;
+	}
+	for (unsigned int i = 0; i < MAX_FREE + 3; i++) {
+		bufs[i] = pixpool_get(p, 64, 64, 64 * 3);
+	}
+	for (unsigned int i = 0; i < MAX_FREE + 3; i++) {
+		pixpool_put(bufs[i]);
+	}
+	if (p->nfree != MAX_FREE) {
+		printf("FAIL: %u free buffers kept, expected %u\n", p->nfree, MAX_FREE);
+		ret = 1;
+	}
+	pixpool_destroy(&p);
+	return ret;
+}
+
+static void *
+put_later (void *pixels)
+{
+	pixpool_put(pixels);
+	return NULL;
+}
+
+static int
+test_destroy_outstanding (void)
+{
+	struct pixpool *p;
+	unsigned char *a;
+	pthread_t thread;
+
+	// The pool outlives its destruction till the last buffer is back,
+	// which may come from another thread:
+	if ((p = pixpool_create()) == NULL) {
+		return 1;
+	}
+	a = pixpool_get(p, 320, 240, 320 * 3);
+	pixpool_destroy(&p);
+	memset(a, 0, 240 * 320 * 3);
+	if (pthread_create(&thread, NULL, put_later, a) != 0) {
+		return 1;
+	}
+	pthread_join(thread, NULL);
+	return 0;
+}
+
+int
+main ()
+{
+	int ret = 0;
+
+	ret |= test_reuse();
+	ret |= test_resize();
+	ret |= test_limit();
+	ret |= test_destroy_outstanding();
+
+	return ret;
+}
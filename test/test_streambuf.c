@@ -0,0 +1,271 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "../mjv_log.c"
+#include "../slab.c"
+#include "../streambuf.c"
+
+static int
+test_mirror_alias (void)
+{
+	struct streambuf *sb;
+	char *base;
+	unsigned int size;
+	int ret = 0;
+
+	if ((sb = streambuf_create(5000, STREAMBUF_MIRRORED)) == NULL) {
+		return 1;
+	}
+	if (streambuf_get_type(sb) != STREAMBUF_MIRRORED) {
+		printf("Skipping mirror test, not supported\n");
+		streambuf_destroy(&sb);
+		return 0;
+	}
+	base = streambuf_base(sb);
+	size = streambuf_size(sb);
+
+	// Size must have been rounded up to whole pages:
+	if (size < 5000 || size % sysconf(_SC_PAGESIZE) != 0) {
+		printf("FAIL: bad mirror size %u\n", size);
+		ret = 1;
+	}
+	// Write across the end of the first copy,
+	// read back from the start of the first copy:
+	memcpy(base + size - 3, "abcdef", 6);
+	if (memcmp(base, "def", 3) != 0) {
+		printf("FAIL: second copy does not alias the first\n");
+		ret = 1;
+	}
+	streambuf_destroy(&sb);
+	return ret;
+}
+
+static int
+test_mirror_compact (void)
+{
+	struct streambuf *sb;
+	char *base;
+	unsigned int size;
+	int ret = 0;
+
+	if ((sb = streambuf_create(4096, STREAMBUF_MIRRORED)) == NULL) {
+		return 1;
+	}
+	if (streambuf_get_type(sb) != STREAMBUF_MIRRORED) {
+		streambuf_destroy(&sb);
+		return 0;
+	}
+	base = streambuf_base(sb);
+	size = streambuf_size(sb);
+
+	// A window inside the first copy stays put:
+	if (streambuf_compact(sb, base + 100, base + 200) != 0) {
+		printf("FAIL: window in first copy was moved\n");
+		ret = 1;
+	}
+	// A window that starts in the second copy is shifted back:
+	if (streambuf_compact(sb, base + size + 10, base + size + 20) != -(ptrdiff_t)size) {
+		printf("FAIL: window in second copy not shifted back\n");
+		ret = 1;
+	}
+	// The free space wraps around behind the window:
+	if (streambuf_space(sb, base + size - 10, base + size + 10) != size - 20) {
+		printf("FAIL: wrong free space in mirrored buffer\n");
+		ret = 1;
+	}
+	streambuf_destroy(&sb);
+	return ret;
+}
+
+static int
+test_flat_compact (void)
+{
+	struct streambuf *sb;
+	char *base;
+	ptrdiff_t shift;
+	int ret = 0;
+
+	if ((sb = streambuf_create(1000, STREAMBUF_FLAT)) == NULL) {
+		return 1;
+	}
+	base = streambuf_base(sb);
+
+	// Plenty of space left at the end, so no move:
+	if (streambuf_compact(sb, base + 10, base + 20) != 0) {
+		printf("FAIL: flat buffer moved needlessly\n");
+		ret = 1;
+	}
+	// Space is scarce, move the bytes to keep to the start:
+	memcpy(base + 900, "keepme", 6);
+	if ((shift = streambuf_compact(sb, base + 900, base + 906)) != -900) {
+		printf("FAIL: flat buffer not compacted\n");
+		ret = 1;
+	}
+	if (memcmp(base, "keepme", 6) != 0) {
+		printf("FAIL: compacted bytes corrupted\n");
+		ret = 1;
+	}
+	// Nothing to keep, rewind to start:
+	if (streambuf_compact(sb, base + 50, base + 50) != -50) {
+		printf("FAIL: empty flat buffer not rewound\n");
+		ret = 1;
+	}
+	streambuf_destroy(&sb);
+	return ret;
+}
+
+static int
+test_resize (enum streambuf_type type)
+{
+	struct streambuf *sb;
+	char *base;
+	ptrdiff_t shift;
+	int ret = 0;
+
+	if ((sb = streambuf_create(1000, type)) == NULL) {
+		return 1;
+	}
+	base = streambuf_base(sb);
+	memcpy(base + 500, "keepme", 6);
+
+	// Cannot shrink below the bytes in use:
+	if (streambuf_resize(sb, 3, base + 500, base + 506, &shift)) {
+		printf("FAIL: resize cut off bytes in use\n");
+		ret = 1;
+	}
+	if (!streambuf_resize(sb, 100000, base + 500, base + 506, &shift)) {
+		printf("FAIL: could not grow buffer\n");
+		streambuf_destroy(&sb);
+		return 1;
+	}
+	if (streambuf_size(sb) < 100000) {
+		printf("FAIL: buffer did not grow\n");
+		ret = 1;
+	}
+	if (memcmp(base + 500 + shift, "keepme", 6) != 0) {
+		printf("FAIL: bytes lost in resize\n");
+		ret = 1;
+	}
+	streambuf_destroy(&sb);
+	return ret;
+}
+
+static int
+test_slab_compact (void)
+{
+	struct streambuf *sb;
+	struct slab *frame_ref;
+	char *base;
+	ptrdiff_t shift;
+	int ret = 0;
+
+	if ((sb = streambuf_create(1000, STREAMBUF_SLAB)) == NULL) {
+		return 1;
+	}
+	base = streambuf_base(sb);
+
+	// Unshared slab behaves like a flat buffer:
+	memcpy(base + 900, "keepme", 6);
+	if (streambuf_compact(sb, base + 900, base + 906) != -900 || memcmp(base, "keepme", 6) != 0) {
+		printf("FAIL: unshared slab not compacted in place\n");
+		ret = 1;
+	}
+	// Hold a reference to the slab, as a frame would:
+	frame_ref = slab_ref(streambuf_get_slab(sb));
+	memcpy(base + 100, "frame", 5);
+	memcpy(base + 900, "keepme", 6);
+
+	// Even with nothing to keep, a shared slab is not rewound:
+	if (streambuf_compact(sb, base + 200, base + 200) != 0) {
+		printf("FAIL: shared slab was rewound\n");
+		ret = 1;
+	}
+	// When space runs out, move to a fresh slab:
+	shift = streambuf_compact(sb, base + 900, base + 906);
+	if (streambuf_base(sb) == base || memcmp(base + 900 + shift, "keepme", 6) != 0) {
+		printf("FAIL: shared slab not moved to a fresh slab\n");
+		ret = 1;
+	}
+	// The old bytes are still there for the frame:
+	if (memcmp(slab_data(frame_ref) + 100, "frame", 5) != 0 || slab_is_shared(frame_ref)) {
+		printf("FAIL: frame bytes lost\n");
+		ret = 1;
+	}
+	slab_unref(&frame_ref);
+	streambuf_destroy(&sb);
+	return ret;
+}
+
+static int
+test_mapped (void)
+{
+	struct streambuf *sb;
+	struct slab *map;
+	char path[] = "/tmp/test_streambuf_XXXXXX";
+	char *base;
+	ptrdiff_t shift;
+	int fd;
+	int ret = 0;
+
+	if ((fd = mkstemp(path)) < 0) {
+		return 1;
+	}
+	unlink(path);
+	if (write(fd, "0123456789", 10) != 10 || (map = slab_create_mapped(fd, 10)) == NULL) {
+		close(fd);
+		return 1;
+	}
+	close(fd);
+
+	if ((sb = streambuf_create_mapped(map)) == NULL) {
+		slab_unref(&map);
+		return 1;
+	}
+	// The buffer takes its own reference:
+	slab_unref(&map);
+	base = streambuf_base(sb);
+
+	if (streambuf_size(sb) != 10 || memcmp(base, "0123456789", 10) != 0) {
+		printf("FAIL: mapped buffer does not hold the file\n");
+		ret = 1;
+	}
+	// Always full, and never moves:
+	if (streambuf_space(sb, base + 5, base + 5) != 0) {
+		printf("FAIL: mapped buffer has free space\n");
+		ret = 1;
+	}
+	if (streambuf_compact(sb, base + 9, base + 10) != 0
+	 || streambuf_reserve(sb, 4, base + 9, base + 10) != 0
+	 || streambuf_resize(sb, 100, base + 9, base + 10, &shift)
+	 || streambuf_base(sb) != base) {
+		printf("FAIL: mapped buffer was moved\n");
+		ret = 1;
+	}
+	// Others can hold on to the mapping after the buffer is gone:
+	map = slab_ref(streambuf_get_slab(sb));
+	streambuf_destroy(&sb);
+	if (memcmp(slab_data(map) + 5, "56789", 5) != 0) {
+		printf("FAIL: mapping lost\n");
+		ret = 1;
+	}
+	slab_unref(&map);
+	return ret;
+}
+
+int
+main ()
+{
+	int ret = 0;
+
+	ret |= test_mirror_alias();
+	ret |= test_mirror_compact();
+	ret |= test_flat_compact();
+	ret |= test_resize(STREAMBUF_FLAT);
+	ret |= test_resize(STREAMBUF_MIRRORED);
+	ret |= test_resize(STREAMBUF_SLAB);
+	ret |= test_slab_compact();
+	ret |= test_mapped();
+
+	return ret;
+}
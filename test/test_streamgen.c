@@ -0,0 +1,173 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../frame.h"
+#include "../mjv_grabber.h"
+#include "../streamgen.h"
+
+// Offset of the frame number in the comment segment of each image:
+#define FRAMENUM_OFFSET	(20 + 4 + 6)
+
+static char *
+generate (const struct streamgen_opts *opts, size_t *len)
+{
+	char *buf = NULL;
+	size_t nbytes;
+	FILE *fp;
+
+	if ((fp = open_memstream(&buf, len)) == NULL) {
+		return NULL;
+	}
+	nbytes = streamgen_write(fp, opts);
+	fclose(fp);
+	if (nbytes != *len) {
+		printf("FAIL: wrote %zu bytes, reported %zu\n", *len, nbytes);
+		free(buf);
+		return NULL;
+	}
+	return buf;
+}
+
+static int
+test_parse (const char *name, const struct streamgen_opts *opts)
+{
+	struct mjv_grabber *g;
+	struct mjv_grabber_stats stats;
+	struct frame *f;
+	unsigned int n = 0;
+	size_t len;
+	size_t off = 0;
+	char *buf;
+	int ret = 0;
+
+	if ((buf = generate(opts, &len)) == NULL) {
+		printf("FAIL: %s: could not generate stream\n", name);
+		return 1;
+	}
+	if ((g = mjv_grabber_create(NULL)) == NULL) {
+		free(buf);
+		return 1;
+	}
+	// Feed the stream in odd-sized pieces, and check that
+	// all frames come out, in order:
+	while (off < len) {
+		size_t piece = (len - off < 7919) ? len - off : 7919;
+
+		if (mjv_grabber_feed(g, buf + off, piece) != MJV_GRABBER_SUCCESS) {
+			printf("FAIL: %s: grabber error at offset %zu\n", name, off);
+			ret = 1;
+			break;
+		}
+		off += piece;
+
+		while ((f = mjv_grabber_next_frame(g)) != NULL) {
+			unsigned int framenum = atoi((char *)frame_get_rawbits(f) + FRAMENUM_OFFSET);
+
+			if (framenum != n && ret == 0) {
+				printf("FAIL: %s: frame %u has number %u\n", name, n, framenum);
+				ret = 1;
+			}
+			n++;
+			frame_destroy(&f);
+		}
+	}
+	mjv_grabber_get_stats(g, &stats);
+	if (ret == 0 && n != opts->frames) {
+		printf("FAIL: %s: got %u frames, expected %u\n", name, n, opts->frames);
+		ret = 1;
+	}
+	if (stats.bad_start + stats.bad_end + stats.bad_segment + stats.oversize > 0) {
+		printf("FAIL: %s: grabber dropped frames\n", name);
+		ret = 1;
+	}
+	mjv_grabber_destroy(&g);
+	free(buf);
+	return ret;
+}
+
+static int
+test_variants (void)
+{
+	struct streamgen_opts opts;
+	int ret = 0;
+
+	streamgen_defaults(&opts);
+	opts.frames = 50;
+	opts.max_size = 50000;
+	ret |= test_parse("defaults", &opts);
+
+	opts.lf = true;
+	opts.casing = STREAMGEN_CASING_LOWER;
+	ret |= test_parse("lf, lower case", &opts);
+
+	opts.lf = false;
+	opts.casing = STREAMGEN_CASING_MIXED;
+	opts.no_length_pct = 50;
+	opts.garbage_pct = 50;
+	ret |= test_parse("mixed case, no length, garbage", &opts);
+
+	opts.boundary_len = 1;
+	opts.no_length_pct = 100;
+	ret |= test_parse("short boundary", &opts);
+
+	opts.boundary_len = 70;
+	opts.min_size = 0;
+	opts.max_size = 100;
+	ret |= test_parse("long boundary, tiny images", &opts);
+
+	opts.frames = 3;
+	opts.min_size = 2000000;
+	opts.max_size = 2097152;
+	ret |= test_parse("huge images", &opts);
+
+	return ret;
+}
+
+static int
+test_deterministic (void)
+{
+	struct streamgen_opts opts;
+	char *a, *b, *c;
+	size_t len_a, len_b, len_c;
+	int ret = 0;
+
+	streamgen_defaults(&opts);
+	opts.frames = 20;
+	opts.casing = STREAMGEN_CASING_MIXED;
+	opts.garbage_pct = 50;
+
+	a = generate(&opts, &len_a);
+	b = generate(&opts, &len_b);
+	opts.seed = 2;
+	c = generate(&opts, &len_c);
+
+	if (a == NULL || b == NULL || c == NULL) {
+		ret = 1;
+	}
+	else if (len_a != len_b || memcmp(a, b, len_a) != 0) {
+		printf("FAIL: same seed, different streams\n");
+		ret = 1;
+	}
+	else if (len_a == len_c && memcmp(a, c, len_a) == 0) {
+		printf("FAIL: different seed, same stream\n");
+		ret = 1;
+	}
+	free(a);
+	free(b);
+	free(c);
+	return ret;
+}
+
+int
+main ()
+{
+	int ret = 0;
+
+	ret |= test_variants();
+	ret |= test_deterministic();
+
+	return ret;
+}
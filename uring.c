@@ -0,0 +1,577 @@
+#ifdef HAVE_IO_URING
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <linux/io_uring.h>
+
+#include "mjv_log.h"
+#include "uring.h"
+
+#define RING_ENTRIES	64
+#define NBUFS		16		// power of two, for the buffer ring;
+#define BUFSIZE		65536
+
+// Completion tags:
+#define TAG_RECV	(1ULL << 32)
+#define TAG_CANCEL	(2ULL << 32)
+#define TAG_FILE	(3ULL << 32)
+#define TAG_MASK	(0xFFFFFFFFULL << 32)
+
+enum slot_state
+{ SLOT_IDLE
+, SLOT_IN_FLIGHT
+, SLOT_DONE
+};
+
+// A regular file read into one fixed buffer:
+struct slot {
+	enum slot_state state;
+	off_t offset;
+	int res;
+};
+
+// A received chunk, waiting to be copied out:
+struct chunk {
+	unsigned int bid;
+	unsigned int len;
+};
+
+struct uring {
+	int fd;			// the descriptor being read;
+	int ring_fd;
+	bool is_socket;
+
+	// Submission and completion rings, shared with the kernel:
+	void *ring;
+	size_t ring_size;
+	struct io_uring_sqe *sqes;
+	size_t sqes_size;
+	unsigned int *sq_head;
+	unsigned int *sq_tail;
+	unsigned int *sq_array;
+	unsigned int sq_mask;
+	unsigned int sq_entries;
+	unsigned int *cq_head;
+	unsigned int *cq_tail;
+	unsigned int cq_mask;
+	struct io_uring_cqe *cqes;
+	unsigned int to_submit;
+
+	// The buffers, NBUFS times BUFSIZE:
+	char *bufs;
+
+	// Sockets: buffer ring and received chunks, in order:
+	struct io_uring_buf_ring *br;
+	unsigned short br_tail;
+	struct chunk chunks[NBUFS];
+	unsigned int chunk_head;
+	unsigned int chunk_count;
+	bool recv_armed;
+	bool received;		// whether any receive has completed yet;
+	bool unsupported;	// whether the kernel lacks multishot receive;
+
+	// Regular files: one read in flight per buffer:
+	struct slot slots[NBUFS];
+	unsigned int cur;	// the slot to consume next;
+	off_t pos;		// file offset of the next byte to consume;
+	off_t next_offset;	// file offset of the next read to submit;
+
+	// Where to continue copying in the current buffer:
+	unsigned int consumed;
+
+	bool cancel_armed;
+	bool cancelled;
+	bool eof;
+	int error;
+};
+
+static inline int
+sys_io_uring_setup (unsigned int entries, struct io_uring_params *p)
+{
+	return syscall(__NR_io_uring_setup, entries, p);
+}
+
+static inline int
+sys_io_uring_enter (int fd, unsigned int to_submit, unsigned int min_complete, unsigned int flags, void *arg, size_t argsz)
+{
+	return syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, arg, argsz);
+}
+
+static inline int
+sys_io_uring_register (int fd, unsigned int opcode, void *arg, unsigned int nr_args)
+{
+	return syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+static bool
+map_rings (struct uring *u, struct io_uring_params *p)
+{
+	size_t sq_size = p->sq_off.array + p->sq_entries * sizeof(unsigned int);
+	size_t cq_size = p->cq_off.cqes + p->cq_entries * sizeof(struct io_uring_cqe);
+	char *sq;
+	char *cq;
+
+	// Both rings share one mapping:
+	if (!(p->features & IORING_FEAT_SINGLE_MMAP) || !(p->features & IORING_FEAT_EXT_ARG)) {
+		return false;
+	}
+	u->ring_size = (sq_size > cq_size) ? sq_size : cq_size;
+	if ((u->ring = mmap(NULL, u->ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, u->ring_fd, IORING_OFF_SQ_RING)) == MAP_FAILED) {
+		u->ring = NULL;
+		return false;
+	}
+	u->sqes_size = p->sq_entries * sizeof(struct io_uring_sqe);
+	if ((u->sqes = mmap(NULL, u->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, u->ring_fd, IORING_OFF_SQES)) == MAP_FAILED) {
+		u->sqes = NULL;
+		return false;
+	}
+	sq = cq = u->ring;
+	u->sq_head    = (unsigned int *)(sq + p->sq_off.head);
+	u->sq_tail    = (unsigned int *)(sq + p->sq_off.tail);
+	u->sq_array   = (unsigned int *)(sq + p->sq_off.array);
+	u->sq_mask    = *(unsigned int *)(sq + p->sq_off.ring_mask);
+	u->sq_entries = *(unsigned int *)(sq + p->sq_off.ring_entries);
+	u->cq_head    = (unsigned int *)(cq + p->cq_off.head);
+	u->cq_tail    = (unsigned int *)(cq + p->cq_off.tail);
+	u->cq_mask    = *(unsigned int *)(cq + p->cq_off.ring_mask);
+	u->cqes       = (struct io_uring_cqe *)(cq + p->cq_off.cqes);
+	return true;
+}
+
+static struct io_uring_sqe *
+get_sqe (struct uring *u)
+{
+	unsigned int tail = *u->sq_tail;
+	unsigned int head = __atomic_load_n(u->sq_head, __ATOMIC_ACQUIRE);
+	struct io_uring_sqe *sqe;
+
+	// The ring is sized so that this cannot happen:
+	if (tail - head >= u->sq_entries) {
+		return NULL;
+	}
+	sqe = &u->sqes[tail & u->sq_mask];
+	memset(sqe, 0, sizeof(*sqe));
+	u->sq_array[tail & u->sq_mask] = tail & u->sq_mask;
+	__atomic_store_n(u->sq_tail, tail + 1, __ATOMIC_RELEASE);
+	u->to_submit++;
+	return sqe;
+}
+
+static int
+enter (struct uring *u, unsigned int min_complete, int timeout_sec)
+{
+	struct __kernel_timespec ts;
+	struct io_uring_getevents_arg arg;
+	unsigned int flags = 0;
+	int ret;
+
+	memset(&arg, 0, sizeof(arg));
+	if (min_complete > 0) {
+		ts.tv_sec = timeout_sec;
+		ts.tv_nsec = 0;
+		arg.sigmask_sz = _NSIG / 8;
+		arg.ts = (uint64_t)(uintptr_t)&ts;
+		flags = IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG;
+	}
+	if ((ret = sys_io_uring_enter(u->ring_fd, u->to_submit, min_complete, flags, (min_complete > 0) ? &arg : NULL, (min_complete > 0) ? sizeof(arg) : 0)) >= 0) {
+		u->to_submit -= ((unsigned int)ret < u->to_submit) ? (unsigned int)ret : u->to_submit;
+	}
+	return ret;
+}
+
+static bool
+arm_recv (struct uring *u)
+{
+	struct io_uring_sqe *sqe;
+
+	// One request keeps receiving into the buffer ring until it runs
+	// out of buffers or the connection ends:
+	if ((sqe = get_sqe(u)) == NULL) {
+		return false;
+	}
+	sqe->opcode = IORING_OP_RECV;
+	sqe->fd = u->fd;
+	sqe->ioprio = IORING_RECV_MULTISHOT;
+	sqe->flags = IOSQE_BUFFER_SELECT;
+	sqe->buf_group = 0;
+	sqe->user_data = TAG_RECV;
+	u->recv_armed = true;
+	return true;
+}
+
+static bool
+arm_cancel (struct uring *u, int cancel_fd)
+{
+	struct io_uring_sqe *sqe;
+
+	if ((sqe = get_sqe(u)) == NULL) {
+		return false;
+	}
+	sqe->opcode = IORING_OP_POLL_ADD;
+	sqe->fd = cancel_fd;
+	sqe->poll32_events = POLLIN;
+	sqe->user_data = TAG_CANCEL;
+	u->cancel_armed = true;
+	return true;
+}
+
+static bool
+submit_slot (struct uring *u, unsigned int i)
+{
+	struct io_uring_sqe *sqe;
+
+	if ((sqe = get_sqe(u)) == NULL) {
+		return false;
+	}
+	sqe->opcode = IORING_OP_READ_FIXED;
+	sqe->fd = u->fd;
+	sqe->addr = (uint64_t)(uintptr_t)(u->bufs + (size_t)i * BUFSIZE);
+	sqe->len = BUFSIZE;
+	sqe->off = u->next_offset;
+	sqe->buf_index = i;
+	sqe->user_data = TAG_FILE | i;
+
+	u->slots[i].state = SLOT_IN_FLIGHT;
+	u->slots[i].offset = u->next_offset;
+	u->next_offset += BUFSIZE;
+	return true;
+}
+
+static void
+recycle_buffer (struct uring *u, unsigned int bid)
+{
+	struct io_uring_buf *b = &u->br->bufs[u->br_tail & (NBUFS - 1)];
+
+	// Hand the buffer back to the kernel; no system call needed:
+	b->addr = (uint64_t)(uintptr_t)(u->bufs + (size_t)bid * BUFSIZE);
+	b->len = BUFSIZE;
+	b->bid = bid;
+	__atomic_store_n(&u->br->tail, ++u->br_tail, __ATOMIC_RELEASE);
+}
+
+static void
+reap (struct uring *u)
+{
+	unsigned int head = *u->cq_head;
+	unsigned int tail = __atomic_load_n(u->cq_tail, __ATOMIC_ACQUIRE);
+
+	for (; head != tail; head++) {
+		struct io_uring_cqe *cqe = &u->cqes[head & u->cq_mask];
+
+		switch (cqe->user_data & TAG_MASK)
+		{
+			case TAG_CANCEL:
+				u->cancelled = true;
+				break;
+
+			case TAG_FILE: {
+				struct slot *slot = &u->slots[cqe->user_data & (NBUFS - 1)];
+				slot->res = cqe->res;
+				slot->state = SLOT_DONE;
+				break;
+			}
+			case TAG_RECV:
+				if (!(cqe->flags & IORING_CQE_F_MORE)) {
+					u->recv_armed = false;
+				}
+				// Kernels before 6.0 have io_uring, but refuse
+				// a multishot receive:
+				if (cqe->res == -EINVAL && !u->received) {
+					u->unsupported = true;
+					break;
+				}
+				u->received = true;
+				if (cqe->res > 0 && (cqe->flags & IORING_CQE_F_BUFFER)) {
+					struct chunk *c = &u->chunks[(u->chunk_head + u->chunk_count++) % NBUFS];
+					c->bid = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+					c->len = cqe->res;
+				}
+				else if (cqe->res == 0) {
+					u->eof = true;
+				}
+				// Out of buffers is not an error; rearm when
+				// a buffer has been handed back:
+				else if (cqe->res < 0 && cqe->res != -ENOBUFS) {
+					u->error = -cqe->res;
+				}
+				break;
+		}
+	}
+	__atomic_store_n(u->cq_head, head, __ATOMIC_RELEASE);
+}
+
+static size_t
+copy_socket (struct uring *u, char *buf, size_t bufsize)
+{
+	size_t total = 0;
+
+	while (total < bufsize && u->chunk_count > 0) {
+		struct chunk *c = &u->chunks[u->chunk_head];
+		size_t n = c->len - u->consumed;
+
+		if (n > bufsize - total) {
+			n = bufsize - total;
+		}
+		memcpy(buf + total, u->bufs + (size_t)c->bid * BUFSIZE + u->consumed, n);
+		total += n;
+		if ((u->consumed += n) < c->len) {
+			break;
+		}
+		recycle_buffer(u, c->bid);
+		u->chunk_head = (u->chunk_head + 1) % NBUFS;
+		u->chunk_count--;
+		u->consumed = 0;
+	}
+	if (!u->recv_armed && !u->eof && u->error == 0) {
+		arm_recv(u);
+	}
+	return total;
+}
+
+static size_t
+copy_file (struct uring *u, char *buf, size_t bufsize)
+{
+	size_t total = 0;
+
+	while (total < bufsize) {
+		struct slot *slot = &u->slots[u->cur];
+		size_t n;
+
+		if (slot->state != SLOT_DONE) {
+			break;
+		}
+		// After a short read, the reads queued behind it started
+		// too far ahead; redo them from the current position:
+		if (u->consumed == 0 && slot->offset != u->pos) {
+			u->next_offset = u->pos;
+			submit_slot(u, u->cur);
+			break;
+		}
+		if (slot->res < 0) {
+			u->error = -slot->res;
+			break;
+		}
+		if (slot->res == 0) {
+			u->eof = true;
+			break;
+		}
+		if ((n = slot->res - u->consumed) > bufsize - total) {
+			n = bufsize - total;
+		}
+		memcpy(buf + total, u->bufs + (size_t)u->cur * BUFSIZE + u->consumed, n);
+		total += n;
+		u->pos += n;
+		if ((u->consumed += n) < (unsigned int)slot->res) {
+			break;
+		}
+		u->consumed = 0;
+		submit_slot(u, u->cur);
+		u->cur = (u->cur + 1) % NBUFS;
+	}
+	return total;
+}
+
+ssize_t
+uring_read (struct uring *u, void *buf, size_t bufsize, int timeout_sec, int cancel_fd)
+{
+	size_t n;
+
+	if (cancel_fd >= 0 && !u->cancel_armed) {
+		arm_cancel(u, cancel_fd);
+	}
+	for (;;)
+	{
+		reap(u);
+		if (u->cancelled) {
+			return -1;
+		}
+		if (u->unsupported) {
+			errno = EOPNOTSUPP;
+			return -1;
+		}
+		n = (u->is_socket)
+			? copy_socket(u, buf, bufsize)
+			: copy_file(u, buf, bufsize);
+
+		if (n > 0) {
+			// Pass on refills in batches, without waiting:
+			if (u->to_submit >= NBUFS / 2) {
+				enter(u, 0, 0);
+			}
+			return n;
+		}
+		if (u->error != 0) {
+			log_error("Read error: %s\n", strerror(u->error));
+			return -1;
+		}
+		if (u->eof) {
+			return 0;
+		}
+		// Nothing buffered; submit what is pending and wait:
+		if (enter(u, 1, timeout_sec) < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			if (errno == ETIME) {
+				log_info("Timeout reached. Giving up.\n");
+				return -1;
+			}
+			log_error("io_uring_enter: %s\n", strerror(errno));
+			return -1;
+		}
+	}
+}
+
+static bool
+setup_socket (struct uring *u)
+{
+	struct io_uring_buf_reg reg;
+
+	// The buffer ring must be page aligned:
+	if ((u->br = mmap(NULL, NBUFS * sizeof(struct io_uring_buf), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0)) == MAP_FAILED) {
+		u->br = NULL;
+		return false;
+	}
+	memset(&reg, 0, sizeof(reg));
+	reg.ring_addr = (uint64_t)(uintptr_t)u->br;
+	reg.ring_entries = NBUFS;
+	reg.bgid = 0;
+	if (sys_io_uring_register(u->ring_fd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0) {
+		return false;
+	}
+	u->br_tail = 0;
+	for (unsigned int i = 0; i < NBUFS; i++) {
+		recycle_buffer(u, i);
+	}
+	return arm_recv(u);
+}
+
+static bool
+setup_file (struct uring *u)
+{
+	struct iovec iov[NBUFS];
+
+	for (unsigned int i = 0; i < NBUFS; i++) {
+		iov[i].iov_base = u->bufs + (size_t)i * BUFSIZE;
+		iov[i].iov_len = BUFSIZE;
+	}
+	if (sys_io_uring_register(u->ring_fd, IORING_REGISTER_BUFFERS, iov, NBUFS) < 0) {
+		return false;
+	}
+	// Read from the current position onwards:
+	if ((u->pos = u->next_offset = lseek(u->fd, 0, SEEK_CUR)) < 0) {
+		return false;
+	}
+	for (unsigned int i = 0; i < NBUFS; i++) {
+		if (!submit_slot(u, i)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+struct uring *
+uring_create (int fd)
+{
+	struct uring *u;
+	struct io_uring_params p;
+	struct stat st;
+
+	if (fstat(fd, &st) < 0 || !(S_ISSOCK(st.st_mode) || S_ISREG(st.st_mode))) {
+		return NULL;
+	}
+	if ((u = calloc(1, sizeof(*u))) == NULL) {
+		return NULL;
+	}
+	u->fd = fd;
+	u->is_socket = S_ISSOCK(st.st_mode);
+
+	memset(&p, 0, sizeof(p));
+	if ((u->ring_fd = sys_io_uring_setup(RING_ENTRIES, &p)) < 0) {
+		log_debug("io_uring_setup: %s\n", strerror(errno));
+		goto err;
+	}
+	if (!map_rings(u, &p)) {
+		goto err;
+	}
+	if ((u->bufs = mmap(NULL, (size_t)NBUFS * BUFSIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0)) == MAP_FAILED) {
+		u->bufs = NULL;
+		goto err;
+	}
+	if (!(u->is_socket ? setup_socket(u) : setup_file(u))) {
+		log_debug("io_uring: could not set up buffers: %s\n", strerror(errno));
+		goto err;
+	}
+	// Start reading right away. A receive that the kernel does not
+	// support usually fails on submission, so check for that now:
+	if (enter(u, 0, 0) < 0) {
+		goto err;
+	}
+	reap(u);
+	if (u->unsupported) {
+		log_debug("io_uring: no multishot receive\n");
+		goto err;
+	}
+	return u;
+
+err:	uring_destroy(&u);
+	return NULL;
+}
+
+static void
+cancel_recv (struct uring *u)
+{
+	struct io_uring_sqe *sqe;
+
+	// The buffer ring is plain user memory; make sure the kernel is
+	// done receiving into it before it is unmapped:
+	if ((sqe = get_sqe(u)) == NULL) {
+		return;
+	}
+	sqe->opcode = IORING_OP_ASYNC_CANCEL;
+	sqe->addr = TAG_RECV;
+	while (u->recv_armed && enter(u, 1, 1) >= 0) {
+		reap(u);
+	}
+}
+
+void
+uring_destroy (struct uring **u)
+{
+	if (u == NULL || *u == NULL) {
+		return;
+	}
+	if ((*u)->recv_armed && (*u)->sqes != NULL) {
+		cancel_recv(*u);
+	}
+	// Closing the ring cancels whatever is still in flight:
+	if ((*u)->ring_fd >= 0) {
+		close((*u)->ring_fd);
+	}
+	if ((*u)->sqes != NULL) {
+		munmap((*u)->sqes, (*u)->sqes_size);
+	}
+	if ((*u)->ring != NULL) {
+		munmap((*u)->ring, (*u)->ring_size);
+	}
+	if ((*u)->br != NULL) {
+		munmap((*u)->br, NBUFS * sizeof(struct io_uring_buf));
+	}
+	if ((*u)->bufs != NULL) {
+		munmap((*u)->bufs, (size_t)NBUFS * BUFSIZE);
+	}
+	free(*u);
+	*u = NULL;
+}
+
+#endif	// HAVE_IO_URING
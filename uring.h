@@ -0,0 +1,25 @@
+#ifndef URING_H
+#define URING_H
+
+// Reads a descriptor through io_uring. The kernel keeps reading into a set
+// of registered buffers in the background, and a read only enters the
+// kernel when none of them hold data yet. Sockets use a multishot receive
+// into a ring of provided buffers; regular files keep one fixed-buffer read
+// in flight per buffer, at consecutive offsets. Reads copy the data out of
+// the registered buffers, so this saves system calls, not copies. Other
+// descriptors, and kernels without io_uring or (for sockets) without
+// multishot receive, are not supported; uring_create() then returns NULL
+// and the caller should fall back to plain reads.
+
+struct uring;
+
+struct uring *uring_create (int fd);
+void uring_destroy (struct uring **);
+
+// Blocks till data is available, end of file, timeout or error. Also
+// returns -1 if cancel_fd (if not negative) becomes readable. If the
+// kernel turns out not to support the receive after all, returns -1
+// with errno set to EOPNOTSUPP, before any data was read:
+ssize_t uring_read (struct uring *, void *buf, size_t bufsize, int timeout_sec, int cancel_fd);
+
+#endif	// URING_H